@@ -6,14 +6,30 @@
 #include <Wire.h>
 #include <LiquidCrystal_I2C.h>
 #include <DHT.h>
+
+// Only the ArduinoJson features the JSON payload needs
+#define ARDUINOJSON_USE_DOUBLE 0
+#define ARDUINOJSON_USE_LONG_LONG 0
+#define ARDUINOJSON_ENABLE_STD_STRING 0
+#define ARDUINOJSON_ENABLE_STD_STREAM 0
+#define ARDUINOJSON_ENABLE_ARDUINO_STRING 0
+#define ARDUINOJSON_ENABLE_ARDUINO_STREAM 0
 #include <ArduinoJson.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_tls.h>
+#include <mbedtls/ssl.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+#include "control_logic.h"
+#include "lcd_display.h"
+#include "sample_clock.h"
+#include "schedule.h"
 
 // ============ PIN DEFINITIONS ============
 #define DHT22_PIN 4
 #define DHT_TYPE DHT22
 #define LCD_ADDRESS 0x27
-#define LCD_COLS 16
-#define LCD_ROWS 2
 #define LIGHT_PIN 34
 #define FAN_RELAY_PIN 26
 #define LIGHT_RELAY_PIN 27
@@ -22,17 +38,304 @@
 #define LIGHT_LED_PIN 33
 #define ALARM_LED_PIN 14
 
-// ============ THRESHOLD VALUES ============
-#define TEMP_HIGH 30.0
-#define HUMIDITY_HIGH 70.0
-#define LIGHT_LOW 500
-
 // ============ TIMING CONFIGURATION ============
 #define SENSOR_READ_INTERVAL 2000 // Read sensors every 2 seconds
+#define DATA_SEND_INTERVAL 10000  // Record a sample every 10 seconds
+#define UPLOAD_BATCH_SIZE 6       // Samples per regular upload
+#define UPLOAD_INTERVAL (DATA_SEND_INTERVAL * UPLOAD_BATCH_SIZE)
+#define UPLOAD_JITTER (UPLOAD_INTERVAL / 10) // Random +/- spread per upload
+#define UPLOAD_FLUSH_SIZE (UPLOAD_BATCH_SIZE * 2) // Samples that force an early upload
+#define MAX_UPLOAD_INTERVAL (UPLOAD_INTERVAL * 4) // Slowest cadence a backend hint can ask for
+#define MAX_UPLOAD_BATCH_SIZE (UPLOAD_BATCH_SIZE * 4) // Largest batch a backend hint can ask for
+#define UPLOAD_BACKOFF_BASE (UPLOAD_INTERVAL / 4) // First wait after an upload got no answer, doubling up to MAX_UPLOAD_INTERVAL
+#define ZONE_CONTROL_TTL_UPLOADS 3 // Local rules after this many upload intervals without zone control
+#define SAMPLE_BUFFER_SIZE (MAX_UPLOAD_BATCH_SIZE + UPLOAD_BATCH_SIZE) // Headroom for jitter and failed uploads
+#define LCD_PAGE_INTERVAL 4000    // Rotate LCD status pages every 4 seconds
+
+static_assert(DATA_SEND_INTERVAL % SENSOR_READ_INTERVAL == 0,
+              "Samples must fall on sensor read boundaries");
+
+// Recorder mode streams every raw sensor reading over serial as a trace
+// line (see TRACE FUNCTIONS) for replay on the host with tools/replay.cpp
+#define TRACE_RECORDER 0
+
+// ============ NETWORK CONFIGURATION ============
+#define WIFI_SSID "your-ssid"
+#define WIFI_PASSWORD "your-password"
+#define WIFI_CONNECT_ATTEMPTS 20
+#define SERVER_HOST "192.168.1.100"
+#define SERVER_HTTP_PORT 4000
+#define SERVER_COAP_PORT 5683
+#define SERVER_HTTPS_PORT 4443
+#define COAP_LOCAL_PORT 5683
+
+// SNTP disciplines the wall clock that aligns sampling (see
+// sample_clock.h). Smooth mode slews small corrections instead of
+// stepping. At a typical 20-40 ppm crystal error a 15 minute sync
+// interval keeps boards within ~40 ms of each other.
+#define NTP_SERVER "pool.ntp.org"
+#define TIME_SYNC_INTERVAL (15 * 60 * 1000UL)
+#define TIME_VALID_AFTER 1700000000 // Clock counts as set after Nov 2023
+
+// Upload transport: HTTP, or CoAP (RFC 7252) over UDP. CoAP sends routine
+// batches non-confirmable and batches containing an alarm confirmable;
+// either kind stays on the device until a 2.xx response answers it.
+#define UPLOAD_TRANSPORT_HTTP 0
+#define UPLOAD_TRANSPORT_COAP 1
+#define UPLOAD_TRANSPORT_HTTPS 2
+#define UPLOAD_TRANSPORT UPLOAD_TRANSPORT_COAP
+
+// HTTP(S) keeps one connection open across uploads. HTTPS resumes the TLS
+// session from a ticket when it has to reconnect. Globals live in RAM
+// that is retained through light sleep, so the session survives it too.
+#define HTTP_TIMEOUT 5000
+#define HTTP_REQUEST_HEADER_SIZE 224
+#define HTTP_RESPONSE_BUFFER_SIZE 576
+
+// Upload pacing headers. A backend seeing arrivals bunch up asks the
+// device to push its next upload back by the given number of ms. While
+// its ingest is overloaded it sends rate hints for the upload period the
+// response answers: the upload interval in ms, the samples to batch per
+// upload, and (standard Retry-After, in seconds) how long a turned-away
+// upload waits. CoAP carries the rate hints in the control block.
+#define UPLOAD_DELAY_HEADER "X-Upload-Delay"
+#define UPLOAD_INTERVAL_HEADER "X-Upload-Interval"
+#define UPLOAD_BATCH_HEADER "X-Upload-Batch"
+#define RETRY_AFTER_HEADER "Retry-After"
+
+// Devices identify themselves with their factory MAC (12 hex digits), in a
+// request header over HTTP and a "d=" Uri-Query option over CoAP. Devices
+// the backend groups into a zone get the zone's fan decision back, in a
+// response header over HTTP and a control block over CoAP.
+#define DEVICE_ID_HEADER "X-Device-Id"
+#define ZONE_FAN_HEADER "X-Zone-Fan"
+
+// Downlink commands (see COMMANDS) are pushed over CoAP to the device,
+// which ACKs them, and repeated in upload responses until acked, over HTTP
+// as "id;command;value;duration[;hex data]". Every upload acks the highest
+// command id applied so far; a command is applied at most once.
+#define COMMAND_HEADER "X-Command"
+#define COMMAND_ACK_HEADER "X-Command-Ack"
+
+// Payload encoding: JSON text (readable, handy for debugging), CBOR with
+// integer keys, or the delta+varint batch format for slowly varying data
+#define PAYLOAD_ENCODING_JSON 0
+#define PAYLOAD_ENCODING_CBOR 1
+#define PAYLOAD_ENCODING_DELTA 2
+#define PAYLOAD_ENCODING PAYLOAD_ENCODING_DELTA
+
+// Confirmable retransmission (RFC 7252 section 4.2), kept short because
+// the wait blocks the control loop
+#define COAP_ACK_TIMEOUT 1000
+#define COAP_MAX_RETRANSMIT 2
+// A non-confirmable upload is sent once and answered after the backend
+// queued its readings, which under overload takes as long as over HTTP
+#define COAP_RESPONSE_TIMEOUT HTTP_TIMEOUT
+#define COAP_RESPONSE_BUFFER_SIZE 128 // Room for a schedule push
+
+// The full handshake is dominated by AES/SHA/bignum work; make sure the
+// core's mbedTLS build offloads it to the ESP32 crypto accelerators
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTPS
+#if !CONFIG_MBEDTLS_HARDWARE_AES || !CONFIG_MBEDTLS_HARDWARE_SHA || !CONFIG_MBEDTLS_HARDWARE_MPI
+#warning "mbedTLS hardware acceleration is disabled, TLS handshakes will be slow"
+#endif
+#ifndef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#warning "CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS is off, reconnects do full handshakes"
+#endif
+// The CA is attached through esp-tls's certificate bundle hook, which also
+// installs the verify callback that tells full and resumed handshakes apart
+#ifndef CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#error "HTTPS needs CONFIG_MBEDTLS_CERTIFICATE_BUNDLE (esp-tls crt_bundle_attach)"
+#endif
+#endif
+
+// Root certificate of the upload server (PEM), e.g.
+// #define SERVER_CA_PEM \
+//     "-----BEGIN CERTIFICATE-----\n" \
+//     "MIIB...\n" \
+//     "-----END CERTIFICATE-----\n"
+// The HTTPS build fails until it is set: without it the server could never
+// be verified.
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTPS
+#ifndef SERVER_CA_PEM
+#error "Define SERVER_CA_PEM as the upload server's root certificate for HTTPS"
+#endif
+const char SERVER_CA_CERT[] = SERVER_CA_PEM;
+#endif
+
+// ============ MEMORY CONFIGURATION ============
+// Everything the upload cycle needs is allocated statically at boot so the
+// heap cannot fragment over weeks of uptime. With CONFIG_HEAP_USE_HOOKS
+// enabled, any allocation from the loop task after setup() is counted
+// (or aborts with HEAP_GUARD_ABORT), except inside network stack calls.
+#define JSON_ARENA_SIZE 4096
+#define HEAP_GUARD_ABORT 0
+#define HEAP_REPORT_INTERVAL 60000
+
+// Footprint budgets: static buffers are checked at compile time, the
+// sketch size against FLASH_BUDGET at boot
+#define STATIC_RAM_BUDGET 8192
+#define FLASH_BUDGET (1024 * 1024)
+
+#ifndef CONFIG_HEAP_USE_HOOKS
+#warning "CONFIG_HEAP_USE_HOOKS is off, allocations after setup() are not checked"
+#endif
+
+// ============ PAYLOAD KEYS ============
+// CBOR integer keys, must match SENSOR_FIELD_KEYS in backend/payload.js
+#define KEY_TEMPERATURE 1
+#define KEY_HUMIDITY 2
+#define KEY_LIGHT_INTENSITY 3
+#define KEY_FAN 4
+#define KEY_FAN_LED 5
+#define KEY_LIGHT 6
+#define KEY_LIGHT_LED 7
+#define KEY_ALARM_LED 8
+#define KEY_BUZZER 9
+#define KEY_AGE 10
+#define KEY_TIME 11 // Sent instead of KEY_AGE once the clock is synced
+#define PAYLOAD_FIELD_COUNT 10
+
+// Control block keys (CBOR map in CoAP responses and command pushes),
+// must match CONTROL_KEYS in backend/control.js
+#define CONTROL_KEY_ZONE_FAN 1
+#define CONTROL_KEY_COMMAND_ID 2
+#define CONTROL_KEY_COMMAND 3
+#define CONTROL_KEY_COMMAND_VALUE 4
+#define CONTROL_KEY_COMMAND_DURATION 5
+#define CONTROL_KEY_COMMAND_DATA 6 // Byte string
+#define CONTROL_KEY_UPLOAD_INTERVAL 7
+#define CONTROL_KEY_UPLOAD_BATCH 8
+#define CONTROL_KEY_RETRY_AFTER 9
+
+// Downlink commands, must match COMMANDS in backend/control.js
+#define COMMAND_FAN 1     // Force the fan to value for duration seconds
+#define COMMAND_LIGHT 2   // Force the light to value for duration seconds
+#define COMMAND_SILENCE 3 // Hold the buzzer off for duration seconds
+#define COMMAND_CLEAR 4   // Drop every forced state
+#define COMMAND_SCHEDULE 5 // Replace the schedule with data (schedule.h)
+
+// Delta batch format, must match backend/delta.js
+#define DELTA_FORMAT_VERSION 2
+#define DELTA_FLAG_FAN 0x01
+#define DELTA_FLAG_FAN_LED 0x02
+#define DELTA_FLAG_LIGHT 0x04
+#define DELTA_FLAG_LIGHT_LED 0x08
+#define DELTA_FLAG_ALARM_LED 0x10
+#define DELTA_FLAG_BUZZER 0x20
+
+#if PAYLOAD_ENCODING == PAYLOAD_ENCODING_JSON
+#define PAYLOAD_CONTENT_TYPE "application/json"
+#define PAYLOAD_CONTENT_FORMAT 50
+#define PAYLOAD_BUFFER_SIZE (SAMPLE_BUFFER_SIZE * 176 + 2)
+#elif PAYLOAD_ENCODING == PAYLOAD_ENCODING_CBOR
+#define PAYLOAD_CONTENT_TYPE "application/cbor"
+#define PAYLOAD_CONTENT_FORMAT 60
+#define PAYLOAD_BUFFER_SIZE (SAMPLE_BUFFER_SIZE * 56 + 4)
+#else
+#define PAYLOAD_CONTENT_TYPE "application/vnd.envmon.delta"
+#define PAYLOAD_CONTENT_FORMAT 65000 // Experimental use range
+#define PAYLOAD_BUFFER_SIZE (SAMPLE_BUFFER_SIZE * 16 + 13)
+#endif
+
+// ============ DATA TYPES ============
+struct SensorSample
+{
+    unsigned long timestamp; // millis() when recorded
+    uint32_t wallTime;       // Aligned epoch seconds, 0 before SNTP sync
+    float temperature;
+    float humidity;
+    int lightLevel;
+    bool fan;
+    bool fanLed;
+    bool light;
+    bool lightLed;
+    bool alarmLed;
+    bool buzzer;
+};
+
+// ============ STARTUP MESSAGES ============
+#define STRINGIFY(x) #x
+#define PIN_NAME(pin) "GPIO" STRINGIFY(pin)
+
+// One flash-resident block instead of a print call per line
+const char STARTUP_BANNER[] PROGMEM =
+    "========================================\n"
+    " Environmental Control System Started\n"
+    " WITH PostgreSQL Integration\n"
+    "========================================\n"
+    "Hardware Configuration:\n"
+    "  DHT22: " PIN_NAME(DHT22_PIN) "\n"
+    "  Fan Relay: " PIN_NAME(FAN_RELAY_PIN) " | Fan LED: " PIN_NAME(FAN_LED_PIN) "\n"
+    "  Light Relay: " PIN_NAME(LIGHT_RELAY_PIN) " | Light LED: " PIN_NAME(LIGHT_LED_PIN) "\n"
+    "  Buzzer: " PIN_NAME(BUZZER_PIN) " | Alarm LED: " PIN_NAME(ALARM_LED_PIN) "\n"
+    "  LDR: " PIN_NAME(LIGHT_PIN) " (ADC)\n"
+    "  LCD: I2C (SDA=21, SCL=22)\n"
+    "========================================";
 
 // ============ GLOBAL OBJECTS ============
 LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
+LcdFrame lcdPages[LCD_PAGE_COUNT];
+LcdFrame lcdMessage;
+LcdFrame lcdShown;
+uint32_t lcdTruncations = 0;
 DHT dht(DHT22_PIN, DHT_TYPE);
+WiFiUDP udp;
+WiFiClient httpClient;
+
+// ============ GLOBAL STATE ============
+unsigned long lastSendTime = 0;
+uint64_t lastSampleBoundary = 0;
+uint16_t coapMessageId = 0;
+unsigned long lastUploadTime = 0;
+unsigned long nextUploadDelay = 0;
+int uploadFlushSize = UPLOAD_FLUSH_SIZE;
+unsigned long retryAfter = 0;
+unsigned long hintedInterval = 0; // Backend's upload interval, 0 without hints
+uint8_t uploadFailures = 0;       // Uploads in a row that got no answer
+unsigned long lastAlarmUploadTime = 0;
+SensorSample sampleBatch[SAMPLE_BUFFER_SIZE];
+int sampleCount = 0;
+esp_tls_t *tlsConnection = NULL;
+esp_tls_client_session_t *tlsSession = NULL;
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTPS
+mbedtls_x509_crt serverCa;
+uint8_t tlsCertificatesChecked = 0;
+#endif
+uint8_t payloadBuffer[PAYLOAD_BUFFER_SIZE];
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+uint8_t coapPacketBuffer[PAYLOAD_BUFFER_SIZE + 64];
+uint8_t coapResponseBuffer[COAP_RESPONSE_BUFFER_SIZE];
+#define TRANSPORT_BUFFER_BYTES (sizeof(coapPacketBuffer) + sizeof(coapResponseBuffer))
+#else
+char httpRequestHeader[HTTP_REQUEST_HEADER_SIZE];
+char httpResponseBuffer[HTTP_RESPONSE_BUFFER_SIZE];
+#define TRANSPORT_BUFFER_BYTES (sizeof(httpRequestHeader) + sizeof(httpResponseBuffer))
+#endif
+TaskHandle_t heapGuardTask = NULL;
+volatile bool heapGuardActive = false;
+volatile uint32_t heapGuardViolations = 0;
+volatile size_t heapGuardLastSize = 0;
+unsigned long lastHeapReportTime = 0;
+int lcdPage = LCD_PAGE_READINGS;
+unsigned long lastPageSwitchTime = 0;
+int lastUploadStatus = UPLOAD_STATUS_NONE;
+char deviceId[13];
+unsigned long uploadSlotOffset = 0;
+bool zoneFan = false;
+bool zoneControlReceived = false;
+unsigned long zoneControlTime = 0;
+Overrides commandOverrides = {};
+uint32_t lastCommandId = 0;
+Schedule schedule = {};
+Overrides scheduleOverrides = {};
+unsigned long scheduleCheckTime = 0;
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+IPAddress coapServerIP; // SERVER_HOST, resolved once WiFi is up
+bool coapServerResolved = false;
+uint16_t coapPostToken = 0;      // Token of the last POST sent
+bool coapPostOutstanding = false; // Its response has not arrived yet
+#endif
 
 // ============ LED CONTROL FUNCTIONS ============
 void setFanLED(bool state)
@@ -94,23 +397,1416 @@ int readLightLevel()
     return analogRead(LIGHT_PIN);
 }
 
-void writeALineOnLCD(const char *str)
+// ============ STATUS FUNCTIONS ============
+// Same message to the serial monitor and the LCD
+void logStatus(const char *message)
+{
+    Serial.println(message);
+    writeALineOnLCD(message);
+}
+
+// Completed step: check mark on serial, check glyph on the LCD
+void logReady(const char *message)
+{
+    Serial.print("✓ ");
+    Serial.println(message);
+    writeMessageOnLCD(message, GLYPH_CHECK);
+}
+
+// ============ TRACE FUNCTIONS ============
+// Trace line: millis,temperature*100,humidity*100,light. The backend's
+// GET /data/trace export uses the same format; other serial output never
+// starts with a digit, so a captured log can be replayed as is.
+void writeTraceLine(unsigned long timestamp, float temperature,
+                    float humidity, int lightLevel)
+{
+    char line[48];
+    int length = snprintf(line, sizeof(line), "%lu,%ld,%ld,%d\n", timestamp,
+                          lroundf(temperature * 100), lroundf(humidity * 100),
+                          lightLevel);
+    Serial.write((const uint8_t *)line, length);
+}
+
+// ============ WIFI FUNCTIONS ============
+void initDeviceId()
+{
+    snprintf(deviceId, sizeof(deviceId), "%012llx",
+             (unsigned long long)ESP.getEfuseMac());
+
+    // Fixed offset after a sample boundary for uploads a sample triggers
+    // (full batch, alarm): synced boards sample on the same boundaries
+    // and must not upload on them together. Boards of one production run
+    // have consecutive MACs, so the MAC is mixed (murmur3 finalizer).
+    uint64_t mix = ESP.getEfuseMac();
+    mix ^= mix >> 33;
+    mix *= 0xff51afd7ed558ccdULL;
+    mix ^= mix >> 33;
+    mix *= 0xc4ceb9fe1a85ec53ULL;
+    mix ^= mix >> 33;
+    uploadSlotOffset = mix % DATA_SEND_INTERVAL;
+}
+
+void connectToWiFi()
+{
+    Serial.print("Connecting to WiFi");
+    writeALineOnLCD("Connecting WiFi");
+
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+
+    int attempts = 0;
+    while (WiFi.status() != WL_CONNECTED && attempts < WIFI_CONNECT_ATTEMPTS)
+    {
+        delay(500);
+        Serial.print(".");
+        attempts++;
+    }
+    Serial.println();
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        Serial.print("✓ WiFi connected, IP: ");
+        Serial.println(WiFi.localIP());
+        writeALineOnLCD("WiFi connected");
+        udp.begin(COAP_LOCAL_PORT);
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+        coapServerResolved = WiFi.hostByName(SERVER_HOST, coapServerIP) == 1;
+        if (!coapServerResolved)
+            Serial.println("ERROR: cannot resolve " SERVER_HOST);
+#endif
+    }
+    else
+    {
+        Serial.println("ERROR: WiFi connection failed!");
+        writeALineOnLCD("WiFi failed");
+    }
+}
+
+// Signal strength as 0-3 LCD bars, 0 when disconnected
+int wifiSignalBars()
+{
+    if (WiFi.status() != WL_CONNECTED)
+        return 0;
+    int rssi = WiFi.RSSI();
+    if (rssi >= -60)
+        return 3;
+    return rssi >= -70 ? 2 : 1;
+}
+
+// ============ TIME FUNCTIONS ============
+void startTimeSync()
+{
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    sntp_set_sync_interval(TIME_SYNC_INTERVAL);
+    configTime(0, 0, NTP_SERVER);
+}
+
+// Wall clock in ms since the epoch, 0 until SNTP has set the clock
+uint64_t wallClockMs()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    if (now.tv_sec < TIME_VALID_AFTER)
+        return 0;
+    return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// ============ CBOR ENCODING FUNCTIONS ============
+struct CborWriter
+{
+    uint8_t *buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+};
+
+void cborPutByte(CborWriter &writer, uint8_t value)
+{
+    if (writer.length >= writer.capacity)
+    {
+        writer.overflow = true;
+        return;
+    }
+    writer.buffer[writer.length++] = value;
+}
+
+void cborPutHead(CborWriter &writer, uint8_t major, uint32_t value)
+{
+    major <<= 5;
+    if (value < 24)
+    {
+        cborPutByte(writer, major | value);
+    }
+    else if (value <= 0xFF)
+    {
+        cborPutByte(writer, major | 24);
+        cborPutByte(writer, value);
+    }
+    else if (value <= 0xFFFF)
+    {
+        cborPutByte(writer, major | 25);
+        cborPutByte(writer, value >> 8);
+        cborPutByte(writer, value);
+    }
+    else
+    {
+        cborPutByte(writer, major | 26);
+        cborPutByte(writer, value >> 24);
+        cborPutByte(writer, value >> 16);
+        cborPutByte(writer, value >> 8);
+        cborPutByte(writer, value);
+    }
+}
+
+void cborPutMap(CborWriter &writer, uint32_t pairs)
+{
+    cborPutHead(writer, 5, pairs);
+}
+
+void cborPutInt(CborWriter &writer, int32_t value)
+{
+    if (value >= 0)
+        cborPutHead(writer, 0, value);
+    else
+        cborPutHead(writer, 1, -1 - value);
+}
+
+void cborPutFloat(CborWriter &writer, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    cborPutByte(writer, 0xFA);
+    cborPutByte(writer, bits >> 24);
+    cborPutByte(writer, bits >> 16);
+    cborPutByte(writer, bits >> 8);
+    cborPutByte(writer, bits);
+}
+
+void cborPutBool(CborWriter &writer, bool value)
+{
+    cborPutByte(writer, value ? 0xF5 : 0xF4);
+}
+
+// ============ MEMORY FUNCTIONS ============
+// Bump allocator over a static buffer for ArduinoJson. Each block keeps
+// its size in front so reallocate() can copy; nothing is freed until the
+// whole arena is reset before the next document.
+#if PAYLOAD_ENCODING == PAYLOAD_ENCODING_JSON
+class ArenaAllocator : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override
+    {
+        size_t total = (sizeof(size_t) + size + 3) & ~(size_t)3;
+        if (used + total > sizeof(arena))
+            return NULL;
+        size_t *block = (size_t *)(arena + used);
+        *block = size;
+        used += total;
+        return block + 1;
+    }
+
+    void deallocate(void *) override
+    {
+    }
+
+    void *reallocate(void *ptr, size_t newSize) override
+    {
+        void *block = allocate(newSize);
+        if (block != NULL && ptr != NULL)
+            memcpy(block, ptr, min(((size_t *)ptr)[-1], newSize));
+        return block;
+    }
+
+    void reset()
+    {
+        used = 0;
+    }
+
+private:
+    alignas(4) uint8_t arena[JSON_ARENA_SIZE];
+    size_t used = 0;
+};
+
+ArenaAllocator jsonArena;
+#define JSON_ARENA_BYTES sizeof(jsonArena)
+#else
+#define JSON_ARENA_BYTES 0
+#endif
+
+static_assert(sizeof(sampleBatch) + sizeof(payloadBuffer) +
+                      TRANSPORT_BUFFER_BYTES + JSON_ARENA_BYTES +
+                      sizeof(lcdPages) + sizeof(lcdMessage) +
+                      sizeof(lcdShown) <=
+                  STATIC_RAM_BUDGET,
+              "Static buffers exceed STATIC_RAM_BUDGET");
+
+// Section boundaries from the ESP32 linker script
+extern "C" uint8_t _data_start, _data_end, _bss_start, _bss_end;
+extern "C" uint8_t _rodata_start, _rodata_end, _text_start, _text_end;
+extern "C" uint8_t _iram_text_start, _iram_text_end;
+
+void printSectionSize(const char *name, const uint8_t &start, const uint8_t &end)
+{
+    Serial.print("  ");
+    Serial.print(name);
+    Serial.print(": ");
+    Serial.print((unsigned long)(&end - &start));
+    Serial.println(" bytes");
+}
+
+void reportFirmwareSections()
+{
+    Serial.println("Firmware sections:");
+    printSectionSize(".data (DRAM)", _data_start, _data_end);
+    printSectionSize(".bss (DRAM)", _bss_start, _bss_end);
+    printSectionSize(".iram.text", _iram_text_start, _iram_text_end);
+    printSectionSize(".flash.rodata", _rodata_start, _rodata_end);
+    printSectionSize(".flash.text", _text_start, _text_end);
+
+    uint32_t sketchSize = ESP.getSketchSize();
+    Serial.print("  Sketch: ");
+    Serial.print(sketchSize);
+    Serial.print(" of ");
+    Serial.print((unsigned long)FLASH_BUDGET);
+    Serial.println(" bytes budget");
+    if (sketchSize > FLASH_BUDGET)
+        Serial.println("WARNING: Sketch exceeds FLASH_BUDGET!");
+}
+
+#ifdef CONFIG_HEAP_USE_HOOKS
+extern "C" void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!heapGuardActive || xTaskGetCurrentTaskHandle() != heapGuardTask)
+        return;
+    heapGuardViolations++;
+    heapGuardLastSize = size;
+#if HEAP_GUARD_ABORT
+    abort();
+#endif
+}
+#endif
+
+// Arms the allocation guard for the calling (loop) task
+void startHeapGuard()
+{
+    heapGuardTask = xTaskGetCurrentTaskHandle();
+    heapGuardActive = true;
+}
+
+// Periodic heap report; a flat max-alloc block means no fragmentation
+void reportHeap(unsigned long now)
+{
+    if (now - lastHeapReportTime < HEAP_REPORT_INTERVAL)
+        return;
+    lastHeapReportTime = now;
+
+    Serial.print("Heap free: ");
+    Serial.print(ESP.getFreeHeap());
+    Serial.print(", min free: ");
+    Serial.print(ESP.getMinFreeHeap());
+    Serial.print(", max block: ");
+    Serial.print(ESP.getMaxAllocHeap());
+    Serial.print(", guard violations: ");
+    Serial.print((unsigned long)heapGuardViolations);
+    Serial.print(" (last ");
+    Serial.print((unsigned)heapGuardLastSize);
+    Serial.println(" bytes)");
+}
+
+// ============ PAYLOAD ENCODING FUNCTIONS ============
+size_t encodeBatchCBOR(uint8_t *buffer, size_t capacity,
+                       const SensorSample *samples, int count,
+                       unsigned long now)
+{
+    CborWriter writer = {buffer, capacity, 0, false};
+
+    cborPutHead(writer, 4, count);
+    for (int i = 0; i < count; i++)
+    {
+        const SensorSample &sample = samples[i];
+        cborPutMap(writer, PAYLOAD_FIELD_COUNT);
+        cborPutInt(writer, KEY_TEMPERATURE);
+        cborPutFloat(writer, sample.temperature);
+        cborPutInt(writer, KEY_HUMIDITY);
+        cborPutFloat(writer, sample.humidity);
+        cborPutInt(writer, KEY_LIGHT_INTENSITY);
+        cborPutInt(writer, sample.lightLevel);
+        cborPutInt(writer, KEY_FAN);
+        cborPutBool(writer, sample.fan);
+        cborPutInt(writer, KEY_FAN_LED);
+        cborPutBool(writer, sample.fanLed);
+        cborPutInt(writer, KEY_LIGHT);
+        cborPutBool(writer, sample.light);
+        cborPutInt(writer, KEY_LIGHT_LED);
+        cborPutBool(writer, sample.lightLed);
+        cborPutInt(writer, KEY_ALARM_LED);
+        cborPutBool(writer, sample.alarmLed);
+        cborPutInt(writer, KEY_BUZZER);
+        cborPutBool(writer, sample.buzzer);
+        if (sample.wallTime != 0)
+        {
+            cborPutInt(writer, KEY_TIME);
+            cborPutInt(writer, sample.wallTime);
+        }
+        else
+        {
+            cborPutInt(writer, KEY_AGE);
+            cborPutInt(writer, now - sample.timestamp);
+        }
+    }
+
+    return writer.overflow ? 0 : writer.length;
+}
+
+#if PAYLOAD_ENCODING == PAYLOAD_ENCODING_JSON
+size_t encodeBatchJSON(char *buffer, size_t capacity,
+                       const SensorSample *samples, int count,
+                       unsigned long now)
+{
+    jsonArena.reset();
+    JsonDocument doc(&jsonArena);
+    JsonArray batch = doc.to<JsonArray>();
+    for (int i = 0; i < count; i++)
+    {
+        const SensorSample &sample = samples[i];
+        JsonObject reading = batch.add<JsonObject>();
+        reading["temperature"] = sample.temperature;
+        reading["humidity"] = sample.humidity;
+        reading["light_intensity"] = sample.lightLevel;
+        reading["fan"] = sample.fan;
+        reading["fan_led"] = sample.fanLed;
+        reading["light"] = sample.light;
+        reading["light_led"] = sample.lightLed;
+        reading["alram_led"] = sample.alarmLed;
+        reading["buzzer"] = sample.buzzer;
+        if (sample.wallTime != 0)
+            reading["sampled_at"] = sample.wallTime;
+        else
+            reading["age_ms"] = now - sample.timestamp;
+    }
+
+    if (measureJson(doc) >= capacity)
+        return 0;
+    return serializeJson(doc, buffer, capacity);
+}
+#endif
+
+// ============ DELTA BATCH ENCODING FUNCTIONS ============
+// Layout: version, sample count, base time, then per sample the zigzag
+// varint deltas against the previous sample (the first against zero) of
+// time, temperature and humidity in hundredths, light level, followed by
+// one byte of actuator flags. Steady readings cost about five bytes each.
+// With a base time (epoch seconds of the first sample) the time deltas
+// are in aligned seconds; a base of 0 means some sample predates SNTP
+// sync and the time deltas are ages in ms.
+void deltaPutVarint(CborWriter &writer, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        cborPutByte(writer, (value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    cborPutByte(writer, value);
+}
+
+void deltaPutSigned(CborWriter &writer, int32_t value)
+{
+    deltaPutVarint(writer, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+uint8_t sampleFlags(const SensorSample &sample)
+{
+    return (sample.fan ? DELTA_FLAG_FAN : 0) |
+           (sample.fanLed ? DELTA_FLAG_FAN_LED : 0) |
+           (sample.light ? DELTA_FLAG_LIGHT : 0) |
+           (sample.lightLed ? DELTA_FLAG_LIGHT_LED : 0) |
+           (sample.alarmLed ? DELTA_FLAG_ALARM_LED : 0) |
+           (sample.buzzer ? DELTA_FLAG_BUZZER : 0);
+}
+
+size_t encodeBatchDelta(uint8_t *buffer, size_t capacity,
+                        const SensorSample *samples, int count,
+                        unsigned long now)
+{
+    CborWriter writer = {buffer, capacity, 0, false};
+    int32_t previousTime = 0;
+    int32_t previousTemperature = 0;
+    int32_t previousHumidity = 0;
+    int32_t previousLight = 0;
+
+    uint32_t baseTime = count > 0 ? samples[0].wallTime : 0;
+    for (int i = 0; i < count; i++)
+        if (samples[i].wallTime == 0)
+            baseTime = 0;
+
+    cborPutByte(writer, DELTA_FORMAT_VERSION);
+    deltaPutVarint(writer, count);
+    deltaPutVarint(writer, baseTime);
+    for (int i = 0; i < count; i++)
+    {
+        const SensorSample &sample = samples[i];
+        int32_t time = baseTime != 0 ? (int32_t)(sample.wallTime - baseTime)
+                                     : (int32_t)(now - sample.timestamp);
+        int32_t temperature = lroundf(sample.temperature * 100);
+        int32_t humidity = lroundf(sample.humidity * 100);
+
+        deltaPutSigned(writer, time - previousTime);
+        deltaPutSigned(writer, temperature - previousTemperature);
+        deltaPutSigned(writer, humidity - previousHumidity);
+        deltaPutSigned(writer, sample.lightLevel - previousLight);
+        cborPutByte(writer, sampleFlags(sample));
+
+        previousTime = time;
+        previousTemperature = temperature;
+        previousHumidity = humidity;
+        previousLight = sample.lightLevel;
+    }
+
+    return writer.overflow ? 0 : writer.length;
+}
+
+size_t encodeBatch(uint8_t *buffer, size_t capacity,
+                   const SensorSample *samples, int count, unsigned long now)
+{
+#if PAYLOAD_ENCODING == PAYLOAD_ENCODING_JSON
+    return encodeBatchJSON((char *)buffer, capacity, samples, count, now);
+#elif PAYLOAD_ENCODING == PAYLOAD_ENCODING_CBOR
+    return encodeBatchCBOR(buffer, capacity, samples, count, now);
+#else
+    return encodeBatchDelta(buffer, capacity, samples, count, now);
+#endif
+}
+
+// ============ UPLOAD SCHEDULING FUNCTIONS ============
+// Every upload is jittered so devices that booted together drift apart
+// instead of hitting the backend in lockstep. The next upload is scheduled
+// as this one starts, and the hints in its response then move it; a CoAP
+// response that outlasted the upload's wait can arrive ticks later.
+void scheduleNextUpload(unsigned long now)
+{
+    long jitter = (long)(esp_random() % (2 * UPLOAD_JITTER + 1)) - UPLOAD_JITTER;
+    lastUploadTime = now;
+    nextUploadDelay = UPLOAD_INTERVAL + jitter;
+    uploadFlushSize = UPLOAD_FLUSH_SIZE;
+    retryAfter = 0;
+    hintedInterval = 0;
+}
+
+void setUploadDelayHint(long delayMs)
+{
+    nextUploadDelay += constrain(delayMs, 0, UPLOAD_INTERVAL);
+}
+
+// Stretches this upload period to the backend's suggested interval and
+// lets the batch grow to match, so an overloaded backend gets fewer,
+// larger uploads. Without hints the next response restores the defaults.
+void setUploadRateHints(unsigned long intervalMs, unsigned long batch)
+{
+    if (intervalMs != 0)
+    {
+        hintedInterval = constrain(intervalMs, UPLOAD_INTERVAL, MAX_UPLOAD_INTERVAL);
+        nextUploadDelay += hintedInterval - UPLOAD_INTERVAL;
+    }
+    if (batch != 0)
+        uploadFlushSize = constrain(batch, UPLOAD_BATCH_SIZE, MAX_UPLOAD_BATCH_SIZE);
+}
+
+// A turned-away upload waits this long before anything (a full buffer or
+// an alarm included) is sent again; samples keep queuing meanwhile
+void setRetryAfter(unsigned long delayMs)
+{
+    retryAfter = min(delayMs, (unsigned long)MAX_UPLOAD_INTERVAL);
+    nextUploadDelay = max(nextUploadDelay, retryAfter);
+}
+
+// Local backoff after an upload that got no answer (timeout, no WiFi),
+// which is what a real overload mostly looks like: UPLOAD_BACKOFF_BASE
+// doubling with every failure in a row, drawn from half to all of it so
+// devices that failed together do not retry together
+void backOffUpload()
+{
+    if (uploadFailures < 8)
+        uploadFailures++;
+    unsigned long backoff = min((unsigned long)UPLOAD_BACKOFF_BASE << (uploadFailures - 1),
+                                (unsigned long)MAX_UPLOAD_INTERVAL);
+    setRetryAfter(backoff / 2 + esp_random() % (backoff / 2 + 1));
+}
+
+// While the backend asks for a slower cadence, an alarm still goes out
+// early, but at most once per hinted interval: a fleet-wide alarm (a hot
+// day) must not undo the hint
+bool alarmUploadAllowed(unsigned long now)
+{
+    return hintedInterval == 0 || now - lastAlarmUploadTime >= hintedInterval;
+}
+
+// Milliseconds until the scheduled upload is due, 0 once it is
+unsigned long msUntilUpload(unsigned long now)
+{
+    unsigned long elapsed = now - lastUploadTime;
+    return elapsed >= nextUploadDelay ? 0 : nextUploadDelay - elapsed;
+}
+
+// Brings the next upload forward to this device's slot after the sample
+// that asks for it (a full batch or an alarm), unless the backend's
+// retry-after is still running
+void requestUpload(unsigned long now)
+{
+    if (now - lastUploadTime >= retryAfter)
+        nextUploadDelay = min(nextUploadDelay,
+                              now - lastUploadTime + uploadSlotOffset);
+}
+
+// ============ CONTROL BLOCK FUNCTIONS ============
+void setZoneFan(bool fan)
+{
+    zoneFan = fan;
+    zoneControlReceived = true;
+    zoneControlTime = millis();
+}
+
+// Zone decision while it is fresh; stale or disconnected means local rules
+ZoneControl currentZoneControl(unsigned long now)
+{
+    ZoneControl zone;
+    zone.valid = zoneControlReceived && WiFi.status() == WL_CONNECTED &&
+                 now - zoneControlTime <
+                     ZONE_CONTROL_TTL_UPLOADS * max(nextUploadDelay, (unsigned long)UPLOAD_INTERVAL);
+    zone.fan = zoneFan;
+    return zone;
+}
+
+// Reads one CBOR unsigned integer or boolean; false on anything else
+bool cborReadValue(const uint8_t *&data, const uint8_t *end, uint32_t &value)
+{
+    if (data >= end)
+        return false;
+    uint8_t initial = *data++;
+    if (initial == 0xF4 || initial == 0xF5)
+    {
+        value = initial == 0xF5;
+        return true;
+    }
+    uint8_t info = initial & 0x1F;
+    int length = info < 24 ? 0 : info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : -1;
+    if ((initial >> 5) != 0 || length < 0 || end - data < length)
+        return false;
+    value = length == 0 ? info : 0;
+    for (int i = 0; i < length; i++)
+        value = (value << 8) | *data++;
+    return true;
+}
+
+// Reads one CBOR byte string shorter than 256 bytes; false on anything else
+bool cborReadBytes(const uint8_t *&data, const uint8_t *end,
+                   const uint8_t *&bytes, size_t &length)
+{
+    if (data >= end || (*data >> 5) != 2 || (*data & 0x1F) > 24)
+        return false;
+    uint8_t info = *data++ & 0x1F;
+    if (info == 24)
+    {
+        if (data >= end)
+            return false;
+        info = *data++;
+    }
+    if ((size_t)(end - data) < info)
+        return false;
+    bytes = data;
+    length = info;
+    data += info;
+    return true;
+}
+
+// Applies a downlink command once; repeats of an applied id are ignored.
+// Returns false, without taking the id, for a command that cannot be
+// applied (a malformed schedule), so it is neither acked nor skipped on
+// the next delivery.
+bool applyCommand(uint32_t id, uint32_t command, uint32_t value,
+                  uint32_t duration, const uint8_t *data, size_t dataLength)
+{
+    if (id <= lastCommandId)
+        return true;
+    if (command == COMMAND_SCHEDULE &&
+        !decodeSchedule(data, dataLength, schedule))
+    {
+        Serial.println("⚠ Malformed schedule ignored");
+        return false;
+    }
+    lastCommandId = id;
+
+    ActuatorOverride forced = {true, value != 0, millis() + duration * 1000UL};
+    switch (command)
+    {
+    case COMMAND_FAN:
+        commandOverrides.fan = forced;
+        break;
+    case COMMAND_LIGHT:
+        commandOverrides.light = forced;
+        break;
+    case COMMAND_SILENCE:
+        forced.state = false;
+        commandOverrides.buzzer = forced;
+        break;
+    case COMMAND_CLEAR:
+        commandOverrides = Overrides();
+        break;
+    case COMMAND_SCHEDULE:
+        scheduleCheckTime = millis(); // Evaluated on this tick
+        break;
+    }
+    Serial.print("Command ");
+    Serial.print(id);
+    Serial.print(": ");
+    Serial.print(command);
+    Serial.print(" value ");
+    Serial.print(value);
+    Serial.print(" for ");
+    Serial.print(duration);
+    Serial.println(" s");
+    return true;
+}
+
+// Applies a control block: a CBOR map of CONTROL_KEY_* to integers or
+// booleans, and command data as a byte string. Unknown keys are ignored so
+// the backend can add fields. Returns false for a malformed block or a
+// command that could not be applied.
+bool applyControlBlock(const uint8_t *data, size_t length)
+{
+    const uint8_t *end = data + length;
+    if (length == 0 || (*data >> 5) != 5 || (*data & 0x1F) >= 24)
+        return false;
+    int entries = *data++ & 0x1F;
+    uint32_t commandId = 0;
+    uint32_t command = 0;
+    uint32_t commandValue = 0;
+    uint32_t commandDuration = 0;
+    const uint8_t *commandData = NULL;
+    size_t commandDataLength = 0;
+    uint32_t uploadInterval = 0;
+    uint32_t uploadBatch = 0;
+    for (int i = 0; i < entries; i++)
+    {
+        uint32_t key;
+        uint32_t value = 0;
+        if (!cborReadValue(data, end, key))
+            return false;
+        if (key == CONTROL_KEY_COMMAND_DATA)
+        {
+            if (!cborReadBytes(data, end, commandData, commandDataLength))
+                return false;
+        }
+        else if (!cborReadValue(data, end, value))
+            return false;
+        switch (key)
+        {
+        case CONTROL_KEY_ZONE_FAN:
+            setZoneFan(value != 0);
+            break;
+        case CONTROL_KEY_COMMAND_ID:
+            commandId = value;
+            break;
+        case CONTROL_KEY_COMMAND:
+            command = value;
+            break;
+        case CONTROL_KEY_COMMAND_VALUE:
+            commandValue = value;
+            break;
+        case CONTROL_KEY_COMMAND_DURATION:
+            commandDuration = value;
+            break;
+        case CONTROL_KEY_UPLOAD_INTERVAL:
+            uploadInterval = value;
+            break;
+        case CONTROL_KEY_UPLOAD_BATCH:
+            uploadBatch = value;
+            break;
+        case CONTROL_KEY_RETRY_AFTER:
+            setRetryAfter(value);
+            break;
+        }
+    }
+    setUploadRateHints(uploadInterval, uploadBatch);
+    return commandId == 0 ||
+           applyCommand(commandId, command, commandValue, commandDuration,
+                        commandData, commandDataLength);
+}
+
+// ============ SCHEDULE FUNCTIONS ============
+// Re-evaluates the schedule only when a window starts or ends (or a new
+// schedule arrived); the overrides carry the scheduled states in between.
+// Needs the wall clock, so nothing is scheduled before SNTP sync.
+void updateSchedule(unsigned long now, uint64_t wallMs)
+{
+    if (wallMs == 0 || (long)(now - scheduleCheckTime) < 0)
+        return;
+    scheduleCheckTime = now + evaluateSchedule(schedule, wallMs, now,
+                                               scheduleOverrides);
+}
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+// ============ COAP FUNCTIONS ============
+#define COAP_VERSION 1
+#define COAP_TYPE_CON 0
+#define COAP_TYPE_NON 1
+#define COAP_TYPE_ACK 2
+#define COAP_TYPE_RST 3
+#define COAP_CODE_POST 0x02
+#define COAP_CODE_CLASS_SUCCESS 2
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY 15
+#define COAP_PAYLOAD_MARKER 0xFF
+#define COAP_HEADER_SIZE 4
+#define COAP_TOKEN_LENGTH 2 // POSTs carry their message id as token
+#define COAP_URI_PATH "sensor-data"
+#define COAP_DEVICE_QUERY "d="
+#define COAP_CODE_CHANGED 0x44 // 2.04
+#define COAP_CODE_BAD_REQUEST 0x80 // 4.00
+#define COAP_CODE_METHOD_NOT_ALLOWED 0x85 // 4.05
+#define COAP_CODE_SERVICE_UNAVAILABLE 0xA3 // 5.03
+
+size_t buildCoapPost(uint8_t *packet, size_t capacity, uint8_t type,
+                     uint16_t messageId, const uint8_t *payload,
+                     size_t payloadLength)
+{
+    const size_t pathLength = strlen(COAP_URI_PATH);
+    const size_t formatLength = PAYLOAD_CONTENT_FORMAT > 0xFF ? 2 : 1;
+    const size_t queryLength = strlen(COAP_DEVICE_QUERY) + strlen(deviceId);
+    char ackQuery[16];
+    const size_t ackLength =
+        lastCommandId != 0 ? snprintf(ackQuery, sizeof(ackQuery), "a=%lu",
+                                      (unsigned long)lastCommandId)
+                           : 0;
+    // Header, token, Uri-Path option (delta 11, length < 13),
+    // Content-Format option (delta 1), Uri-Query options for the device id
+    // (delta 3, one extended length byte) and the command ack (delta 0,
+    // length < 13), and payload marker
+    const size_t size = COAP_HEADER_SIZE + COAP_TOKEN_LENGTH + 1 +
+                        pathLength + 1 + formatLength +
+                        2 + queryLength + (ackLength ? 1 + ackLength : 0) +
+                        1 + payloadLength;
+    if (pathLength >= 13 || queryLength < 13 || queryLength >= 13 + 256 ||
+        size > capacity)
+        return 0;
+
+    size_t n = 0;
+    packet[n++] = (COAP_VERSION << 6) | (type << 4) | COAP_TOKEN_LENGTH;
+    packet[n++] = COAP_CODE_POST;
+    packet[n++] = messageId >> 8;
+    packet[n++] = messageId;
+    packet[n++] = messageId >> 8; // Token
+    packet[n++] = messageId;
+
+    packet[n++] = (COAP_OPTION_URI_PATH << 4) | pathLength;
+    memcpy(packet + n, COAP_URI_PATH, pathLength);
+    n += pathLength;
+
+    packet[n++] = ((COAP_OPTION_CONTENT_FORMAT - COAP_OPTION_URI_PATH) << 4) |
+                  formatLength;
+    if (formatLength == 2)
+        packet[n++] = PAYLOAD_CONTENT_FORMAT >> 8;
+    packet[n++] = PAYLOAD_CONTENT_FORMAT & 0xFF;
+
+    packet[n++] = ((COAP_OPTION_URI_QUERY - COAP_OPTION_CONTENT_FORMAT) << 4) | 13;
+    packet[n++] = queryLength - 13;
+    memcpy(packet + n, COAP_DEVICE_QUERY, strlen(COAP_DEVICE_QUERY));
+    n += strlen(COAP_DEVICE_QUERY);
+    memcpy(packet + n, deviceId, strlen(deviceId));
+    n += strlen(deviceId);
+    if (ackLength)
+    {
+        packet[n++] = ackLength;
+        memcpy(packet + n, ackQuery, ackLength);
+        n += ackLength;
+    }
+
+    packet[n++] = COAP_PAYLOAD_MARKER;
+    memcpy(packet + n, payload, payloadLength);
+    n += payloadLength;
+    return n;
+}
+
+// Reads the next datagram into coapResponseBuffer; returns its length, 0
+// when nothing (or nothing that can be CoAP) arrived. Only the configured
+// server may push commands or answer uploads, so datagrams from any
+// other address or port are dropped.
+size_t readCoapPacket()
+{
+    int size = udp.parsePacket();
+    if (size <= 0)
+        return 0;
+    int n = udp.read(coapResponseBuffer, sizeof(coapResponseBuffer));
+    while (udp.available())
+        udp.read();
+    if (!coapServerResolved || udp.remoteIP() != coapServerIP ||
+        udp.remotePort() != SERVER_COAP_PORT)
+        return 0;
+    return n >= COAP_HEADER_SIZE ? n : 0;
+}
+
+// True when a response echoes the token of the POST still waiting for one
+bool isCoapPostResponse(const uint8_t *packet, size_t length)
+{
+    return coapPostOutstanding &&
+           (packet[0] & 0x0F) == COAP_TOKEN_LENGTH &&
+           length >= COAP_HEADER_SIZE + COAP_TOKEN_LENGTH &&
+           ((packet[4] << 8) | packet[5]) == coapPostToken;
+}
+
+// Payload after the token and options, or NULL when there is none
+const uint8_t *coapPayload(const uint8_t *packet, size_t length,
+                           size_t &payloadLength)
+{
+    size_t offset = COAP_HEADER_SIZE + (packet[0] & 0x0F); // Skip the token
+    while (offset < length && packet[offset] != COAP_PAYLOAD_MARKER)
+    {
+        uint8_t delta = packet[offset] >> 4;
+        uint8_t optionLength = packet[offset++] & 0x0F;
+        if (delta == 15 || optionLength == 15)
+            return NULL;
+        offset += delta == 13 ? 1 : delta == 14 ? 2 : 0;
+        if (optionLength >= 13)
+        {
+            if (offset + (optionLength == 14 ? 2 : 1) > length)
+                return NULL;
+            size_t extended = optionLength == 14
+                                  ? ((packet[offset] << 8) | packet[offset + 1]) + 269
+                                  : packet[offset] + 13;
+            offset += optionLength == 14 ? 2 : 1;
+            offset += extended;
+        }
+        else
+            offset += optionLength;
+    }
+    if (offset >= length)
+        return NULL;
+    payloadLength = length - offset - 1;
+    return packet + offset + 1;
+}
+
+// Applies the control block carried by a successful response, or by a
+// 5.03 that turned the upload away, if any
+void handleCoapResponse(const uint8_t *packet, size_t length)
+{
+    size_t payloadLength;
+    const uint8_t *payload = coapPayload(packet, length, payloadLength);
+    if (((packet[1] >> 5) == COAP_CODE_CLASS_SUCCESS ||
+         packet[1] == COAP_CODE_SERVICE_UNAVAILABLE) &&
+        payload != NULL)
+        applyControlBlock(payload, payloadLength);
+}
+
+void sendCoapAck(const uint8_t *request, uint8_t code)
+{
+    uint8_t tokenLength = request[0] & 0x0F;
+    uint8_t ack[COAP_HEADER_SIZE + 8];
+    if (tokenLength > 8)
+        return;
+    ack[0] = (COAP_VERSION << 6) | (COAP_TYPE_ACK << 4) | tokenLength;
+    ack[1] = code;
+    ack[2] = request[2];
+    ack[3] = request[3];
+    memcpy(ack + COAP_HEADER_SIZE, request + COAP_HEADER_SIZE, tokenLength);
+    if (udp.beginPacket(coapServerIP, SERVER_COAP_PORT))
+    {
+        udp.write(ack, COAP_HEADER_SIZE + tokenLength);
+        udp.endPacket();
+    }
+}
+
+// Command pushes from the backend: the control block is applied right away
+// and the ACK tells the backend whether the command was applied; a 4.00
+// leaves it queued on the backend
+void handleCoapRequest(const uint8_t *packet, size_t length)
+{
+    uint8_t type = (packet[0] >> 4) & 0x03;
+    uint8_t code = COAP_CODE_METHOD_NOT_ALLOWED;
+    if (packet[1] == COAP_CODE_POST)
+    {
+        size_t payloadLength;
+        const uint8_t *payload = coapPayload(packet, length, payloadLength);
+        code = payload != NULL && applyControlBlock(payload, payloadLength)
+                   ? COAP_CODE_CHANGED
+                   : COAP_CODE_BAD_REQUEST;
+    }
+    if (type == COAP_TYPE_CON)
+        sendCoapAck(packet, code);
+}
+
+// Requests carry a method code (class 0), anything else is a response;
+// a non-confirmable response is applied once, and only when it answers
+// the last POST
+void handleCoapPacket(const uint8_t *packet, size_t length)
+{
+    uint8_t type = (packet[0] >> 4) & 0x03;
+    if (packet[1] != 0 && (packet[1] >> 5) == 0)
+        handleCoapRequest(packet, length);
+    else if (type == COAP_TYPE_NON && isCoapPostResponse(packet, length))
+    {
+        coapPostOutstanding = false;
+        handleCoapResponse(packet, length);
+    }
+}
+
+// Command pushes, and responses that outlasted the upload's wait, arrive
+// between uploads; picked up here once per control tick
+void pollCoapResponses()
+{
+    size_t length;
+    while ((length = readCoapPacket()) > 0)
+        handleCoapPacket(coapResponseBuffer, length);
+}
+
+// Waits for the response to the POST sent as messageId: the ACK of a
+// confirmable one, or the non-confirmable response echoing its token.
+// Returns true on a 2.xx response.
+bool waitForCoapResponse(uint16_t messageId, unsigned long timeout)
+{
+    unsigned long start = millis();
+
+    while (millis() - start < timeout)
+    {
+        size_t length = readCoapPacket();
+        if (length == 0)
+        {
+            delay(1);
+            continue;
+        }
+        const uint8_t *header = coapResponseBuffer;
+        uint8_t type = (header[0] >> 4) & 0x03;
+        uint16_t id = (header[2] << 8) | header[3];
+        if (type == COAP_TYPE_NON && (header[1] >> 5) != 0 &&
+            isCoapPostResponse(header, length))
+        {
+            coapPostOutstanding = false;
+            handleCoapResponse(header, length);
+            return (header[1] >> 5) == COAP_CODE_CLASS_SUCCESS;
+        }
+        if (type == COAP_TYPE_CON || type == COAP_TYPE_NON)
+        {
+            handleCoapPacket(header, length);
+            continue;
+        }
+        if (id != messageId)
+            continue;
+        if (type == COAP_TYPE_RST)
+            return false;
+        if (type == COAP_TYPE_ACK)
+        {
+            coapPostOutstanding = false;
+            handleCoapResponse(header, length);
+            return (header[1] >> 5) == COAP_CODE_CLASS_SUCCESS;
+        }
+    }
+    return false;
+}
+
+bool sendCoapPost(const uint8_t *payload, size_t payloadLength, bool confirmable)
+{
+    uint8_t *packet = coapPacketBuffer;
+    uint16_t messageId = ++coapMessageId;
+    size_t packetLength = buildCoapPost(packet, sizeof(coapPacketBuffer),
+                                        confirmable ? COAP_TYPE_CON : COAP_TYPE_NON,
+                                        messageId, payload, payloadLength);
+    if (packetLength == 0 || !coapServerResolved)
+        return false;
+    coapPostToken = messageId;
+    coapPostOutstanding = true;
+
+    int attempts = confirmable ? COAP_MAX_RETRANSMIT + 1 : 1;
+    unsigned long timeout = confirmable ? COAP_ACK_TIMEOUT : COAP_RESPONSE_TIMEOUT;
+    for (int i = 0; i < attempts; i++)
+    {
+        if (!udp.beginPacket(coapServerIP, SERVER_COAP_PORT))
+            return false;
+        udp.write(packet, packetLength);
+        if (!udp.endPacket())
+            return false;
+
+        // A non-confirmable upload is not retransmitted, but a 5.03 or
+        // no answer at all keeps its readings for the next upload
+        if (waitForCoapResponse(messageId, timeout))
+            return true;
+        timeout *= 2;
+    }
+    return false;
+}
+#else
+// ============ HTTP CONNECTION FUNCTIONS ============
+// Both HTTP transports keep one connection open across uploads and share
+// the static request/response buffers used below.
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTPS
+// Parses SERVER_CA_CERT once at boot, while the heap may still be used
+void loadServerCa()
+{
+    mbedtls_x509_crt_init(&serverCa);
+    if (mbedtls_x509_crt_parse(&serverCa, (const unsigned char *)SERVER_CA_CERT,
+                               sizeof(SERVER_CA_CERT)) != 0)
+        Serial.println("ERROR: SERVER_CA_PEM is not a valid certificate!");
+}
+
+// Called by mbedTLS for every certificate of the server's chain it checks.
+// A resumed handshake skips the server's Certificate message, so a
+// handshake that checked none reused the session.
+int countServerCertificate(void *context, mbedtls_x509_crt *certificate,
+                           int depth, uint32_t *flags)
+{
+    tlsCertificatesChecked++;
+    return 0; // flags still fails the handshake on a bad chain
+}
+
+// esp-tls crt_bundle_attach hook: verify against SERVER_CA_CERT only
+esp_err_t attachServerCa(void *conf)
+{
+    mbedtls_ssl_config *ssl = (mbedtls_ssl_config *)conf;
+    mbedtls_ssl_conf_authmode(ssl, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(ssl, &serverCa, NULL);
+    mbedtls_ssl_conf_verify(ssl, countServerCertificate, NULL);
+    return ESP_OK;
+}
+
+bool httpIsOpen()
+{
+    return tlsConnection != NULL;
+}
+
+void httpClose()
+{
+    if (tlsConnection != NULL)
+    {
+        esp_tls_conn_destroy(tlsConnection);
+        tlsConnection = NULL;
+    }
+}
+
+bool httpOpen()
+{
+    esp_tls_cfg_t config = {};
+    config.crt_bundle_attach = attachServerCa;
+    config.timeout_ms = HTTP_TIMEOUT;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    config.client_session = tlsSession;
+#endif
+
+    unsigned long handshakeStart = micros();
+    tlsCertificatesChecked = 0;
+    tlsConnection = esp_tls_init();
+    if (tlsConnection == NULL ||
+        esp_tls_conn_new_sync(SERVER_HOST, strlen(SERVER_HOST),
+                              SERVER_HTTPS_PORT, &config, tlsConnection) != 1)
+    {
+        Serial.println("ERROR: TLS connection failed!");
+        httpClose();
+        return false;
+    }
+
+    Serial.print("TLS handshake (");
+    if (tlsCertificatesChecked == 0)
+        Serial.print("resumed");
+    else
+        Serial.print(tlsSession != NULL ? "full, ticket refused" : "full");
+    Serial.print("): ");
+    Serial.print(micros() - handshakeStart);
+    Serial.println(" us");
+
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    // Keep the newest ticket for the next reconnect
+    esp_tls_client_session_t *session = esp_tls_get_client_session(tlsConnection);
+    if (session != NULL)
+    {
+        if (tlsSession != NULL)
+            esp_tls_free_client_session(tlsSession);
+        tlsSession = session;
+    }
+#endif
+    return true;
+}
+
+int httpWrite(const uint8_t *data, size_t length)
+{
+    return esp_tls_conn_write(tlsConnection, data, length);
+}
+
+int httpRead(uint8_t *buffer, size_t length)
 {
-    lcd.clear();
-    lcd.print(str);
+    return esp_tls_conn_read(tlsConnection, buffer, length);
 }
-void displayOnLCD(float temp, float humidity, int light)
+#else
+bool httpIsOpen()
 {
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    lcd.print("T:");
-    lcd.print(temp, 1);
-    lcd.print("C H:");
-    lcd.print(humidity, 1);
-    lcd.print("%");
-    lcd.setCursor(0, 1);
-    lcd.print("Light: ");
-    lcd.print(light);
+    return httpClient.connected();
+}
+
+void httpClose()
+{
+    httpClient.stop();
+}
+
+bool httpOpen()
+{
+    if (!httpClient.connect(SERVER_HOST, SERVER_HTTP_PORT))
+    {
+        Serial.println("ERROR: HTTP connection failed!");
+        return false;
+    }
+    return true;
+}
+
+int httpWrite(const uint8_t *data, size_t length)
+{
+    return httpClient.write(data, length);
+}
+
+// Blocks until data arrives, the peer closes or HTTP_TIMEOUT passes
+int httpRead(uint8_t *buffer, size_t length)
+{
+    unsigned long start = millis();
+    while (httpClient.available() == 0)
+    {
+        if (!httpClient.connected() || millis() - start >= HTTP_TIMEOUT)
+            return -1;
+        delay(1);
+    }
+    return httpClient.read(buffer, length);
+}
+#endif
+
+// ============ HTTP FUNCTIONS ============
+bool httpWriteAll(const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        int written = httpWrite(data, length);
+        if (written <= 0)
+            return false;
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+// Reads one response and returns its status code, or -1 on a broken
+// connection. The body is drained so the connection can be reused.
+int readHttpResponse()
+{
+    char *response = httpResponseBuffer;
+    size_t received = 0;
+    char *headerEnd = NULL;
+
+    while (headerEnd == NULL)
+    {
+        if (received == HTTP_RESPONSE_BUFFER_SIZE - 1)
+            return -1;
+        int n = httpRead((uint8_t *)response + received,
+                         HTTP_RESPONSE_BUFFER_SIZE - 1 - received);
+        if (n <= 0)
+            return -1;
+        received += n;
+        response[received] = '\0';
+        headerEnd = strstr(response, "\r\n\r\n");
+    }
+
+    int statusCode = -1;
+    if (sscanf(response, "HTTP/1.%*d %d", &statusCode) != 1)
+        return -1;
+
+    long contentLength = 0;
+    char *lengthHeader = strcasestr(response, "\r\nContent-Length:");
+    if (lengthHeader != NULL && lengthHeader < headerEnd)
+        contentLength = strtol(lengthHeader + 17, NULL, 10);
+
+    char *delayHeader = strcasestr(response, "\r\n" UPLOAD_DELAY_HEADER ":");
+    if (delayHeader != NULL && delayHeader < headerEnd)
+        setUploadDelayHint(strtol(delayHeader + strlen(UPLOAD_DELAY_HEADER) + 3,
+                                  NULL, 10));
+
+    char *intervalHeader = strcasestr(response, "\r\n" UPLOAD_INTERVAL_HEADER ":");
+    char *batchHeader = strcasestr(response, "\r\n" UPLOAD_BATCH_HEADER ":");
+    setUploadRateHints(
+        intervalHeader != NULL && intervalHeader < headerEnd
+            ? strtoul(intervalHeader + strlen(UPLOAD_INTERVAL_HEADER) + 3, NULL, 10)
+            : 0,
+        batchHeader != NULL && batchHeader < headerEnd
+            ? strtoul(batchHeader + strlen(UPLOAD_BATCH_HEADER) + 3, NULL, 10)
+            : 0);
+
+    char *retryHeader = strcasestr(response, "\r\n" RETRY_AFTER_HEADER ":");
+    if (retryHeader != NULL && retryHeader < headerEnd)
+        setRetryAfter(strtoul(retryHeader + strlen(RETRY_AFTER_HEADER) + 3,
+                              NULL, 10) * 1000UL);
+
+    char *zoneHeader = strcasestr(response, "\r\n" ZONE_FAN_HEADER ":");
+    if (zoneHeader != NULL && zoneHeader < headerEnd)
+        setZoneFan(strtol(zoneHeader + strlen(ZONE_FAN_HEADER) + 3, NULL, 10) != 0);
+
+    char *commandHeader = strcasestr(response, "\r\n" COMMAND_HEADER ":");
+    unsigned long command[4];
+    int fieldsEnd = 0;
+    if (commandHeader != NULL && commandHeader < headerEnd &&
+        sscanf(commandHeader + strlen(COMMAND_HEADER) + 3,
+               "%lu;%lu;%lu;%lu%n", &command[0], &command[1], &command[2],
+               &command[3], &fieldsEnd) == 4)
+    {
+        // Optional command data as hex after a fifth ';'
+        const char *hex =
+            commandHeader + strlen(COMMAND_HEADER) + 3 + fieldsEnd;
+        uint8_t data[SCHEDULE_MAX_SIZE];
+        size_t dataLength = 0;
+        if (*hex == ';')
+            for (hex++; isxdigit(hex[0]) && isxdigit(hex[1]) &&
+                        dataLength < sizeof(data);
+                 hex += 2)
+            {
+                char byte[3] = {hex[0], hex[1], '\0'};
+                data[dataLength++] = strtol(byte, NULL, 16);
+            }
+        applyCommand(command[0], command[1], command[2], command[3], data,
+                     dataLength);
+    }
+
+    long remaining = contentLength - (long)(received - (headerEnd + 4 - response));
+    while (remaining > 0)
+    {
+        int n = httpRead((uint8_t *)response,
+                         min((long)HTTP_RESPONSE_BUFFER_SIZE, remaining));
+        if (n <= 0)
+            return -1;
+        remaining -= n;
+    }
+    return statusCode;
+}
+
+bool sendHttpPost(const uint8_t *payload, size_t payloadLength)
+{
+    int headerLength = snprintf(httpRequestHeader, sizeof(httpRequestHeader),
+                                "POST /sensor-data HTTP/1.1\r\n"
+                                "Host: %s\r\n"
+                                "Content-Type: %s\r\n"
+                                "Content-Length: %u\r\n"
+                                DEVICE_ID_HEADER ": %s\r\n"
+                                COMMAND_ACK_HEADER ": %lu\r\n"
+                                "Connection: keep-alive\r\n\r\n",
+                                SERVER_HOST, PAYLOAD_CONTENT_TYPE,
+                                (unsigned)payloadLength, deviceId,
+                                (unsigned long)lastCommandId);
+
+    // A kept-alive connection may have been closed by the server since the
+    // last upload, so retry once on a fresh connection
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!httpIsOpen() && !httpOpen())
+            return false;
+
+        int statusCode = -1;
+        if (httpWriteAll((const uint8_t *)httpRequestHeader, headerLength) &&
+            httpWriteAll(payload, payloadLength))
+            statusCode = readHttpResponse();
+
+        if (statusCode >= 200 && statusCode < 300)
+            return true;
+        httpClose();
+        if (statusCode > 0)
+        {
+            Serial.print("ERROR: HTTP POST failed, code: ");
+            Serial.println(statusCode);
+            return false;
+        }
+    }
+    return false;
+}
+#endif
+
+// ============ SERVER UPLOAD FUNCTIONS ============
+// Queues a sample for the next batch, dropping the oldest when full
+void recordSample(const SensorSample &sample)
+{
+    if (sampleCount == SAMPLE_BUFFER_SIZE)
+    {
+        memmove(sampleBatch, sampleBatch + 1,
+                (SAMPLE_BUFFER_SIZE - 1) * sizeof(SensorSample));
+        sampleCount--;
+    }
+    sampleBatch[sampleCount++] = sample;
+}
+
+bool sendDataToServer(const SensorSample *samples, int count)
+{
+    if (WiFi.status() != WL_CONNECTED)
+    {
+        Serial.println("ERROR: WiFi not connected, reconnecting...");
+        heapGuardActive = false;
+        connectToWiFi();
+        heapGuardActive = true;
+        if (WiFi.status() != WL_CONNECTED)
+            return false;
+    }
+
+    unsigned long uploadStart = micros();
+    bool success = false;
+    uint8_t *payload = payloadBuffer;
+
+    uint32_t encodeStart = ESP.getCycleCount();
+    size_t payloadLength = encodeBatch(payload, sizeof(payloadBuffer),
+                                       samples, count, millis());
+    uint32_t encodeCycles = ESP.getCycleCount() - encodeStart;
+
+    // lwIP and mbedTLS allocate internally, the guard only covers our code
+    heapGuardActive = false;
+    if (payloadLength > 0)
+    {
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+        // Alarms are retransmitted until ACKed, routine readings go out once
+        bool alarm = false;
+        for (int i = 0; i < count; i++)
+            alarm = alarm || samples[i].buzzer;
+        success = sendCoapPost(payload, payloadLength, alarm);
+#else
+        success = sendHttpPost(payload, payloadLength);
+#endif
+    }
+    heapGuardActive = true;
+
+    // Upload duration approximates radio-on time for transport comparisons
+    Serial.print("Upload ");
+    Serial.print(success ? "OK" : "FAILED");
+    Serial.print(": ");
+    Serial.print(count);
+    Serial.print(" samples, ");
+    Serial.print((unsigned)payloadLength);
+    Serial.print(" bytes ");
+    Serial.print(PAYLOAD_CONTENT_TYPE);
+    Serial.print(", encode ");
+    Serial.print(encodeCycles);
+    Serial.print(" cycles, sent in ");
+    Serial.print(micros() - uploadStart);
+    Serial.println(" us");
+    return success;
+}
+
+// Sends the batch once its upload is due. Runs on every loop pass and
+// from the sleep between reads, so the jittered schedule and the
+// backend's hints take effect to the millisecond instead of on the next
+// sample.
+void serviceUpload()
+{
+    unsigned long now = millis();
+    if (sampleCount == 0 || msUntilUpload(now) > 0)
+        return;
+    scheduleNextUpload(now);
+    if (sampleBatch[sampleCount - 1].buzzer)
+        lastAlarmUploadTime = now;
+    bool sendSuccess = sendDataToServer(sampleBatch, sampleCount);
+    if (sendSuccess)
+    {
+        sampleCount = 0;
+        uploadFailures = 0;
+    }
+    else if (retryAfter == 0) // A turned-away upload has the backend's
+        backOffUpload();
+
+    lastUploadStatus = sendSuccess ? UPLOAD_STATUS_OK : UPLOAD_STATUS_FAILED;
 }
 
 // ============ SETUP FUNCTION ============
@@ -119,56 +1815,41 @@ void setup()
     Serial.begin(115200);
     delay(1000);
 
-    Serial.println("========================================");
-    Serial.println(" Environmental Control System Started");
-    Serial.println(" WITH PostgreSQL Integration");
-    Serial.println("========================================");
-    Serial.println("Hardware Configuration:");
-    Serial.println("  DHT22: GPIO15");
-    Serial.println("  Fan Relay: GPIO26 | Fan LED: GPIO32");
-    Serial.println("  Light Relay: GPIO27 | Light LED: GPIO33");
-    Serial.println("  Buzzer: GPIO25 | Alarm LED: GPIO14");
-    Serial.println("  LDR: GPIO34 (ADC)");
-    Serial.println("  LCD: I2C (SDA=21, SCL=22)");
-    Serial.println("========================================");
+    Serial.println(STARTUP_BANNER);
+    initDeviceId();
+    Serial.print("Device ID: ");
+    Serial.println(deviceId);
+    reportFirmwareSections();
 
     // Initialize I2C LCD
     // Wire.begin();
-    lcd.init();
-    lcd.backlight();
-    lcd.clear();
-    lcd.setCursor(0, 0);
-    writeALineOnLCD("Environmental Control System Started");
+    initLCD();
+    writeALineOnLCD("Environmental control started");
 
     delay(1000);
 
-    Serial.println("✓ LCD initialized");
-    writeALineOnLCD("✓ LCD initialized");
+    logReady("LCD ready");
 
     // Initialize DHT22 sensor
     dht.begin();
-    Serial.println("✓ DHT22 initialized");
-    writeALineOnLCD("✓ DHT22 initialized");
+    logReady("DHT22 ready");
     delay(2000);
 
     // Initialize ADC
     analogReadResolution(12);
-    Serial.println("✓ ADC initialized");
-    writeALineOnLCD("✓ ADC initialized");
+    logReady("ADC ready");
 
     // Initialize relay GPIO pins
     pinMode(FAN_RELAY_PIN, OUTPUT);
     pinMode(LIGHT_RELAY_PIN, OUTPUT);
     digitalWrite(FAN_RELAY_PIN, HIGH);
     digitalWrite(LIGHT_RELAY_PIN, HIGH);
-    Serial.println("✓ Relays initialized (all OFF)");
-    writeALineOnLCD("✓ Relays initialized (all OFF)");
+    logReady("Relays ready (all OFF)");
 
     // Initialize buzzer GPIO
     pinMode(BUZZER_PIN, OUTPUT);
     digitalWrite(BUZZER_PIN, LOW);
-    Serial.println("✓ Buzzer initialized (OFF)");
-    writeALineOnLCD("✓ Buzzer initialized (OFF)");
+    logReady("Buzzer ready (OFF)");
 
     // Initialize LED indicator pins
     pinMode(FAN_LED_PIN, OUTPUT);
@@ -177,17 +1858,26 @@ void setup()
     digitalWrite(FAN_LED_PIN, LOW);
     digitalWrite(LIGHT_LED_PIN, LOW);
     digitalWrite(ALARM_LED_PIN, LOW);
-    Serial.println("✓ LED indicators initialized (all OFF)");
-    writeALineOnLCD("✓ LED indicators initialized (all OFF)");
+    logReady("LED indicators ready (all OFF)");
 
-    Serial.println("Hardware initialization complete!");
-    writeALineOnLCD("Hardware initialization complete!");
+    logStatus("Hardware init complete!");
 
     // Connect to WiFi
     connectToWiFi();
+    startTimeSync();
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_HTTPS
+    loadServerCa();
+#endif
+
+    // Random first upload so a fleet powered on together is spread out,
+    // after the first sample so it does not wait for one on its boundary
+    lastUploadTime = millis();
+    nextUploadDelay = DATA_SEND_INTERVAL + esp_random() % UPLOAD_INTERVAL;
+
+    // From here on the loop must not touch the heap
+    startHeapGuard();
 
     Serial.println("\nSystem Ready!\n");
-    lcd.clear();
     writeALineOnLCD("System Ready");
     delay(1000);
 }
@@ -204,6 +1894,16 @@ void loop()
     bool lightLedStatus = false;
     bool alarmLedStatus = false;
     bool buzzerStatus = false;
+    uint64_t readWallMs = wallClockMs();
+
+#if UPLOAD_TRANSPORT == UPLOAD_TRANSPORT_COAP
+    // Commands and zone control that arrived since the last tick take
+    // effect this tick. WiFiUDP buffers received packets on the heap, so
+    // the guard is paused.
+    heapGuardActive = false;
+    pollCoapResponses();
+    heapGuardActive = true;
+#endif
 
     // Read DHT22 sensor
     bool sensorSuccess = readDHT22(temperature, humidity);
@@ -213,9 +1913,6 @@ void loop()
         // Read light level
         lightLevel = readLightLevel();
 
-        // Display on LCD
-        displayOnLCD(temperature, humidity, lightLevel);
-
         // Log to Serial Monitor
         Serial.print("Temp: ");
         Serial.print(temperature, 1);
@@ -224,61 +1921,53 @@ void loop()
         Serial.print("%, Light: ");
         Serial.println(lightLevel);
 
+#if TRACE_RECORDER
+        writeTraceLine(millis(), temperature, humidity, lightLevel);
+#endif
+
         // ============ CONTROL LOGIC ============
+        ControlOutputs outputs = evaluateControl(temperature, humidity, lightLevel);
+        // The zone's fan decision replaces the local rule while it is
+        // fresh, scheduled windows replace both, and commanded states
+        // override everything until they expire
+        outputs = applyZoneControl(outputs, currentZoneControl(millis()));
+        updateSchedule(millis(), readWallMs);
+        outputs = applyOverrides(outputs, scheduleOverrides, millis());
+        outputs = applyOverrides(outputs, commandOverrides, millis());
 
-        // Fan control
-        if (temperature >= TEMP_HIGH)
-        {
-            controlFan(true);
-            fanStatus = true;
-            fanLedStatus = true;
-        }
-        else
-        {
-            if (temperature < TEMP_HIGH)
-            {
-                controlFan(false);
-                fanStatus = false;
-                fanLedStatus = false;
-            }
-        }
+        controlFan(outputs.fan);
+        fanStatus = outputs.fan;
+        fanLedStatus = outputs.fan;
 
-        // Light control
-        if (lightLevel < LIGHT_LOW)
-        {
-            controlLight(true);
-            lightStatus = true;
-            lightLedStatus = true;
-        }
-        else
-        {
-            controlLight(false);
-            lightStatus = false;
-            lightLedStatus = false;
-        }
+        controlLight(outputs.light);
+        lightStatus = outputs.light;
+        lightLedStatus = outputs.light;
+
+        controlBuzzer(outputs.buzzer);
+        buzzerStatus = outputs.buzzer;
+        alarmLedStatus = outputs.buzzer;
 
-        // Alarm control
-        if ((temperature >= TEMP_HIGH || humidity >= HUMIDITY_HIGH) &&
-            lightLevel < LIGHT_LOW)
-        {
-            controlBuzzer(true);
-            buzzerStatus = true;
-            alarmLedStatus = true;
-        }
-        else
-        {
-            controlBuzzer(false);
-            buzzerStatus = false;
-            alarmLedStatus = false;
-        }
         // ============ SEND DATA TO SERVER ============
-        // Only send data if:
+        // Only record a sample if:
         // 1. Sensors read successfully (we're here in this if block)
-        // 2. Enough time has passed since last send
+        // 2. This read is on a wall-clock sample boundary, or before SNTP
+        //    sync, enough time has passed since the last sample
+        // The batch is uploaded on its jittered schedule (stretched by the
+        // backend's rate hints, see serviceUpload()), or early in this
+        // device's slot after the sample when it is full or on an alarm.
         unsigned long currentTime = millis();
-        if (currentTime - lastSendTime >= DATA_SEND_INTERVAL)
+        uint64_t boundary = sampleBoundary(readWallMs, lastSampleBoundary,
+                                           SENSOR_READ_INTERVAL,
+                                           DATA_SEND_INTERVAL);
+        bool sampleDue = readWallMs != 0
+                             ? boundary != 0
+                             : currentTime - lastSendTime >= DATA_SEND_INTERVAL;
+        if (sampleDue)
         {
-            bool sendSuccess = sendDataToServer(
+            uint32_t wallTime = boundary / 1000; // 0 before SNTP sync
+            SensorSample sample = {
+                currentTime,    // created_at from the age before SNTP sync
+                wallTime,       // created_at once synced
                 temperature,    // temperature (numeric 5,2)
                 humidity,       // humidity (numeric 5,2)
                 lightLevel,     // light_intensity (numeric 5,2)
@@ -288,22 +1977,32 @@ void loop()
                 lightLedStatus, // light_led (boolean)
                 alarmLedStatus, // alram_led (boolean) - matches your typo
                 buzzerStatus    // buzzer (boolean)
-            );
+            };
+            recordSample(sample);
 
-            // Brief visual feedback on LCD
-            if (sendSuccess)
-            {
-                lcd.setCursor(15, 1);
-                lcd.print("*"); // Success indicator
-            }
-            else
-            {
-                lcd.setCursor(15, 1);
-                lcd.print("X"); // Failed indicator
-            }
+            // A full batch or an alarm goes out early
+            if (sampleCount >= uploadFlushSize ||
+                (buzzerStatus && alarmUploadAllowed(currentTime)))
+                requestUpload(currentTime);
 
             lastSendTime = currentTime;
+            lastSampleBoundary = boundary;
+        }
+
+        // ============ LCD STATUS PAGES ============
+        // Pages are rerendered every reading but only changed cells are sent
+        DisplayStatus status = {
+            temperature, humidity, lightLevel,
+            outputs.fan, outputs.light, outputs.buzzer,
+            WiFi.RSSI(), wifiSignalBars(), lastUploadStatus,
+            alarmReason(temperature, humidity, lightLevel)};
+        renderStatusPages(status);
+        if (currentTime - lastPageSwitchTime >= LCD_PAGE_INTERVAL)
+        {
+            lcdPage = (lcdPage + 1) % LCD_PAGE_COUNT;
+            lastPageSwitchTime = currentTime;
         }
+        showLCDPage(lcdPage);
     }
     else
     {
@@ -311,12 +2010,27 @@ void loop()
         // DO NOT send data to server when sensor fails
         Serial.println("⚠ Sensor read failed. NOT sending data to server.");
 
-        lcd.clear();
-        lcd.setCursor(0, 0);
-        lcd.print("Sensor Error!");
-        lcd.setCursor(0, 1);
-        lcd.print("No data sent");
+        displaySensorErrorOnLCD();
     }
 
-    delay(SENSOR_READ_INTERVAL);
+    serviceUpload();
+    reportHeap(millis());
+
+    // Sleep until the next wall-clock read boundary, waking in between
+    // for an upload that falls due first
+    uint64_t wallMs = wallClockMs();
+    unsigned long wait = wallMs != 0 ? msUntilBoundary(wallMs, SENSOR_READ_INTERVAL)
+                                     : SENSOR_READ_INTERVAL;
+    unsigned long untilUpload = sampleCount > 0 ? msUntilUpload(millis()) : wait;
+    if (untilUpload < wait)
+    {
+        unsigned long sleepStart = millis();
+        delay(untilUpload);
+        serviceUpload();
+        unsigned long slept = millis() - sleepStart;
+        wallMs = wallClockMs();
+        wait = wallMs != 0 ? msUntilBoundary(wallMs, SENSOR_READ_INTERVAL)
+                           : (slept < wait ? wait - slept : 0);
+    }
+    delay(wait);
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+/*
+ * Control rules for the fan, grow light and alarm.
+ * Pure functions with no Arduino dependencies, shared by the sketch and
+ * the host tools in tools/.
+ */
+
+#ifndef CONTROL_LOGIC_H
+#define CONTROL_LOGIC_H
+
+// ============ THRESHOLD VALUES ============
+#define TEMP_HIGH 30.0
+#define HUMIDITY_HIGH 70.0
+#define LIGHT_LOW 500
+
+// ============ DATA TYPES ============
+struct ControlOutputs
+{
+    bool fan;
+    bool light;
+    bool buzzer;
+};
+
+// ============ CONTROL FUNCTIONS ============
+inline ControlOutputs evaluateControl(float temperature, float humidity,
+                                      int lightLevel)
+{
+    ControlOutputs outputs;
+    bool dark = lightLevel < LIGHT_LOW;
+
+    // Fan runs while it is too hot
+    outputs.fan = temperature >= TEMP_HIGH;
+    // Grow light compensates for low ambient light
+    outputs.light = dark;
+    // Alarm when hot or humid while dark
+    outputs.buzzer = (temperature >= TEMP_HIGH || humidity >= HUMIDITY_HIGH) &&
+                     dark;
+    return outputs;
+}
+
+// Zone-level decision from the backend, shared by all boards of a zone
+struct ZoneControl
+{
+    bool valid; // False when stale or disconnected: keep local rules
+    bool fan;
+};
+
+inline ControlOutputs applyZoneControl(ControlOutputs outputs,
+                                       const ZoneControl &zone)
+{
+    if (zone.valid)
+        outputs.fan = zone.fan;
+    return outputs;
+}
+
+// Actuator state forced by a backend command until it expires
+struct ActuatorOverride
+{
+    bool active;
+    bool state;
+    unsigned long until; // millis() at expiry
+};
+
+struct Overrides
+{
+    ActuatorOverride fan;
+    ActuatorOverride light;
+    ActuatorOverride buzzer;
+};
+
+inline void applyOverride(bool &output, const ActuatorOverride &forced,
+                          unsigned long now)
+{
+    if (forced.active && (long)(forced.until - now) > 0)
+        output = forced.state;
+}
+
+inline ControlOutputs applyOverrides(ControlOutputs outputs,
+                                     const Overrides &overrides,
+                                     unsigned long now)
+{
+    applyOverride(outputs.fan, overrides.fan, now);
+    applyOverride(outputs.light, overrides.light, now);
+    applyOverride(outputs.buzzer, overrides.buzzer, now);
+    return outputs;
+}
+
+// Short reason for the alarm state, fits one LCD row
+inline const char *alarmReason(float temperature, float humidity,
+                               int lightLevel)
+{
+    bool hot = temperature >= TEMP_HIGH;
+    bool humid = humidity >= HUMIDITY_HIGH;
+    if (lightLevel >= LIGHT_LOW || (!hot && !humid))
+        return "All normal";
+    if (hot && humid)
+        return "Hot+humid, dark";
+    return hot ? "Hot and dark" : "Humid and dark";
+}
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * LCD screens of the monitoring system.
+ * Only uses the LiquidCrystal_I2C interface, so the same code renders on
+ * the real display and on the host emulator in tools/.
+ *
+ * Screens are drawn into framebuffers and flushed by writing only the
+ * cells that differ from what the display already shows, so rotating
+ * between prerendered pages costs just the changed cells on the bus.
+ */
+
+#ifndef LCD_DISPLAY_H
+#define LCD_DISPLAY_H
+
+#include <LiquidCrystal_I2C.h>
+#include <stdarg.h>
+
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+// ============ LCD GLYPHS ============
+// CGRAM slots 0-7
+#define GLYPH_FAN 0
+#define GLYPH_BULB 1
+#define GLYPH_BELL 2
+#define GLYPH_CHECK 3
+#define GLYPH_WIFI_LOW 4
+#define GLYPH_WIFI_MID 5
+#define GLYPH_WIFI_HIGH 6
+#define GLYPH_CROSS 7
+#define GLYPH_COUNT 8
+
+const uint8_t LCD_GLYPHS[GLYPH_COUNT][8] = {
+    {0x00, 0x19, 0x0B, 0x04, 0x1A, 0x13, 0x00, 0x00}, // Fan
+    {0x0E, 0x11, 0x11, 0x11, 0x0A, 0x0E, 0x0E, 0x04}, // Bulb
+    {0x04, 0x0E, 0x0E, 0x0E, 0x1F, 0x00, 0x04, 0x00}, // Bell
+    {0x00, 0x01, 0x03, 0x16, 0x1C, 0x08, 0x00, 0x00}, // Check mark
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x10}, // WiFi, 1 bar
+    {0x00, 0x00, 0x00, 0x00, 0x04, 0x04, 0x14, 0x14}, // WiFi, 2 bars
+    {0x00, 0x00, 0x01, 0x01, 0x05, 0x05, 0x15, 0x15}, // WiFi, 3 bars
+    {0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00, 0x00}, // Cross
+};
+
+// ============ STATUS PAGES ============
+#define LCD_PAGE_READINGS 0
+#define LCD_PAGE_ACTUATORS 1
+#define LCD_PAGE_ALARM 2
+#define LCD_PAGE_COUNT 3
+
+#define UPLOAD_STATUS_NONE 0
+#define UPLOAD_STATUS_OK 1
+#define UPLOAD_STATUS_FAILED 2
+
+struct DisplayStatus
+{
+    float temperature;
+    float humidity;
+    int lightLevel;
+    bool fan;
+    bool light;
+    bool buzzer;
+    int rssi;     // dBm, only meaningful when wifiBars > 0
+    int wifiBars; // 0 when disconnected
+    int upload;   // UPLOAD_STATUS_*
+    const char *alarmReason;
+};
+
+typedef uint8_t LcdFrame[LCD_ROWS][LCD_COLS];
+
+// Defined by the sketch (and the host tools) next to lcd, so this header
+// can be included from more than one translation unit
+extern LiquidCrystal_I2C lcd;
+extern LcdFrame lcdPages[LCD_PAGE_COUNT];
+extern LcdFrame lcdMessage; // Scratch frame for one-off messages
+extern LcdFrame lcdShown;   // What the display currently shows
+extern uint32_t lcdTruncations; // Texts cut off at the row end or screen end
+
+// ============ FRAME FUNCTIONS ============
+inline void clearFrame(LcdFrame frame)
+{
+    memset(frame, ' ', sizeof(LcdFrame));
+}
+
+// Writes text clipped to the row; returns the column after it
+inline int frameText(LcdFrame frame, int row, int col, const char *text)
+{
+    while (*text != '\0' && col < LCD_COLS)
+        frame[row][col++] = *text++;
+    if (*text != '\0')
+        lcdTruncations++;
+    return col;
+}
+
+// printf into the row from col, clipped like frameText()
+inline int frameFormat(LcdFrame frame, int row, int col, const char *format, ...)
+{
+    char text[LCD_COLS + 2]; // One extra so a clipped text stays visible
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (length >= (int)sizeof(text))
+        lcdTruncations++;
+    return frameText(frame, row, col, text);
+}
+
+inline void frameGlyph(LcdFrame frame, int row, int col, uint8_t glyph)
+{
+    frame[row][col] = glyph;
+}
+
+inline uint8_t wifiGlyph(int bars)
+{
+    if (bars <= 0)
+        return GLYPH_CROSS;
+    if (bars == 1)
+        return GLYPH_WIFI_LOW;
+    return bars == 2 ? GLYPH_WIFI_MID : GLYPH_WIFI_HIGH;
+}
+
+inline uint8_t uploadGlyph(int upload)
+{
+    if (upload == UPLOAD_STATUS_OK)
+        return GLYPH_CHECK;
+    return upload == UPLOAD_STATUS_FAILED ? GLYPH_CROSS : ' ';
+}
+
+// ============ LCD FUNCTIONS ============
+// Sends only the cells that differ from the display, moving the cursor
+// only where a run of unchanged cells was skipped
+inline void flushLCD(const LcdFrame frame)
+{
+    for (int row = 0; row < LCD_ROWS; row++)
+    {
+        int cursor = -1;
+        for (int col = 0; col < LCD_COLS; col++)
+        {
+            if (lcdShown[row][col] == frame[row][col])
+                continue;
+            if (cursor != col)
+                lcd.setCursor(col, row);
+            lcd.write(frame[row][col]);
+            lcdShown[row][col] = frame[row][col];
+            cursor = col + 1;
+        }
+    }
+}
+
+inline void initLCD()
+{
+    lcd.init();
+    lcd.backlight();
+    for (int i = 0; i < GLYPH_COUNT; i++)
+        lcd.createChar(i, (uint8_t *)LCD_GLYPHS[i]);
+    lcd.clear();
+    clearFrame(lcdShown);
+}
+
+// Word-wraps a message over both rows; an optional glyph leads the text
+inline void writeMessageOnLCD(const char *str, int glyph)
+{
+    clearFrame(lcdMessage);
+    int row = 0;
+    int col = 0;
+    if (glyph >= 0)
+    {
+        frameGlyph(lcdMessage, 0, 0, glyph);
+        col = 2;
+    }
+
+    while (*str != '\0' && row < LCD_ROWS)
+    {
+        const char *wordEnd = str;
+        while (*wordEnd != '\0' && *wordEnd != ' ')
+            wordEnd++;
+        int length = wordEnd - str;
+        if (col > 0 && col + length > LCD_COLS)
+        {
+            row++;
+            col = 0;
+            continue;
+        }
+        for (; str < wordEnd && col < LCD_COLS && row < LCD_ROWS; str++)
+            lcdMessage[row][col++] = *str;
+        while (*str == ' ')
+            str++;
+        col++; // Space between words
+    }
+    if (*str != '\0')
+        lcdTruncations++;
+    flushLCD(lcdMessage);
+}
+
+inline void writeALineOnLCD(const char *str)
+{
+    writeMessageOnLCD(str, -1);
+}
+
+inline void displaySensorErrorOnLCD()
+{
+    clearFrame(lcdMessage);
+    frameText(lcdMessage, 0, 0, "Sensor Error!");
+    frameText(lcdMessage, 1, 0, "No data sent");
+    flushLCD(lcdMessage);
+}
+
+// Prerenders every status page; nothing is sent to the display
+inline void renderStatusPages(const DisplayStatus &status)
+{
+    // Whole-percent humidity keeps -40.0C / 100% within 16 columns; the
+    // DHT22 is only accurate to 2% anyway
+    LcdFrame &readings = lcdPages[LCD_PAGE_READINGS];
+    clearFrame(readings);
+    frameFormat(readings, 0, 0, "T:%.1fC H:%.0f%%", status.temperature,
+                status.humidity);
+    frameFormat(readings, 1, 0, "Light: %d", status.lightLevel);
+    if (status.fan)
+        frameGlyph(readings, 1, 11, GLYPH_FAN);
+    if (status.light)
+        frameGlyph(readings, 1, 12, GLYPH_BULB);
+    if (status.buzzer)
+        frameGlyph(readings, 1, 13, GLYPH_BELL);
+    frameGlyph(readings, 1, 14, wifiGlyph(status.wifiBars));
+    frameGlyph(readings, 1, 15, uploadGlyph(status.upload));
+
+    LcdFrame &actuators = lcdPages[LCD_PAGE_ACTUATORS];
+    clearFrame(actuators);
+    frameGlyph(actuators, 0, 0, GLYPH_FAN);
+    frameText(actuators, 0, 1, status.fan ? "ON" : "OFF");
+    frameGlyph(actuators, 0, 5, GLYPH_BULB);
+    frameText(actuators, 0, 6, status.light ? "ON" : "OFF");
+    frameGlyph(actuators, 0, 10, GLYPH_BELL);
+    frameText(actuators, 0, 11, status.buzzer ? "ON" : "OFF");
+    frameGlyph(actuators, 1, 0, wifiGlyph(status.wifiBars));
+    if (status.wifiBars > 0)
+        frameFormat(actuators, 1, 2, "%ddBm", status.rssi);
+    else
+        frameText(actuators, 1, 2, "offline");
+    frameText(actuators, 1, 10, "Sent:");
+    frameGlyph(actuators, 1, 15, uploadGlyph(status.upload));
+
+    LcdFrame &alarm = lcdPages[LCD_PAGE_ALARM];
+    clearFrame(alarm);
+    frameGlyph(alarm, 0, 0, GLYPH_BELL);
+    frameText(alarm, 0, 2, status.buzzer ? "Alarm ON" : "Alarm off");
+    frameText(alarm, 1, 0, status.alarmReason);
+}
+
+inline void showLCDPage(int page)
+{
+    flushLCD(lcdPages[page]);
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Wall-clock aligned sampling schedule of the monitoring system.
+ * Kept free of Arduino dependencies so the schedule can be simulated on
+ * the host (tools/clock_skew.cpp).
+ *
+ * Once SNTP has set the clock, every reading is taken on a wall-clock
+ * multiple of the read interval and samples on multiples of the sample
+ * interval, so readings from different boards share the same buckets.
+ * The wait is recomputed from the wall clock on every loop, so neither
+ * the loop's run time nor SNTP corrections accumulate as drift.
+ */
+
+#ifndef SAMPLE_CLOCK_H
+#define SAMPLE_CLOCK_H
+
+#include <stdint.h>
+
+// Milliseconds to wait until the next wall-clock multiple of interval
+inline uint32_t msUntilBoundary(uint64_t wallMs, uint32_t interval)
+{
+    return interval - wallMs % interval;
+}
+
+// Boundary a reading belongs to; readings land just after the boundary
+// they were scheduled for, so round to the nearest one
+inline uint64_t nearestBoundary(uint64_t wallMs, uint32_t interval)
+{
+    return (wallMs + interval / 2) / interval * interval;
+}
+
+// Sample boundary a reading at wallMs is kept as, or 0 when it is no
+// sample: not on a sample boundary, already sampled, or too far off the
+// boundary (the first reading after boot or an SNTP step)
+inline uint64_t sampleBoundary(uint64_t wallMs, uint64_t lastSampleBoundary,
+                               uint32_t readInterval, uint32_t sampleInterval)
+{
+    uint64_t boundary = nearestBoundary(wallMs, readInterval);
+    uint64_t distance = wallMs > boundary ? wallMs - boundary
+                                          : boundary - wallMs;
+    if (boundary % sampleInterval != 0 || boundary == lastSampleBoundary ||
+        distance > readInterval / 20)
+        return 0;
+    return boundary;
+}
+
+#endif
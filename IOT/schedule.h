@@ -0,0 +1,170 @@
+/*
+ * Time-of-day schedules for the fan and grow light.
+ * Kept free of Arduino dependencies so lookups can be checked on the host
+ * (tools/schedule_check.cpp).
+ *
+ * Each actuator has a table of windows in minutes of the local day,
+ * sorted by start and not overlapping, during which it is held at the
+ * window's state. Windows across midnight are split by the backend. The
+ * tables arrive in a compact binary format (see decodeSchedule) with the
+ * downlink commands.
+ *
+ * A schedule is evaluated into overrides that hold until the next window
+ * start or end, so the sketch only looks at the tables again when that
+ * event is due rather than on every reading.
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "control_logic.h"
+
+#define SCHEDULE_FORMAT_VERSION 1
+#define SCHEDULE_MAX_WINDOWS 8 // Per actuator
+#define SCHEDULE_HEADER_SIZE 5
+#define SCHEDULE_WINDOW_SIZE 3
+#define SCHEDULE_MAX_SIZE \
+    (SCHEDULE_HEADER_SIZE + 2 * SCHEDULE_MAX_WINDOWS * SCHEDULE_WINDOW_SIZE)
+#define MINUTES_PER_DAY 1440
+#define MS_PER_MINUTE 60000UL
+#define MS_PER_DAY (MINUTES_PER_DAY * MS_PER_MINUTE)
+
+// ============ DATA TYPES ============
+struct ScheduleWindow
+{
+    uint16_t start; // Minute of the local day, inclusive
+    uint16_t end;   // Minute of the local day, exclusive
+    bool state;
+};
+
+struct ActuatorSchedule
+{
+    uint8_t count;
+    ScheduleWindow windows[SCHEDULE_MAX_WINDOWS];
+};
+
+struct Schedule
+{
+    int16_t utcOffset; // Minutes east of UTC
+    ActuatorSchedule fan;
+    ActuatorSchedule light;
+};
+
+// ============ LOOKUP FUNCTIONS ============
+// Index of the last window starting at or before minute, -1 if none
+inline int scheduleWindowIndex(const ActuatorSchedule &schedule,
+                               uint16_t minute)
+{
+    int low = 0;
+    int high = schedule.count;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (schedule.windows[middle].start <= minute)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low - 1;
+}
+
+// Scheduled state at dayMs into the local day as an override lasting until
+// the actuator's next window start or end; returns the ms until that event
+inline uint32_t evaluateActuatorSchedule(const ActuatorSchedule &schedule,
+                                         uint32_t dayMs, unsigned long now,
+                                         ActuatorOverride &forced)
+{
+    forced = ActuatorOverride();
+    if (schedule.count == 0)
+        return MS_PER_DAY;
+
+    uint16_t minute = dayMs / MS_PER_MINUTE;
+    int index = scheduleWindowIndex(schedule, minute);
+    uint32_t eventMinute;
+    if (index >= 0 && minute < schedule.windows[index].end)
+    {
+        forced.active = true;
+        forced.state = schedule.windows[index].state;
+        eventMinute = schedule.windows[index].end;
+    }
+    else if (index + 1 < schedule.count)
+        eventMinute = schedule.windows[index + 1].start;
+    else
+        eventMinute = schedule.windows[0].start + MINUTES_PER_DAY;
+
+    uint32_t untilEvent = eventMinute * MS_PER_MINUTE - dayMs;
+    forced.until = now + untilEvent;
+    return untilEvent;
+}
+
+// Scheduled fan and light states at wallMs (ms since the epoch); returns
+// the ms until either changes
+inline uint32_t evaluateSchedule(const Schedule &schedule, uint64_t wallMs,
+                                 unsigned long now, Overrides &overrides)
+{
+    int64_t localMs =
+        (int64_t)wallMs + schedule.utcOffset * (int64_t)MS_PER_MINUTE;
+    const int64_t day = MS_PER_DAY;
+    uint32_t dayMs = (uint32_t)((localMs % day + day) % day);
+    overrides = Overrides();
+    uint32_t fanEvent = evaluateActuatorSchedule(schedule.fan, dayMs, now,
+                                                 overrides.fan);
+    uint32_t lightEvent = evaluateActuatorSchedule(schedule.light, dayMs, now,
+                                                   overrides.light);
+    return fanEvent < lightEvent ? fanEvent : lightEvent;
+}
+
+// ============ DECODING FUNCTIONS ============
+// Binary schedule, must match encodeSchedule in backend/schedule.js:
+//   u8 SCHEDULE_FORMAT_VERSION, i16 UTC offset in minutes (big-endian),
+//   u8 fan window count, u8 light window count, then the fan windows and
+//   the light windows, 3 bytes each: start (11 bits), end (11 bits),
+//   state (1 bit), 1 bit unused
+inline bool decodeActuatorSchedule(const uint8_t *&data, uint8_t count,
+                                   ActuatorSchedule &schedule)
+{
+    if (count > SCHEDULE_MAX_WINDOWS)
+        return false;
+    schedule.count = count;
+    uint16_t previousEnd = 0;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint32_t packed = ((uint32_t)data[0] << 16) | (data[1] << 8) | data[2];
+        data += SCHEDULE_WINDOW_SIZE;
+        ScheduleWindow &window = schedule.windows[i];
+        window.start = packed >> 13;
+        window.end = (packed >> 2) & 0x7FF;
+        window.state = (packed >> 1) & 1;
+        if (window.start < previousEnd || window.start >= window.end ||
+            window.end > MINUTES_PER_DAY)
+            return false;
+        previousEnd = window.end;
+    }
+    return true;
+}
+
+// false (and schedule untouched) when the data is malformed
+inline bool decodeSchedule(const uint8_t *data, size_t length,
+                           Schedule &schedule)
+{
+    if (length < SCHEDULE_HEADER_SIZE || data[0] != SCHEDULE_FORMAT_VERSION)
+        return false;
+    uint8_t fanCount = data[3];
+    uint8_t lightCount = data[4];
+    if (length != SCHEDULE_HEADER_SIZE +
+                      (size_t)(fanCount + lightCount) * SCHEDULE_WINDOW_SIZE)
+        return false;
+
+    Schedule decoded;
+    decoded.utcOffset = (int16_t)((data[1] << 8) | data[2]);
+    data += SCHEDULE_HEADER_SIZE;
+    if (!decodeActuatorSchedule(data, fanCount, decoded.fan) ||
+        !decodeActuatorSchedule(data, lightCount, decoded.light))
+        return false;
+    schedule = decoded;
+    return true;
+}
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * Host simulation of a fleet of boards with skewed crystals, comparing the
+ * free-running millis() sampling schedule with the SNTP-aligned one of
+ * sample_clock.h.
+ *
+ * Build:  g++ -O2 -std=c++17 -o clock_skew clock_skew.cpp
+ * Usage:  clock_skew [--boards <n>] [--hours <n>] [--skew-ppm <ppm>]
+ *                    [--sync-minutes <n>] [--sntp-error-ms <ms>]
+ *
+ * Each board has a constant crystal error within +/- skew-ppm, boots at a
+ * random time and spends a random time per loop reading sensors, with a
+ * longer upload every UPLOAD_BATCH_SIZE samples. SNTP resets the wall
+ * clock offset to within +/- sntp-error-ms every sync interval; between
+ * syncs the offset grows with the crystal error (modeled as a step, the
+ * firmware slews).
+ *
+ * Alignment error is the true sampling instant minus the bucket boundary
+ * the sample is attributed to. A bucket is complete when every board has
+ * exactly one sample in it, which is what a bucket join needs. The exit
+ * status is 1 when an aligned sample lands in the wrong bucket.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../sample_clock.h"
+
+// Same values as TIMING CONFIGURATION in the sketch
+#define SENSOR_READ_INTERVAL 2000
+#define DATA_SEND_INTERVAL 10000
+#define UPLOAD_BATCH_SIZE 6
+
+#define BOOT_SPREAD_MS 60000
+#define SETUP_MS 5000
+#define LOOP_WORK_MIN_MS 30
+#define LOOP_WORK_MAX_MS 300
+#define UPLOAD_WORK_MAX_MS 1500
+
+// ============ DATA TYPES ============
+struct Options
+{
+    int boards = 50;
+    double hours = 24;
+    double skewPpm = 40;
+    double syncMinutes = 15;
+    double sntpErrorMs = 20;
+};
+
+struct Board
+{
+    double skew;         // Crystal error, local ms per true ms minus 1
+    double offsetMs;     // Wall clock error at the last sync
+    double lastSyncMs;   // True time of the last sync
+};
+
+struct Sample
+{
+    double trueMs;    // When the sample was actually taken
+    double bucketMs;  // Boundary it is attributed to
+};
+
+struct ScheduleStats
+{
+    std::vector<double> errors;
+    long misbucketed = 0;
+    long completeBuckets = 0;
+    long buckets = 0;
+};
+
+// ============ CLOCK MODEL ============
+static double wallClock(const Board &board, double trueMs)
+{
+    return trueMs + board.offsetMs + (trueMs - board.lastSyncMs) * board.skew;
+}
+
+static void syncIfDue(Board &board, double trueMs, const Options &options,
+                      std::mt19937 &rng)
+{
+    if (trueMs - board.lastSyncMs < options.syncMinutes * 60000)
+        return;
+    std::uniform_real_distribution<double> residual(-options.sntpErrorMs,
+                                                    options.sntpErrorMs);
+    board.offsetMs = residual(rng);
+    board.lastSyncMs = trueMs;
+}
+
+static double loopWork(int samples, std::mt19937 &rng, bool sampled)
+{
+    std::uniform_real_distribution<double> work(LOOP_WORK_MIN_MS,
+                                                LOOP_WORK_MAX_MS);
+    std::uniform_real_distribution<double> upload(0, UPLOAD_WORK_MAX_MS);
+    double ms = work(rng);
+    if (sampled && samples % UPLOAD_BATCH_SIZE == 0)
+        ms += upload(rng);
+    return ms;
+}
+
+// ============ SCHEDULES ============
+// Current firmware: delay(SENSOR_READ_INTERVAL) after the loop's work and
+// a sample once DATA_SEND_INTERVAL of millis() has passed. The backend
+// buckets created_at (receive time minus age) by rounding.
+static std::vector<Sample> runFreeRunning(const Board &board, double bootMs,
+                                          double endMs, std::mt19937 &rng)
+{
+    std::vector<Sample> samples;
+    double trueMs = bootMs + SETUP_MS;
+    double lastSampleLocal = -DATA_SEND_INTERVAL;
+    while (trueMs < endMs)
+    {
+        double local = (trueMs - bootMs) * (1 + board.skew);
+        bool sampled = local - lastSampleLocal >= DATA_SEND_INTERVAL;
+        if (sampled)
+        {
+            samples.push_back(
+                {trueMs, (double)nearestBoundary((uint64_t)trueMs,
+                                                 DATA_SEND_INTERVAL)});
+            lastSampleLocal = local;
+        }
+        trueMs += loopWork(samples.size(), rng, sampled);
+        trueMs += SENSOR_READ_INTERVAL / (1 + board.skew);
+    }
+    return samples;
+}
+
+// Aligned firmware: sleep to the next wall-clock read boundary, keep the
+// reading on sample boundaries, attributed to that boundary
+static std::vector<Sample> runAligned(Board board, double bootMs, double endMs,
+                                      const Options &options,
+                                      std::mt19937 &rng)
+{
+    std::vector<Sample> samples;
+    double trueMs = bootMs + SETUP_MS;
+    uint64_t lastSampleBoundary = 0;
+    while (trueMs < endMs)
+    {
+        syncIfDue(board, trueMs, options, rng);
+        uint64_t wallMs = (uint64_t)wallClock(board, trueMs);
+        uint64_t boundary = sampleBoundary(wallMs, lastSampleBoundary,
+                                           SENSOR_READ_INTERVAL,
+                                           DATA_SEND_INTERVAL);
+        bool sampled = boundary != 0;
+        if (sampled)
+        {
+            samples.push_back({trueMs, (double)boundary});
+            lastSampleBoundary = boundary;
+        }
+        trueMs += loopWork(samples.size(), rng, sampled);
+        uint32_t wait = msUntilBoundary((uint64_t)wallClock(board, trueMs),
+                                        SENSOR_READ_INTERVAL);
+        trueMs += wait / (1 + board.skew);
+    }
+    return samples;
+}
+
+// ============ REPORT FUNCTIONS ============
+static void collect(ScheduleStats &stats,
+                    const std::vector<std::vector<Sample>> &fleet,
+                    double startMs, double endMs)
+{
+    long firstBucket = (long)std::ceil(startMs / DATA_SEND_INTERVAL);
+    long lastBucket = (long)(endMs / DATA_SEND_INTERVAL) - 1;
+    std::vector<std::vector<int>> counts(
+        fleet.size(), std::vector<int>(lastBucket - firstBucket + 1, 0));
+
+    for (size_t b = 0; b < fleet.size(); b++)
+        for (const Sample &sample : fleet[b])
+        {
+            double error = sample.trueMs - sample.bucketMs;
+            stats.errors.push_back(std::fabs(error));
+            if (std::fabs(error) >= DATA_SEND_INTERVAL / 2)
+                stats.misbucketed++;
+            long bucket = std::lround(sample.bucketMs / DATA_SEND_INTERVAL);
+            if (bucket >= firstBucket && bucket <= lastBucket)
+                counts[b][bucket - firstBucket]++;
+        }
+
+    for (long i = 0; i <= lastBucket - firstBucket; i++)
+    {
+        bool complete = true;
+        for (size_t b = 0; b < fleet.size(); b++)
+            complete = complete && counts[b][i] == 1;
+        stats.completeBuckets += complete;
+        stats.buckets++;
+    }
+    std::sort(stats.errors.begin(), stats.errors.end());
+}
+
+static void printStats(const char *name, const ScheduleStats &stats)
+{
+    double sum = 0;
+    for (double error : stats.errors)
+        sum += error;
+    size_t n = stats.errors.size();
+    printf("%-13s %8zu %10.1f %10.1f %10.1f %11ld %9.1f%%\n", name, n,
+           n ? sum / n : 0.0, n ? stats.errors[n * 99 / 100] : 0.0,
+           n ? stats.errors[n - 1] : 0.0, stats.misbucketed,
+           stats.buckets ? 100.0 * stats.completeBuckets / stats.buckets : 0.0);
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            return false;
+        double value = atof(argv[i + 1]);
+        if (strcmp(argv[i], "--boards") == 0)
+            options.boards = (int)value;
+        else if (strcmp(argv[i], "--hours") == 0)
+            options.hours = value;
+        else if (strcmp(argv[i], "--skew-ppm") == 0)
+            options.skewPpm = value;
+        else if (strcmp(argv[i], "--sync-minutes") == 0)
+            options.syncMinutes = value;
+        else if (strcmp(argv[i], "--sntp-error-ms") == 0)
+            options.sntpErrorMs = value;
+        else
+            return false;
+        i++;
+    }
+    return options.boards > 0 && options.hours > 0 && options.syncMinutes > 0;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr,
+                "usage: %s [--boards <n>] [--hours <n>] [--skew-ppm <ppm>]\n"
+                "       [--sync-minutes <n>] [--sntp-error-ms <ms>]\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> skew(-options.skewPpm * 1e-6,
+                                                options.skewPpm * 1e-6);
+    std::uniform_real_distribution<double> boot(0, BOOT_SPREAD_MS);
+    std::uniform_real_distribution<double> residual(-options.sntpErrorMs,
+                                                    options.sntpErrorMs);
+
+    // An arbitrary epoch-like origin keeps boundaries away from zero
+    const double originMs = 1.7e12;
+    double endMs = originMs + options.hours * 3600000;
+    std::vector<std::vector<Sample>> freeRunning;
+    std::vector<std::vector<Sample>> aligned;
+    for (int i = 0; i < options.boards; i++)
+    {
+        double bootMs = originMs + boot(rng);
+        Board board = {skew(rng), residual(rng), bootMs};
+        freeRunning.push_back(runFreeRunning(board, bootMs, endMs, rng));
+        aligned.push_back(runAligned(board, bootMs, endMs, options, rng));
+    }
+
+    double startMs = originMs + BOOT_SPREAD_MS + SETUP_MS;
+    ScheduleStats freeStats;
+    ScheduleStats alignedStats;
+    collect(freeStats, freeRunning, startMs, endMs);
+    collect(alignedStats, aligned, startMs, endMs);
+
+    printf("%d boards, %.0f h, +/-%.0f ppm, SNTP every %.0f min "
+           "(+/-%.0f ms)\n\n",
+           options.boards, options.hours, options.skewPpm,
+           options.syncMinutes, options.sntpErrorMs);
+    printf("%-13s %8s %10s %10s %10s %11s %10s\n", "schedule", "samples",
+           "mean ms", "p99 ms", "max ms", "misbucketed", "complete");
+    printStats("free-running", freeStats);
+    printStats("aligned", alignedStats);
+
+    return alignedStats.misbucketed == 0 ? 0 : 1;
+}
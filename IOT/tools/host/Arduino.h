@@ -0,0 +1,108 @@
+/*
+ * Minimal Arduino core for host builds of the sketch's headers.
+ * Time is simulated: delay() and delayMicroseconds() only advance the
+ * clock, so tools can account for blocking time without waiting.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ============ TIME FUNCTIONS ============
+extern uint64_t hostMicros;
+
+inline unsigned long micros()
+{
+    return (unsigned long)hostMicros;
+}
+
+inline unsigned long millis()
+{
+    return (unsigned long)(hostMicros / 1000);
+}
+
+inline void delayMicroseconds(unsigned int us)
+{
+    hostMicros += us;
+}
+
+inline void delay(unsigned long ms)
+{
+    hostMicros += (uint64_t)ms * 1000;
+}
+
+// ============ PRINT CLASS ============
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t value) = 0;
+
+    size_t write(const char *str)
+    {
+        size_t n = 0;
+        while (*str)
+            n += write((uint8_t)*str++);
+        return n;
+    }
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return print((long)value); }
+    size_t print(unsigned int value) { return print((unsigned long)value); }
+
+    size_t print(long value)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%ld", value);
+        return write(buffer);
+    }
+
+    size_t print(unsigned long value)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), "%lu", value);
+        return write(buffer);
+    }
+
+    // Same rounding as the Arduino core's printFloat()
+    size_t print(double value, int digits = 2)
+    {
+        if (isnan(value))
+            return write("nan");
+        if (isinf(value))
+            return write("inf");
+
+        size_t n = 0;
+        if (value < 0.0)
+        {
+            n += write((uint8_t)'-');
+            value = -value;
+        }
+        double rounding = 0.5;
+        for (int i = 0; i < digits; i++)
+            rounding /= 10.0;
+        value += rounding;
+
+        unsigned long whole = (unsigned long)value;
+        double remainder = value - (double)whole;
+        n += print(whole);
+        if (digits > 0)
+            n += write((uint8_t)'.');
+        while (digits-- > 0)
+        {
+            remainder *= 10.0;
+            unsigned int digit = (unsigned int)remainder;
+            n += write((uint8_t)('0' + digit));
+            remainder -= digit;
+        }
+        return n;
+    }
+};
+
+#endif
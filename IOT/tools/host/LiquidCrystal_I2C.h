@@ -0,0 +1,142 @@
+/*
+ * Host port of the LiquidCrystal_I2C library's wire protocol: the same
+ * PCF8574 byte sequence and the same delays, so bus and blocking time
+ * measured on the host match the device.
+ */
+
+#ifndef HOST_LIQUIDCRYSTAL_I2C_H
+#define HOST_LIQUIDCRYSTAL_I2C_H
+
+#include "Arduino.h"
+#include "Wire.h"
+
+// ============ HD44780 COMMANDS ============
+#define LCD_CLEARDISPLAY 0x01
+#define LCD_RETURNHOME 0x02
+#define LCD_ENTRYMODESET 0x04
+#define LCD_DISPLAYCONTROL 0x08
+#define LCD_FUNCTIONSET 0x20
+#define LCD_SETCGRAMADDR 0x40
+#define LCD_SETDDRAMADDR 0x80
+#define LCD_ENTRYLEFT 0x02
+#define LCD_DISPLAYON 0x04
+#define LCD_2LINE 0x08
+
+// ============ PCF8574 PINS ============
+#define LCD_BACKLIGHT 0x08
+#define LCD_NOBACKLIGHT 0x00
+#define En 0x04
+#define Rs 0x01
+
+// ============ LCD CLASS ============
+class LiquidCrystal_I2C : public Print
+{
+public:
+    LiquidCrystal_I2C(uint8_t address, uint8_t cols, uint8_t rows)
+        : address(address), cols(cols), rows(rows)
+    {
+    }
+
+    void init()
+    {
+        Wire.begin();
+        delay(50);
+        expanderWrite(backlightValue);
+        delay(1000);
+
+        // Enter 4-bit mode (HD44780 datasheet figure 24)
+        write4bits(0x03 << 4);
+        delayMicroseconds(4500);
+        write4bits(0x03 << 4);
+        delayMicroseconds(4500);
+        write4bits(0x03 << 4);
+        delayMicroseconds(150);
+        write4bits(0x02 << 4);
+
+        command(LCD_FUNCTIONSET | (rows > 1 ? LCD_2LINE : 0));
+        command(LCD_DISPLAYCONTROL | LCD_DISPLAYON);
+        clear();
+        command(LCD_ENTRYMODESET | LCD_ENTRYLEFT);
+        home();
+    }
+
+    void clear()
+    {
+        command(LCD_CLEARDISPLAY);
+        delayMicroseconds(2000);
+    }
+
+    void home()
+    {
+        command(LCD_RETURNHOME);
+        delayMicroseconds(2000);
+    }
+
+    void setCursor(uint8_t col, uint8_t row)
+    {
+        static const uint8_t rowOffsets[] = {0x00, 0x40, 0x14, 0x54};
+        if (row >= rows)
+            row = rows - 1;
+        command(LCD_SETDDRAMADDR | (col + rowOffsets[row]));
+    }
+
+    void backlight()
+    {
+        backlightValue = LCD_BACKLIGHT;
+        expanderWrite(0);
+    }
+
+    void createChar(uint8_t location, const uint8_t charmap[])
+    {
+        command(LCD_SETCGRAMADDR | ((location & 0x7) << 3));
+        for (int i = 0; i < 8; i++)
+            write(charmap[i]);
+    }
+
+    using Print::write;
+    size_t write(uint8_t value) override
+    {
+        send(value, Rs);
+        return 1;
+    }
+
+    void command(uint8_t value)
+    {
+        send(value, 0);
+    }
+
+private:
+    uint8_t address;
+    uint8_t cols;
+    uint8_t rows;
+    uint8_t backlightValue = LCD_NOBACKLIGHT;
+
+    void send(uint8_t value, uint8_t mode)
+    {
+        write4bits((value & 0xF0) | mode);
+        write4bits(((value << 4) & 0xF0) | mode);
+    }
+
+    void write4bits(uint8_t value)
+    {
+        expanderWrite(value);
+        pulseEnable(value);
+    }
+
+    void expanderWrite(uint8_t data)
+    {
+        Wire.beginTransmission(address);
+        Wire.write(data | backlightValue);
+        Wire.endTransmission();
+    }
+
+    void pulseEnable(uint8_t data)
+    {
+        expanderWrite(data | En);
+        delayMicroseconds(1);
+        expanderWrite(data & ~En);
+        delayMicroseconds(50);
+    }
+};
+
+#endif
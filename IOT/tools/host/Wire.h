@@ -0,0 +1,75 @@
+/*
+ * Host I2C bus: forwards every transaction to the attached device and
+ * accounts for its time on the wire.
+ */
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+// ============ DATA TYPES ============
+class I2cDevice
+{
+public:
+    virtual ~I2cDevice() {}
+    virtual void receive(uint8_t address, const uint8_t *data, size_t length) = 0;
+};
+
+// ============ WIRE CLASS ============
+class TwoWire
+{
+public:
+    uint32_t clock = 100000; // Wire default
+    I2cDevice *device = NULL;
+    unsigned long transactions = 0;
+    unsigned long bytes = 0;
+    double busMicros = 0;
+
+    void begin() {}
+    void setClock(uint32_t frequency) { clock = frequency; }
+
+    void beginTransmission(uint8_t address)
+    {
+        txAddress = address;
+        txLength = 0;
+    }
+
+    size_t write(uint8_t value)
+    {
+        if (txLength == sizeof(txBuffer))
+            return 0;
+        txBuffer[txLength++] = value;
+        return 1;
+    }
+
+    // START + address byte + data bytes (9 clocks each with ACK) + STOP
+    uint8_t endTransmission(bool stop = true)
+    {
+        (void)stop;
+        double micros = (2 + 9.0 * (1 + txLength)) * 1e6 / clock;
+        transactions++;
+        bytes += txLength;
+        busMicros += micros;
+        hostMicros += (uint64_t)micros;
+        if (device != NULL)
+            device->receive(txAddress, txBuffer, txLength);
+        return 0;
+    }
+
+    void resetStats()
+    {
+        transactions = 0;
+        bytes = 0;
+        busMicros = 0;
+    }
+
+private:
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[32];
+    size_t txLength = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
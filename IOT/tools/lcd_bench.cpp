@@ -0,0 +1,141 @@
+/*
+ * Renders the sketch's LCD screens (lcd_display.h) on the emulated
+ * HD44780 and reports the resulting 16x2 content, I2C transactions, bus
+ * time and total blocking time per screen. Custom glyphs show as their
+ * CGRAM slot digit. Status pages are flushed in sequence, so each page
+ * and update reports only the cells that changed on the display.
+ *
+ * Build:  g++ -O2 -std=c++17 -Ihost -o lcd_bench lcd_bench.cpp
+ * Usage:  lcd_bench
+ *
+ * Exits with status 1 when a screen writes characters the display cannot
+ * render or that fall off the visible area, or cuts a text short to fit
+ * its row.
+ */
+
+#include "host/Arduino.h"
+#include "host/LiquidCrystal_I2C.h"
+#include "host/Wire.h"
+#include "lcd_emulator.h"
+
+#include "../lcd_display.h"
+
+#define LCD_ADDRESS 0x27
+
+uint64_t hostMicros = 0;
+TwoWire Wire;
+LiquidCrystal_I2C lcd(LCD_ADDRESS, LCD_COLS, LCD_ROWS);
+LcdFrame lcdPages[LCD_PAGE_COUNT];
+LcdFrame lcdMessage;
+LcdFrame lcdShown;
+uint32_t lcdTruncations = 0;
+LcdEmulator emulator(LCD_ADDRESS);
+
+// Messages shown by setup() and connectToWiFi(); ready steps lead with
+// the check glyph (logReady)
+struct StatusMessage
+{
+    const char *text;
+    bool ready;
+};
+
+static const StatusMessage STATUS_MESSAGES[] = {
+    {"Environmental control started", false},
+    {"LCD ready", true},
+    {"DHT22 ready", true},
+    {"ADC ready", true},
+    {"Relays ready (all OFF)", true},
+    {"Buzzer ready (OFF)", true},
+    {"LED indicators ready (all OFF)", true},
+    {"Hardware init complete!", false},
+    {"Connecting WiFi", false},
+    {"WiFi connected", false},
+    {"WiFi failed", false},
+    {"System Ready", false},
+};
+
+static const DisplayStatus NORMAL_STATUS = {
+    23.5, 45.2, 1234, false, false, false, -58, 3, UPLOAD_STATUS_OK,
+    "All normal"};
+static const DisplayStatus ALARM_STATUS = {
+    -40.0, 100.0, 120, true, true, true, -83, 1, UPLOAD_STATUS_FAILED,
+    "Hot+humid, dark"};
+
+static void showPage(const DisplayStatus &status, int page)
+{
+    renderStatusPages(status);
+    showLCDPage(page);
+}
+
+static bool passed = true;
+
+// ============ REPORT FUNCTIONS ============
+static uint32_t truncationsBefore = 0;
+
+static void beginScreen()
+{
+    Wire.resetStats();
+    emulator.resetStats();
+    truncationsBefore = lcdTruncations;
+}
+
+static void endScreen(const char *name, uint64_t startMicros)
+{
+    char row0[LCD_EMULATOR_COLS + 1];
+    char row1[LCD_EMULATOR_COLS + 1];
+    emulator.rowText(0, row0);
+    emulator.rowText(1, row1);
+
+    printf("%s\n", name);
+    printf("  |%s|\n  |%s|\n", row0, row1);
+    printf("  %lu commands, %lu chars, %lu I2C transactions (%lu bytes), "
+           "bus %.0f us, blocking %llu us\n",
+           emulator.commands, emulator.characters, Wire.transactions,
+           Wire.bytes, Wire.busMicros,
+           (unsigned long long)(hostMicros - startMicros));
+    if (emulator.unsupported > 0)
+        printf("  WARNING: %lu unsupported characters (last %s)\n",
+               emulator.unsupported, emulator.lastUnsupported);
+    if (emulator.clipped > 0)
+        printf("  WARNING: %lu characters beyond column %d\n",
+               emulator.clipped, LCD_EMULATOR_COLS);
+    uint32_t truncated = lcdTruncations - truncationsBefore;
+    if (truncated > 0)
+        printf("  WARNING: %lu texts cut off to fit the screen\n",
+               (unsigned long)truncated);
+    passed = passed && emulator.unsupported == 0 && emulator.clipped == 0 &&
+             truncated == 0;
+}
+
+#define SCREEN(name, code)              \
+    do                                  \
+    {                                   \
+        uint64_t startMicros = hostMicros; \
+        beginScreen();                  \
+        code;                           \
+        endScreen(name, startMicros);   \
+    } while (0)
+
+int main()
+{
+    Wire.device = &emulator;
+
+    SCREEN("init", initLCD());
+    for (const StatusMessage &message : STATUS_MESSAGES)
+        SCREEN(message.text,
+               writeMessageOnLCD(message.text, message.ready ? GLYPH_CHECK : -1));
+
+    DisplayStatus status = NORMAL_STATUS;
+    SCREEN("readings page", showPage(status, LCD_PAGE_READINGS));
+    status.temperature = 23.6;
+    SCREEN("readings page, temperature +0.1", showPage(status, LCD_PAGE_READINGS));
+    SCREEN("readings page, unchanged", showPage(status, LCD_PAGE_READINGS));
+    SCREEN("actuators page", showPage(status, LCD_PAGE_ACTUATORS));
+    SCREEN("alarm page", showPage(status, LCD_PAGE_ALARM));
+    SCREEN("readings page (alarm)", showPage(ALARM_STATUS, LCD_PAGE_READINGS));
+    SCREEN("actuators page (alarm)", showPage(ALARM_STATUS, LCD_PAGE_ACTUATORS));
+    SCREEN("alarm page (alarm)", showPage(ALARM_STATUS, LCD_PAGE_ALARM));
+    SCREEN("sensor error", displaySensorErrorOnLCD());
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/*
+ * HD44780 character LCD behind a PCF8574 I2C backpack, decoded from the
+ * raw I2C byte stream. Keeps DDRAM/CGRAM like the controller does and
+ * flags characters the A00 character ROM cannot show as intended.
+ */
+
+#ifndef LCD_EMULATOR_H
+#define LCD_EMULATOR_H
+
+#include <string.h>
+
+#include "host/Wire.h"
+
+// PCF8574 to HD44780 wiring of the common backpack
+#define PCF_RS 0x01
+#define PCF_EN 0x04
+
+#define LCD_EMULATOR_COLS 16
+#define LCD_EMULATOR_ROWS 2
+#define LCD_DDRAM_SIZE 0x68
+
+// ============ EMULATOR CLASS ============
+class LcdEmulator : public I2cDevice
+{
+public:
+    unsigned long commands = 0;
+    unsigned long characters = 0;
+    unsigned long unsupported = 0; // Bytes the ROM renders as other glyphs
+    unsigned long clipped = 0;     // Characters written off screen
+    char lastUnsupported[64] = "";
+
+    explicit LcdEmulator(uint8_t address) : address(address)
+    {
+        memset(ddram, ' ', sizeof(ddram));
+        memset(cgram, 0, sizeof(cgram));
+    }
+
+    void receive(uint8_t target, const uint8_t *data, size_t length) override
+    {
+        if (target != address)
+            return;
+        for (size_t i = 0; i < length; i++)
+        {
+            // The controller latches D4-D7 on the falling edge of EN
+            if ((previous & PCF_EN) && !(data[i] & PCF_EN))
+                latch(previous >> 4, previous & PCF_RS);
+            previous = data[i];
+        }
+    }
+
+    // Visible character at a cell; 0-7 are CGRAM glyphs
+    uint8_t cell(int row, int col) const
+    {
+        return ddram[row * 0x40 + col];
+    }
+
+    const uint8_t *glyph(int index) const
+    {
+        return cgram + (index & 7) * 8;
+    }
+
+    // Row as text, CGRAM glyphs shown as their index digit and bytes
+    // without an ASCII look-alike in the ROM as '?'
+    void rowText(int row, char *out) const
+    {
+        for (int col = 0; col < LCD_EMULATOR_COLS; col++)
+        {
+            uint8_t c = cell(row, col);
+            if (c < 8)
+                out[col] = (char)('0' + c);
+            else if (c >= 0x80)
+                out[col] = '?';
+            else
+                out[col] = (char)c;
+        }
+        out[LCD_EMULATOR_COLS] = '\0';
+    }
+
+    void resetStats()
+    {
+        commands = 0;
+        characters = 0;
+        unsupported = 0;
+        clipped = 0;
+        lastUnsupported[0] = '\0';
+    }
+
+private:
+    uint8_t address;
+    uint8_t previous = 0;
+    bool fourBitMode = false;
+    bool highNibblePending = true;
+    uint8_t pendingByte = 0;
+    uint8_t addressCounter = 0;
+    bool cgramSelected = false;
+    uint8_t ddram[LCD_DDRAM_SIZE];
+    uint8_t cgram[64];
+
+    void latch(uint8_t nibble, bool dataRegister)
+    {
+        // Until the 4-bit function set, each latch is a full 8-bit command
+        // with the low data lines unconnected
+        if (!fourBitMode)
+        {
+            execute(nibble << 4, false);
+            return;
+        }
+        if (highNibblePending)
+        {
+            pendingByte = nibble << 4;
+            highNibblePending = false;
+            return;
+        }
+        highNibblePending = true;
+        execute(pendingByte | nibble, dataRegister);
+    }
+
+    void execute(uint8_t value, bool dataRegister)
+    {
+        if (dataRegister)
+        {
+            writeData(value);
+            return;
+        }
+
+        commands++;
+        if (value & 0x80)
+        {
+            addressCounter = value & 0x7F;
+            cgramSelected = false;
+        }
+        else if (value & 0x40)
+        {
+            addressCounter = value & 0x3F;
+            cgramSelected = true;
+        }
+        else if (value & 0x20)
+        {
+            fourBitMode = !(value & 0x10);
+        }
+        else if (value == 0x01)
+        {
+            memset(ddram, ' ', sizeof(ddram));
+            addressCounter = 0;
+            cgramSelected = false;
+        }
+        else if ((value & 0xFE) == 0x02)
+        {
+            addressCounter = 0;
+            cgramSelected = false;
+        }
+    }
+
+    void writeData(uint8_t value)
+    {
+        if (cgramSelected)
+        {
+            cgram[addressCounter & 0x3F] = value & 0x1F;
+            addressCounter = (addressCounter + 1) & 0x3F;
+            return;
+        }
+
+        characters++;
+        int col = addressCounter & 0x3F;
+        int row = addressCounter >= 0x40 ? 1 : 0;
+        if (col >= LCD_EMULATOR_COLS)
+            clipped++;
+        // A00 ROM: no glyphs above 0x7F match the sender's intent, and
+        // 0x5C, 0x7E and 0x7F are yen, right and left arrows
+        if (value >= 0x80 || value == 0x5C || value == 0x7E || value == 0x7F)
+        {
+            unsupported++;
+            snprintf(lastUnsupported, sizeof(lastUnsupported),
+                     "0x%02X at row %d col %d", value, row, col);
+        }
+        if (addressCounter < LCD_DDRAM_SIZE)
+            ddram[addressCounter] = value;
+
+        // Two-line mode: 0x00-0x27 and 0x40-0x67 wrap into each other
+        addressCounter++;
+        if (addressCounter == 0x28)
+            addressCounter = 0x40;
+        else if (addressCounter == 0x68)
+            addressCounter = 0x00;
+    }
+};
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ * Deterministic host replay of recorded sensor traces through the
+ * sketch's control rules.
+ *
+ * Build:  g++ -O2 -std=c++17 -o replay replay.cpp
+ * Usage:  replay <trace> [--timeline <file>] [--golden <file>]
+ *                [--repeat <n>]
+ *
+ * A trace is a recorder-mode serial capture (TRACE_RECORDER) or a
+ * GET /data/trace export: one "millis,temp*100,humidity*100,light" line
+ * per sample. Lines not starting with a digit are skipped.
+ *
+ * As a regression check, --golden compares the actuator timeline with a
+ * previously accepted one, and every sample is checked against the
+ * control properties below. Either failing makes the exit status 1.
+ * tools/replay_corpus.sh runs the synthetic threshold-edge and dropout
+ * traces in tools/traces against their golden timelines.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../control_logic.h"
+
+// ============ DATA TYPES ============
+struct TraceSample
+{
+    long long timestamp;
+    float temperature;
+    float humidity;
+    int lightLevel;
+};
+
+struct ActuatorStats
+{
+    const char *name;
+    long long onTime;
+    long transitions;
+};
+
+// ============ TRACE PARSING FUNCTIONS ============
+static bool parseInt(const char *&p, const char *end, long long &value)
+{
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    if (p >= end || *p < '0' || *p > '9')
+        return false;
+    value = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        value = value * 10 + (*p++ - '0');
+    if (negative)
+        value = -value;
+    return true;
+}
+
+static bool parseLine(const char *p, const char *end, TraceSample &sample)
+{
+    long long fields[4];
+    for (int i = 0; i < 4; i++)
+    {
+        if (!parseInt(p, end, fields[i]))
+            return false;
+        if (i < 3 && (p >= end || *p++ != ','))
+            return false;
+    }
+    sample.timestamp = fields[0];
+    sample.temperature = fields[1] / 100.0f;
+    sample.humidity = fields[2] / 100.0f;
+    sample.lightLevel = (int)fields[3];
+    return true;
+}
+
+static bool loadTrace(const char *path, std::vector<TraceSample> &samples)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    std::vector<char> data(size);
+    size_t read = fread(data.data(), 1, size, file);
+    fclose(file);
+
+    const char *p = data.data();
+    const char *end = p + read;
+    while (p < end)
+    {
+        const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+        if (lineEnd == NULL)
+            lineEnd = end;
+        TraceSample sample;
+        if (*p >= '0' && *p <= '9' && parseLine(p, lineEnd, sample))
+            samples.push_back(sample);
+        p = lineEnd + 1;
+    }
+    return true;
+}
+
+// ============ PROPERTY FUNCTIONS ============
+#define PROPERTY_COUNT 4
+
+static const char *const PROPERTY_NAMES[PROPERTY_COUNT] = {
+    "no alarm without low light",
+    "no alarm without heat or humidity",
+    "hotter never turns the fan off",
+    "more humid never silences the alarm",
+};
+
+// Returns a bit per violated property
+static unsigned checkProperties(const TraceSample &sample,
+                                const ControlOutputs &outputs)
+{
+    unsigned violations = 0;
+    if (outputs.buzzer && sample.lightLevel >= LIGHT_LOW)
+        violations |= 1 << 0;
+    if (outputs.buzzer && sample.temperature < TEMP_HIGH &&
+        sample.humidity < HUMIDITY_HIGH)
+        violations |= 1 << 1;
+
+    ControlOutputs hotter = evaluateControl(sample.temperature + 1.0f,
+                                            sample.humidity, sample.lightLevel);
+    if (outputs.fan && !hotter.fan)
+        violations |= 1 << 2;
+    ControlOutputs humid = evaluateControl(sample.temperature,
+                                           sample.humidity + 1.0f,
+                                           sample.lightLevel);
+    if (outputs.buzzer && !humid.buzzer)
+        violations |= 1 << 3;
+    return violations;
+}
+
+static bool readFile(const char *path, std::string &contents)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return false;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, n);
+    fclose(file);
+    return true;
+}
+
+// Reports the first differing line; returns true when both match
+static bool compareTimelines(const std::string &actual,
+                             const std::string &golden)
+{
+    size_t line = 1;
+    size_t a = 0;
+    size_t g = 0;
+    while (a < actual.size() || g < golden.size())
+    {
+        size_t aEnd = actual.find('\n', a);
+        size_t gEnd = golden.find('\n', g);
+        std::string actualLine = actual.substr(a, aEnd - a);
+        std::string goldenLine = golden.substr(g, gEnd - g);
+        if (actualLine != goldenLine)
+        {
+            printf("golden: MISMATCH at line %zu\n  expected: %s\n  actual:   %s\n",
+                   line, goldenLine.c_str(), actualLine.c_str());
+            return false;
+        }
+        a = aEnd == std::string::npos ? actual.size() : aEnd + 1;
+        g = gEnd == std::string::npos ? golden.size() : gEnd + 1;
+        line++;
+    }
+    printf("golden: match (%zu lines)\n", line - 1);
+    return true;
+}
+
+// ============ REPLAY FUNCTIONS ============
+// Runs the trace through evaluateControl(). Transitions are appended to
+// timeline (when given) as "timestamp,actuator,state".
+static void replay(const std::vector<TraceSample> &samples,
+                   ActuatorStats stats[3], std::string *timeline)
+{
+    bool previous[3] = {false, false, false};
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        const TraceSample &sample = samples[i];
+        ControlOutputs outputs = evaluateControl(sample.temperature,
+                                                 sample.humidity,
+                                                 sample.lightLevel);
+        bool state[3] = {outputs.fan, outputs.light, outputs.buzzer};
+        // A state holds until the next sample
+        long long duration = i + 1 < samples.size()
+                                 ? samples[i + 1].timestamp - sample.timestamp
+                                 : 0;
+
+        for (int a = 0; a < 3; a++)
+        {
+            if (state[a])
+                stats[a].onTime += duration;
+            if (state[a] != previous[a] || i == 0)
+            {
+                if (i > 0)
+                    stats[a].transitions++;
+                if (timeline != NULL)
+                {
+                    char line[64];
+                    int length = snprintf(line, sizeof(line), "%lld,%s,%d\n",
+                                          sample.timestamp, stats[a].name,
+                                          state[a]);
+                    timeline->append(line, length);
+                }
+                previous[a] = state[a];
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *tracePath = NULL;
+    const char *timelinePath = NULL;
+    const char *goldenPath = NULL;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--timeline") == 0 && i + 1 < argc)
+            timelinePath = argv[++i];
+        else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+            goldenPath = argv[++i];
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else
+            tracePath = argv[i];
+    }
+    if (tracePath == NULL || repeat < 1)
+    {
+        fprintf(stderr,
+                "usage: %s <trace> [--timeline <file>] [--golden <file>] "
+                "[--repeat <n>]\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::vector<TraceSample> samples;
+    if (!loadTrace(tracePath, samples))
+    {
+        fprintf(stderr, "ERROR: cannot read %s\n", tracePath);
+        return 1;
+    }
+
+    std::string golden;
+    if (goldenPath != NULL && !readFile(goldenPath, golden))
+    {
+        fprintf(stderr, "ERROR: cannot read %s\n", goldenPath);
+        return 1;
+    }
+
+    std::string timeline;
+    bool keepTimeline = timelinePath != NULL || goldenPath != NULL;
+    ActuatorStats stats[3];
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeat; r++)
+    {
+        stats[0] = {"fan", 0, 0};
+        stats[1] = {"light", 0, 0};
+        stats[2] = {"buzzer", 0, 0};
+        replay(samples, stats, r == 0 && keepTimeline ? &timeline : NULL);
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    if (timelinePath != NULL)
+    {
+        FILE *file = fopen(timelinePath, "w");
+        if (file == NULL)
+        {
+            fprintf(stderr, "ERROR: cannot write %s\n", timelinePath);
+            return 1;
+        }
+        fwrite(timeline.data(), 1, timeline.size(), file);
+        fclose(file);
+    }
+
+    // Timed separately from replay, which should only measure the rules
+    long violations[PROPERTY_COUNT] = {0};
+    for (const TraceSample &sample : samples)
+    {
+        ControlOutputs outputs = evaluateControl(sample.temperature,
+                                                 sample.humidity,
+                                                 sample.lightLevel);
+        unsigned failed = checkProperties(sample, outputs);
+        for (int p = 0; p < PROPERTY_COUNT; p++)
+            if (failed & (1u << p))
+                violations[p]++;
+    }
+
+    long long span = samples.empty()
+                         ? 0
+                         : samples.back().timestamp - samples.front().timestamp;
+    printf("samples: %zu\n", samples.size());
+    printf("span_ms: %lld\n", span);
+    for (int a = 0; a < 3; a++)
+        printf("%s: on %.1f%%, %ld transitions\n", stats[a].name,
+               span > 0 ? 100.0 * stats[a].onTime / span : 0.0,
+               stats[a].transitions);
+    double evaluations = samples.size() * (double)repeat;
+    printf("replay: %.1f Msamples/s, %.2f ns/eval\n",
+           seconds > 0 ? evaluations / seconds / 1e6 : 0.0,
+           evaluations > 0 ? seconds * 1e9 / evaluations : 0.0);
+
+    bool passed = true;
+    for (int p = 0; p < PROPERTY_COUNT; p++)
+    {
+        printf("property \"%s\": %s", PROPERTY_NAMES[p],
+               violations[p] ? "FAILED" : "ok");
+        if (violations[p])
+            printf(" (%ld samples)", violations[p]);
+        printf("\n");
+        passed = passed && violations[p] == 0;
+    }
+    if (goldenPath != NULL && !compareTimelines(timeline, golden))
+        passed = false;
+    return passed ? 0 : 1;
+}
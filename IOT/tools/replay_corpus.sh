@@ -0,0 +1,39 @@
+#!/bin/sh
+# Replays every trace in tools/traces through the control rules and
+# compares its actuator timeline with the accepted <name>.golden next to
+# it (see replay.cpp). Exits 1 when any trace differs or breaks a control
+# property.
+#
+# Usage:  tools/replay_corpus.sh [--accept]
+#
+# --accept rewrites the golden files from the current rules; review the
+# diff before committing it.
+
+set -u
+dir=$(cd "$(dirname "$0")" && pwd)
+build=$(mktemp -d)
+trap 'rm -rf "$build"' EXIT
+
+c++ -O2 -std=c++17 -o "$build/replay" "$dir/replay.cpp" || exit 1
+
+failed=0
+for trace in "$dir"/traces/*.trace; do
+    golden="${trace%.trace}.golden"
+    name=$(basename "$trace")
+    if [ "${1:-}" = "--accept" ]; then
+        "$build/replay" "$trace" --timeline "$golden" > /dev/null
+        echo "accepted $name"
+        continue
+    fi
+    if [ ! -f "$golden" ]; then
+        echo "FAIL $name: no golden file, run with --accept"
+        failed=1
+    elif output=$("$build/replay" "$trace" --golden "$golden"); then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        echo "$output" | grep -E "MISMATCH|expected|actual|FAILED"
+        failed=1
+    fi
+done
+exit $failed
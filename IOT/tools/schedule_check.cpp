@@ -0,0 +1,210 @@
+/*
+ * Host check of the schedule lookup in schedule.h against a brute-force
+ * scan, plus the cost of evaluating on events instead of every reading.
+ *
+ * Build:  g++ -O2 -std=c++17 -o schedule_check schedule_check.cpp
+ * Usage:  schedule_check [--schedules <n>] [--windows <n>]
+ *
+ * Random schedules with up to --windows windows per actuator are encoded
+ * in the backend's binary format, decoded with decodeSchedule and
+ * evaluated at every second of a day. The scheduled state and the time of
+ * the next event must match a linear scan over the minutes of the day.
+ * The exit status is 1 on any mismatch.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "../schedule.h"
+
+// Same value as TIMING CONFIGURATION in the sketch
+#define SENSOR_READ_INTERVAL 2000
+
+// ============ DATA TYPES ============
+struct Options
+{
+    int schedules = 50;
+    int windows = SCHEDULE_MAX_WINDOWS;
+};
+
+// ============ SCHEDULE GENERATION ============
+static std::vector<ScheduleWindow> randomWindows(int maxWindows,
+                                                 std::mt19937 &rng)
+{
+    std::uniform_int_distribution<int> count(0, maxWindows);
+    std::uniform_int_distribution<int> minute(0, MINUTES_PER_DAY);
+    std::vector<int> edges(count(rng) * 2);
+    for (int &edge : edges)
+        edge = minute(rng);
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::vector<ScheduleWindow> windows;
+    for (size_t i = 0; i + 1 < edges.size(); i += 2)
+        windows.push_back({(uint16_t)edges[i], (uint16_t)edges[i + 1],
+                           (rng() & 1) != 0});
+    return windows;
+}
+
+// Same layout as encodeSchedule in backend/schedule.js
+static std::vector<uint8_t> encode(int16_t utcOffset,
+                                   const std::vector<ScheduleWindow> &fan,
+                                   const std::vector<ScheduleWindow> &light)
+{
+    std::vector<uint8_t> bytes = {SCHEDULE_FORMAT_VERSION,
+                                  (uint8_t)(utcOffset >> 8), (uint8_t)utcOffset,
+                                  (uint8_t)fan.size(), (uint8_t)light.size()};
+    for (const auto *windows : {&fan, &light})
+        for (const ScheduleWindow &window : *windows)
+        {
+            uint32_t packed = (window.start << 13) | (window.end << 2) |
+                              (window.state << 1);
+            bytes.push_back(packed >> 16);
+            bytes.push_back(packed >> 8);
+            bytes.push_back(packed);
+        }
+    return bytes;
+}
+
+// ============ REFERENCE ============
+// State at minute by scanning every window, and the minutes until the
+// state or window changes by walking forward minute by minute
+static bool scanState(const std::vector<ScheduleWindow> &windows, int minute,
+                      bool &state, int &window)
+{
+    minute %= MINUTES_PER_DAY;
+    for (size_t i = 0; i < windows.size(); i++)
+        if (minute >= windows[i].start && minute < windows[i].end)
+        {
+            state = windows[i].state;
+            window = i;
+            return true;
+        }
+    window = -1;
+    return false;
+}
+
+static int scanNextEvent(const std::vector<ScheduleWindow> &windows,
+                         int minute)
+{
+    if (windows.empty())
+        return MINUTES_PER_DAY;
+    bool state;
+    int window;
+    scanState(windows, minute, state, window);
+    for (int m = minute + 1; m <= minute + MINUTES_PER_DAY; m++)
+    {
+        int next;
+        scanState(windows, m, state, next);
+        if (next != window)
+            return m - minute;
+    }
+    return MINUTES_PER_DAY;
+}
+
+static bool checkActuator(const std::vector<ScheduleWindow> &windows,
+                          const ActuatorSchedule &schedule, uint32_t dayMs)
+{
+    ActuatorOverride forced;
+    uint32_t until = evaluateActuatorSchedule(schedule, dayMs, 0, forced);
+    int minute = dayMs / MS_PER_MINUTE;
+    bool state = false;
+    int window;
+    bool active = scanState(windows, minute, state, window);
+    uint32_t expected = windows.empty()
+                            ? MS_PER_DAY
+                            : scanNextEvent(windows, minute) * MS_PER_MINUTE -
+                                  dayMs % MS_PER_MINUTE;
+    return forced.active == active && (!active || forced.state == state) &&
+           until == expected;
+}
+
+static bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            return false;
+        int value = atoi(argv[i + 1]);
+        if (strcmp(argv[i], "--schedules") == 0)
+            options.schedules = value;
+        else if (strcmp(argv[i], "--windows") == 0)
+            options.windows = value;
+        else
+            return false;
+        i++;
+    }
+    return options.schedules > 0 && options.windows >= 0 &&
+           options.windows <= SCHEDULE_MAX_WINDOWS;
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        fprintf(stderr, "usage: %s [--schedules <n>] [--windows <0-%d>]\n",
+                argv[0], SCHEDULE_MAX_WINDOWS);
+        return 2;
+    }
+
+    std::mt19937 rng(1);
+    long checks = 0;
+    long mismatches = 0;
+    long events = 0;
+    double evaluateNs = 0;
+    for (int s = 0; s < options.schedules; s++)
+    {
+        std::vector<ScheduleWindow> fan = randomWindows(options.windows, rng);
+        std::vector<ScheduleWindow> light = randomWindows(options.windows, rng);
+        std::vector<uint8_t> bytes = encode(0, fan, light);
+        Schedule schedule;
+        if (!decodeSchedule(bytes.data(), bytes.size(), schedule))
+        {
+            printf("schedule %d failed to decode\n", s);
+            return 1;
+        }
+
+        for (uint32_t dayMs = 0; dayMs < MS_PER_DAY; dayMs += 1000)
+        {
+            bool ok = checkActuator(fan, schedule.fan, dayMs) &&
+                      checkActuator(light, schedule.light, dayMs);
+            mismatches += !ok;
+            checks++;
+        }
+
+        // The sketch evaluates once per event instead of once per reading
+        Overrides overrides;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t wallMs = 0; wallMs < MS_PER_DAY;)
+        {
+            wallMs += evaluateSchedule(schedule, wallMs, 0, overrides);
+            events++;
+        }
+        auto end = std::chrono::steady_clock::now();
+        evaluateNs += std::chrono::duration<double, std::nano>(end - start)
+                          .count();
+    }
+
+    // Overlapping windows must be rejected
+    std::vector<ScheduleWindow> overlapping = {{60, 120, true},
+                                               {100, 200, false}};
+    std::vector<uint8_t> bad = encode(0, overlapping, {});
+    Schedule rejected;
+    bool rejects = !decodeSchedule(bad.data(), bad.size(), rejected);
+
+    long ticks = (long)options.schedules * (MS_PER_DAY / SENSOR_READ_INTERVAL);
+    printf("%d schedules, up to %d windows per actuator\n\n",
+           options.schedules, options.windows);
+    printf("lookups checked    %ld (%ld mismatches)\n", checks, mismatches);
+    printf("overlap rejected   %s\n", rejects ? "yes" : "NO");
+    printf("evaluations/day    %.1f on events vs %ld every reading\n",
+           (double)events / options.schedules, ticks / options.schedules);
+    printf("evaluate cost      %.0f ns host\n", evaluateNs / events);
+    return mismatches == 0 && rejects ? 0 : 1;
+}
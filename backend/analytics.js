@@ -0,0 +1,429 @@
+import { FLAGS, MEASURES, NULL_MEASURE } from "./archive.js";
+
+// Curated analytical queries over the column archive (archive.js). Every
+// query is a scan over typed-array column slices, one archived day at a
+// time, into per-group accumulators that are finished once all days are
+// in; the archive being sorted by created_at, a time range costs two
+// binary searches per day instead of a filter per row. A NULL measure
+// (NULL_MEASURE) is left out of everything computed over that measure.
+//
+// POST /analytics/query {"query": "hourly_percentiles", "params": {...}}
+// Common params: from, to (ISO timestamps, default the last 30 archived
+// days), utc_offset_minutes (for hour-of-day and day grouping).
+
+const HOUR_MS = 60 * 60 * 1000;
+const DAY_MS = 24 * HOUR_MS;
+const DEFAULT_RANGE_DAYS = 30;
+const MAX_HISTOGRAM_BINS = 1 << 20; // Per group, 4 MiB of counts
+
+function parseMeasure(name, value) {
+  if (!MEASURES.includes(value)) {
+    throw new Error(`Invalid ${name}: ${value}`);
+  }
+  return value;
+}
+
+function parseTime(name, value) {
+  if (value === undefined) {
+    return undefined;
+  }
+  const ms = Date.parse(value);
+  if (Number.isNaN(ms)) {
+    throw new Error(`Invalid ${name}: ${value}`);
+  }
+  return ms;
+}
+
+// Index of the first element of the sorted times not below ms
+function lowerBound(times, ms) {
+  let lo = 0;
+  let hi = times.length;
+  while (lo < hi) {
+    const mid = (lo + hi) >>> 1;
+    if (times[mid] < ms) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// Calls visit(start, lo, hi) for each run of rows [lo, hi) falling in the
+// same local span of spanMs (an hour or a day), start being the span's
+// local start; rows are sorted, so each run is found by binary search
+function forEachSpan(times, lo, hi, offsetMs, spanMs, visit) {
+  while (lo < hi) {
+    const local = times[lo] + offsetMs;
+    const start = local - (local % spanMs);
+    const end = Math.min(hi, lowerBound(times, start + spanMs - offsetMs));
+    visit(start, lo, end);
+    lo = end;
+  }
+}
+
+const hourOfDay = (start) => (start % DAY_MS) / HOUR_MS;
+
+// Combines the co-moments of two disjoint sets of (x, y) pairs
+function mergeMoments(a, b) {
+  if (!a) {
+    return b;
+  }
+  const n = a.n + b.n;
+  const dx = b.meanX - a.meanX;
+  const dy = b.meanY - a.meanY;
+  const weight = (a.n * b.n) / n;
+  return {
+    n,
+    meanX: a.meanX + (dx * b.n) / n,
+    meanY: a.meanY + (dy * b.n) / n,
+    cxx: a.cxx + b.cxx + dx * dx * weight,
+    cyy: a.cyy + b.cyy + dy * dy * weight,
+    cxy: a.cxy + b.cxy + dx * dy * weight,
+  };
+}
+
+// Query definitions: params(body) validates the query-specific params,
+// init(context) creates the accumulators, scan(state, columns, lo, hi)
+// folds in rows [lo, hi) of one day, finish(state) builds the result.
+// context carries the parsed params, the offset in ms and the measure
+// ranges of the days in range.
+const QUERIES = {
+  // Count, mean, min and max of a measure per local hour of day
+  hourly_profile: {
+    params: (body) => ({ metric: parseMeasure("metric", body.metric) }),
+    init: ({ params, offsetMs }) => ({
+      metric: params.metric,
+      offsetMs,
+      count: new Float64Array(24),
+      sum: new Float64Array(24),
+      min: new Int32Array(24).fill(0x7fffffff),
+      max: new Int32Array(24).fill(-0x80000000),
+    }),
+    scan: (state, columns, lo, hi) => {
+      const times = columns.created_at;
+      const values = columns[state.metric];
+      const { count, sum, min, max } = state;
+      forEachSpan(times, lo, hi, state.offsetMs, HOUR_MS, (start, from, to) => {
+        const hour = hourOfDay(start);
+        let runCount = 0;
+        let runSum = 0;
+        let runMin = min[hour];
+        let runMax = max[hour];
+        for (let i = from; i < to; i++) {
+          const value = values[i];
+          if (value === NULL_MEASURE) continue;
+          runCount++;
+          runSum += value;
+          if (value < runMin) runMin = value;
+          if (value > runMax) runMax = value;
+        }
+        count[hour] += runCount;
+        sum[hour] += runSum;
+        min[hour] = runMin;
+        max[hour] = runMax;
+      });
+    },
+    finish: ({ count, sum, min, max }) =>
+      Array.from({ length: 24 }, (_, hour) => ({
+        hour,
+        readings: count[hour],
+        mean: count[hour] ? sum[hour] / count[hour] / 100 : null,
+        min: count[hour] ? min[hour] / 100 : null,
+        max: count[hour] ? max[hour] / 100 : null,
+      })),
+  },
+
+  // Exact percentiles (percentile_disc) of a measure per local hour of
+  // day, by counting hundredths over the measure's range
+  hourly_percentiles: {
+    params: (body) => {
+      const percentiles = body.percentiles ?? [50, 95, 99];
+      if (
+        !Array.isArray(percentiles) ||
+        !percentiles.length ||
+        percentiles.some((p) => !(p >= 0 && p <= 100))
+      ) {
+        throw new Error("Invalid percentiles");
+      }
+      return { metric: parseMeasure("metric", body.metric), percentiles };
+    },
+    init: ({ params, offsetMs, ranges }) => {
+      const { min, max } = ranges[params.metric];
+      const bins = Math.max(1, max - min + 1);
+      if (bins > MAX_HISTOGRAM_BINS) {
+        throw new Error(`Range of ${params.metric} too wide to count`);
+      }
+      return {
+        ...params,
+        offsetMs,
+        min,
+        bins,
+        counts: new Uint32Array(24 * bins),
+        readings: new Float64Array(24),
+      };
+    },
+    scan: (state, columns, lo, hi) => {
+      const times = columns.created_at;
+      const values = columns[state.metric];
+      const { counts, readings, min, bins } = state;
+      forEachSpan(times, lo, hi, state.offsetMs, HOUR_MS, (start, from, to) => {
+        const hour = hourOfDay(start);
+        const base = hour * bins - min;
+        let measured = 0;
+        for (let i = from; i < to; i++) {
+          const value = values[i];
+          if (value === NULL_MEASURE) continue;
+          counts[base + value]++;
+          measured++;
+        }
+        readings[hour] += measured;
+      });
+    },
+    finish: ({ counts, readings, min, bins, percentiles }) =>
+      Array.from({ length: 24 }, (_, hour) => {
+        const result = { hour, readings: readings[hour] };
+        const targets = percentiles
+          .map((p) => ({ p, target: (p / 100) * readings[hour] }))
+          .sort((a, b) => a.target - b.target);
+        let next = 0;
+        let seen = 0;
+        for (let bin = 0; bin < bins && next < targets.length; bin++) {
+          const count = counts[hour * bins + bin];
+          seen += count;
+          while (
+            count &&
+            next < targets.length &&
+            seen >= targets[next].target
+          ) {
+            result[`p${targets[next].p}`] = (bin + min) / 100;
+            next++;
+          }
+        }
+        for (; next < targets.length; next++) {
+          result[`p${targets[next].p}`] = null;
+        }
+        return result;
+      }),
+  },
+
+  // Pearson correlation of two measures, overall and per local day. Runs
+  // are summarized as count, means and centered co-moments, merged with
+  // Chan's update, so sums of squares never lose precision to large n.
+  correlation: {
+    params: (body) => ({
+      x: parseMeasure("x", body.x),
+      y: parseMeasure("y", body.y),
+    }),
+    init: ({ params, offsetMs }) => ({
+      ...params,
+      offsetMs,
+      days: new Map(), // Local day start -> moments
+    }),
+    scan: (state, columns, lo, hi) => {
+      const times = columns.created_at;
+      const xs = columns[state.x];
+      const ys = columns[state.y];
+      forEachSpan(times, lo, hi, state.offsetMs, DAY_MS, (day, from, to) => {
+        // Only rows with both measures present form a pair
+        let n = 0;
+        let meanX = 0;
+        let meanY = 0;
+        for (let i = from; i < to; i++) {
+          if (xs[i] === NULL_MEASURE || ys[i] === NULL_MEASURE) continue;
+          n++;
+          meanX += xs[i];
+          meanY += ys[i];
+        }
+        if (!n) {
+          return;
+        }
+        meanX /= n;
+        meanY /= n;
+        let cxx = 0;
+        let cyy = 0;
+        let cxy = 0;
+        for (let i = from; i < to; i++) {
+          if (xs[i] === NULL_MEASURE || ys[i] === NULL_MEASURE) continue;
+          const dx = xs[i] - meanX;
+          const dy = ys[i] - meanY;
+          cxx += dx * dx;
+          cyy += dy * dy;
+          cxy += dx * dy;
+        }
+        const run = { n, meanX, meanY, cxx, cyy, cxy };
+        state.days.set(day, mergeMoments(state.days.get(day), run));
+      });
+    },
+    finish: ({ days }) => {
+      const pearson = ({ cxx, cyy, cxy }) =>
+        cxx > 0 && cyy > 0 ? cxy / Math.sqrt(cxx * cyy) : null;
+      let total;
+      const byDay = [...days.entries()]
+        .sort(([a], [b]) => a - b)
+        .map(([day, moments]) => {
+          total = mergeMoments(total, moments);
+          return {
+            day: new Date(day).toISOString().slice(0, 10),
+            readings: moments.n,
+            r: pearson(moments),
+          };
+        });
+      return {
+        readings: total?.n ?? 0,
+        r: total ? pearson(total) : null,
+        days: byDay,
+      };
+    },
+  },
+
+  // Per local day: count, mean, min and max of a measure over the readings
+  // that have it, and the share of all readings with the fan, light and
+  // alarm on
+  daily_summary: {
+    params: (body) => ({ metric: parseMeasure("metric", body.metric) }),
+    init: ({ params, offsetMs }) => ({
+      metric: params.metric,
+      offsetMs,
+      days: new Map(),
+    }),
+    scan: (state, columns, lo, hi) => {
+      const times = columns.created_at;
+      const values = columns[state.metric];
+      const flags = columns.flags;
+      forEachSpan(times, lo, hi, state.offsetMs, DAY_MS, (day, from, to) => {
+        const summary = state.days.get(day) ?? {
+          readings: 0,
+          measured: 0,
+          sum: 0,
+          min: Infinity,
+          max: -Infinity,
+          fan: 0,
+          light: 0,
+          alarm: 0,
+        };
+        let { measured, sum, min, max, fan, light, alarm } = summary;
+        for (let i = from; i < to; i++) {
+          const value = values[i];
+          const flag = flags[i];
+          if (value !== NULL_MEASURE) {
+            measured++;
+            sum += value;
+            if (value < min) min = value;
+            if (value > max) max = value;
+          }
+          fan += flag & FLAGS.fan;
+          light += (flag & FLAGS.light) >> 1;
+          alarm += (flag & FLAGS.alram_led) >> 2;
+        }
+        state.days.set(day, {
+          readings: summary.readings + to - from,
+          measured,
+          sum,
+          min,
+          max,
+          fan,
+          light,
+          alarm,
+        });
+      });
+    },
+    finish: ({ days }) =>
+      [...days.entries()]
+        .sort(([a], [b]) => a - b)
+        .map(([day, s]) => ({
+          day: new Date(day).toISOString().slice(0, 10),
+          readings: s.readings,
+          measured: s.measured,
+          mean: s.measured ? s.sum / s.measured / 100 : null,
+          min: s.measured ? s.min / 100 : null,
+          max: s.measured ? s.max / 100 : null,
+          fan_share: s.fan / s.readings,
+          light_share: s.light / s.readings,
+          alarm_share: s.alarm / s.readings,
+        })),
+  },
+};
+
+export const ANALYTICS_QUERIES = Object.keys(QUERIES);
+
+// Validates {query, params} into {name, params, from, to, offsetMs};
+// from and to stay undefined for the archive's extent
+export function parseAnalyticsQuery(body) {
+  const definition = QUERIES[body?.query];
+  if (!definition) {
+    throw new Error(`Unknown query: ${body?.query}`);
+  }
+  const params = body.params ?? {};
+  const utcOffset = params.utc_offset_minutes ?? 0;
+  if (!Number.isInteger(utcOffset) || Math.abs(utcOffset) > 14 * 60) {
+    throw new Error("Invalid utc_offset_minutes");
+  }
+  const from = parseTime("from", params.from);
+  const to = parseTime("to", params.to);
+  if (from !== undefined && to !== undefined && from >= to) {
+    throw new Error("from must be before to");
+  }
+  return {
+    name: body.query,
+    params: definition.params(params),
+    from,
+    to,
+    offsetMs: utcOffset * 60 * 1000,
+  };
+}
+
+export function createAnalytics({ archive }) {
+  async function run({ name, params, from, to, offsetMs }) {
+    const definition = QUERIES[name];
+    const { last_day: lastDay } = archive.stats();
+    if (!lastDay) {
+      return { from: null, to: null, rows_scanned: 0, result: null };
+    }
+    to ??= Date.parse(`${lastDay}T00:00:00Z`) + DAY_MS;
+    from ??= to - DEFAULT_RANGE_DAYS * DAY_MS;
+    const days = archive.daysBetween(from, to);
+
+    const ranges = {};
+    for (const measure of MEASURES) {
+      ranges[measure] = { min: Infinity, max: -Infinity };
+    }
+    for (const day of days) {
+      const header = await archive.header(day);
+      if (!header.rows) {
+        continue;
+      }
+      for (const measure of MEASURES) {
+        const range = header.ranges[measure];
+        if (range.min === null) {
+          continue;
+        }
+        ranges[measure].min = Math.min(ranges[measure].min, range.min);
+        ranges[measure].max = Math.max(ranges[measure].max, range.max);
+      }
+    }
+    for (const range of Object.values(ranges)) {
+      if (range.min > range.max) {
+        range.min = range.max = 0;
+      }
+    }
+
+    const state = definition.init({ params, offsetMs, ranges });
+    let scanned = 0;
+    for (const day of days) {
+      const { columns } = await archive.partition(day);
+      const lo = lowerBound(columns.created_at, from);
+      const hi = lowerBound(columns.created_at, to);
+      definition.scan(state, columns, lo, hi);
+      scanned += hi - lo;
+    }
+    return {
+      from: new Date(from).toISOString(),
+      to: new Date(to).toISOString(),
+      rows_scanned: scanned,
+      result: definition.finish(state),
+    };
+  }
+
+  return { run };
+}
@@ -0,0 +1,345 @@
+import {
+  mkdir,
+  open,
+  readdir,
+  readFile,
+  rename,
+  writeFile,
+} from "node:fs/promises";
+import { join } from "node:path";
+
+// Columnar archive of closed days of `data` for analytical queries (see
+// analytics.js). Each UTC day, once it is older than graceMs, is exported
+// once into <dir>/<YYYY-MM-DD>.col, sorted by created_at:
+//
+//   "IOTCOL2\n", uint32 LE header length, JSON header, padding to 8 bytes,
+//   then one little-endian column per ARCHIVE_COLUMNS entry, 8-aligned
+//
+// Measures are stored as integer hundredths, the exact value of a
+// numeric(5,2), so scans run over typed arrays without parsing and
+// percentiles can be computed exactly by counting. A NULL measure is
+// stored as NULL_MEASURE, outside any numeric(5,2), and every query skips
+// it for that measure. IOTCOL1 files, written before NULLs were kept, are
+// still read but hold 0 for them. Rows arriving for a day after it was
+// archived are not added; delete the file to rebuild it.
+
+const MAGIC = Buffer.from("IOTCOL2\n", "latin1");
+const MAGIC_V1 = Buffer.from("IOTCOL1\n", "latin1");
+const DAY_MS = 24 * 60 * 60 * 1000;
+const EXPORT_PAGE_ROWS = 50000;
+
+export const MEASURES = ["temperature", "humidity", "light_intensity"];
+
+// Stored for a NULL measure
+export const NULL_MEASURE = -0x80000000;
+
+// Flag bits of the flags column
+export const FLAGS = { fan: 1, light: 2, alram_led: 4 };
+
+export const ARCHIVE_COLUMNS = {
+  created_at: Float64Array, // Epoch ms
+  temperature: Int32Array,
+  humidity: Int32Array,
+  light_intensity: Int32Array,
+  flags: Uint8Array,
+};
+
+const align8 = (offset) => (offset + 7) & ~7;
+
+export const dayKey = (ms) => new Date(ms).toISOString().slice(0, 10);
+
+// Empty columns for a partition of rows rows
+export function allocatePartition(rows) {
+  return Object.fromEntries(
+    Object.entries(ARCHIVE_COLUMNS).map(([name, Type]) => [
+      name,
+      new Type(rows),
+    ])
+  );
+}
+
+// Per-measure min and max of the non-NULL values (both null when there
+// are none), kept in the header so a query can size its histograms
+// without scanning
+function measureRanges(columns) {
+  const ranges = {};
+  for (const name of MEASURES) {
+    const values = columns[name];
+    let min = Infinity;
+    let max = -Infinity;
+    for (let i = 0; i < values.length; i++) {
+      const value = values[i];
+      if (value === NULL_MEASURE) continue;
+      if (value < min) min = value;
+      if (value > max) max = value;
+    }
+    ranges[name] = min > max ? { min: null, max: null } : { min, max };
+  }
+  return ranges;
+}
+
+export async function writePartition(dir, day, columns) {
+  const rows = columns.created_at.length;
+  const layout = {};
+  let offset = 0;
+  for (const name of Object.keys(ARCHIVE_COLUMNS)) {
+    layout[name] = { offset, length: columns[name].byteLength };
+    offset = align8(offset + columns[name].byteLength);
+  }
+  const header = Buffer.from(
+    JSON.stringify({
+      day,
+      rows,
+      columns: layout,
+      ranges: measureRanges(columns),
+    })
+  );
+  const dataStart = align8(MAGIC.length + 4 + header.length);
+  const file = Buffer.alloc(dataStart + offset);
+  MAGIC.copy(file, 0);
+  file.writeUInt32LE(header.length, MAGIC.length);
+  header.copy(file, MAGIC.length + 4);
+  for (const name of Object.keys(ARCHIVE_COLUMNS)) {
+    const column = columns[name];
+    Buffer.from(column.buffer, column.byteOffset, column.byteLength).copy(
+      file,
+      dataStart + layout[name].offset
+    );
+  }
+  const path = join(dir, `${day}.col`);
+  await writeFile(`${path}.tmp`, file);
+  await rename(`${path}.tmp`, path);
+}
+
+// Header length from the start of a file
+function headerLength(path, start) {
+  const magic = start.subarray(0, MAGIC.length);
+  if (!magic.equals(MAGIC) && !magic.equals(MAGIC_V1)) {
+    throw new Error(`${path} is not a column archive`);
+  }
+  return start.readUInt32LE(MAGIC.length);
+}
+
+// The JSON header alone, without reading the columns
+export async function readPartitionHeader(path) {
+  const file = await open(path);
+  try {
+    const start = Buffer.alloc(MAGIC.length + 4);
+    await file.read(start, 0, start.length, 0);
+    const header = Buffer.alloc(headerLength(path, start));
+    await file.read(header, 0, header.length, start.length);
+    const { day, rows, ranges } = JSON.parse(header.toString("utf8"));
+    return { day, rows, ranges };
+  } finally {
+    await file.close();
+  }
+}
+
+export async function readPartition(path) {
+  let file = await readFile(path);
+  if (file.byteOffset % 8) {
+    file = Buffer.from(file); // Typed array views need aligned offsets
+  }
+  const length = headerLength(path, file);
+  const header = JSON.parse(
+    file.toString("utf8", MAGIC.length + 4, MAGIC.length + 4 + length)
+  );
+  const dataStart = align8(MAGIC.length + 4 + length);
+  const columns = {};
+  for (const [name, Type] of Object.entries(ARCHIVE_COLUMNS)) {
+    columns[name] = new Type(
+      file.buffer,
+      file.byteOffset + dataStart + header.columns[name].offset,
+      header.rows
+    );
+  }
+  const { day, rows, ranges } = header;
+  return { day, rows, ranges, columns };
+}
+
+export function createArchive({
+  pool,
+  dir,
+  graceMs = 60 * 60 * 1000,
+  intervalMs = 10 * 60 * 1000,
+  cacheRows = 50000000,
+}) {
+  let timer = null;
+  let archiving = false;
+  let days = []; // Archived days, ascending
+  const headers = new Map(); // Day -> {rows, ranges}
+  const cache = new Map(); // Day -> partition, least recently used first
+  let cachedRows = 0;
+
+  async function load() {
+    await mkdir(dir, { recursive: true });
+    days = (await readdir(dir))
+      .filter((name) => name.endsWith(".col"))
+      .map((name) => name.slice(0, -4))
+      .sort();
+  }
+
+  // Exports one day page by page on (created_at, id). The cursor is the
+  // timestamp as text: a JS Date keeps milliseconds only, and rows written
+  // by now() have microseconds, so a Date cursor would return the last
+  // row of a page (and its millisecond's neighbours) again.
+  async function exportDay(day) {
+    const start = Date.parse(`${day}T00:00:00Z`);
+    const pages = [];
+    let after = [new Date(start - 1), "00000000-0000-0000-0000-000000000000"];
+    for (;;) {
+      const { rows } = await pool.query({
+        name: "archive-page",
+        text: `SELECT id, created_at, created_at::text AS cursor,
+                      temperature, humidity, light_intensity,
+                      fan, light, alram_led
+                 FROM data
+                WHERE created_at >= $1 AND created_at < $2
+                  AND (created_at, id) > ($3::timestamptz, $4)
+                ORDER BY created_at, id
+                LIMIT $5`,
+        values: [
+          new Date(start),
+          new Date(start + DAY_MS),
+          ...after,
+          EXPORT_PAGE_ROWS,
+        ],
+      });
+      pages.push(rows);
+      if (rows.length < EXPORT_PAGE_ROWS) {
+        break;
+      }
+      after = [rows.at(-1).cursor, rows.at(-1).id];
+    }
+    const rows = pages.flat();
+    const columns = allocatePartition(rows.length);
+    rows.forEach((row, i) => {
+      columns.created_at[i] = new Date(row.created_at).getTime();
+      for (const name of MEASURES) {
+        columns[name][i] =
+          row[name] === null
+            ? NULL_MEASURE
+            : Math.round(Number(row[name]) * 100);
+      }
+      columns.flags[i] =
+        (row.fan ? FLAGS.fan : 0) |
+        (row.light ? FLAGS.light : 0) |
+        (row.alram_led ? FLAGS.alram_led : 0);
+    });
+    await writePartition(dir, day, columns);
+    return rows.length;
+  }
+
+  // Archives every closed day after the last archived one
+  async function archiveClosed(now = Date.now()) {
+    if (archiving) {
+      return 0;
+    }
+    archiving = true;
+    try {
+      let next;
+      if (days.length) {
+        next = Date.parse(`${days.at(-1)}T00:00:00Z`) + DAY_MS;
+      } else {
+        const { rows } = await pool.query(
+          "SELECT min(created_at) AS oldest FROM data"
+        );
+        if (!rows[0].oldest) {
+          return 0;
+        }
+        const oldest = new Date(rows[0].oldest).getTime();
+        next = oldest - (oldest % DAY_MS);
+      }
+      let archived = 0;
+      for (; next + DAY_MS <= now - graceMs; next += DAY_MS) {
+        const day = dayKey(next);
+        const rows = await exportDay(day);
+        days.push(day);
+        archived += rows;
+        console.log(`Archived ${day}: ${rows} rows`);
+      }
+      return archived;
+    } finally {
+      archiving = false;
+    }
+  }
+
+  async function partition(day) {
+    let part = cache.get(day);
+    if (part) {
+      cache.delete(day); // Re-inserted as most recently used
+    } else {
+      part = await readPartition(join(dir, `${day}.col`));
+      headers.set(day, { rows: part.rows, ranges: part.ranges });
+      cachedRows += part.rows;
+    }
+    cache.set(day, part);
+    for (const [oldest, evicted] of cache) {
+      if (cachedRows <= cacheRows || oldest === day) {
+        break;
+      }
+      cache.delete(oldest);
+      cachedRows -= evicted.rows;
+    }
+    return part;
+  }
+
+  // Archived days overlapping [from, to)
+  function daysBetween(from, to) {
+    return days.filter((day) => {
+      const start = Date.parse(`${day}T00:00:00Z`);
+      return start < to && start + DAY_MS > from;
+    });
+  }
+
+  // Row count and measure ranges of a day, read from the file's header
+  // only, so sizing a query does not load partitions it then evicts
+  async function header(day) {
+    if (!headers.has(day)) {
+      const { rows, ranges } = await readPartitionHeader(
+        join(dir, `${day}.col`)
+      );
+      headers.set(day, { rows, ranges });
+    }
+    return headers.get(day);
+  }
+
+  async function start() {
+    await load();
+    archiveClosed().catch((err) => {
+      console.log(`Archive failed: ${err.message}`);
+    });
+    timer = setInterval(() => {
+      archiveClosed().catch((err) => {
+        console.log(`Archive failed: ${err.message}`);
+      });
+    }, intervalMs);
+    timer.unref();
+  }
+
+  function stop() {
+    clearInterval(timer);
+    timer = null;
+  }
+
+  function stats() {
+    return {
+      days: days.length,
+      first_day: days[0] ?? null,
+      last_day: days.at(-1) ?? null,
+      cached_days: cache.size,
+      cached_rows: cachedRows,
+    };
+  }
+
+  return {
+    start,
+    stop,
+    load,
+    archiveClosed,
+    partition,
+    daysBetween,
+    header,
+    stats,
+  };
+}
@@ -0,0 +1,112 @@
+// Ingest backpressure: how loaded the write path is, and the upload rate
+// hints devices get back while it is overloaded. Load is the larger of
+// the ingest latency (moving average) over targetMs and a share of failed
+// writes; it stretches the suggested upload interval and batch size by up
+// to maxFactor. The factor follows the load up at once and back down over
+// decayMs, by default the longest interval it can ask for: devices only
+// hear of it on their next upload, and a fleet that rushes back the
+// moment the queue drains overloads ingest again. Requests in flight are
+// left out of the load, since a momentary burst would hand the same hint
+// to every device uploading in it and keep them in step. Past maxPending
+// they are turned away with a retry-after instead of queueing until they
+// time out (keep maxPending below what the writer clears within the
+// devices' HTTP timeout); the retry-after is spread over half to one
+// stretched interval so the turned-away devices do not return together.
+
+const LATENCY_WEIGHT = 0.05; // Weight of the newest ingest in the averages
+
+export function createBackpressure({
+  intervalMs = 60 * 1000,
+  batch = 6,
+  maxFactor = 4,
+  targetMs = 500,
+  maxPending = 1000,
+  decayMs = maxFactor * intervalMs,
+} = {}) {
+  let pending = 0;
+  let latencyMs = 0;
+  let errorRate = 0;
+  let factor = 1;
+  let updated = null; // Time the factor was last updated
+
+  // The stretch factor the load calls for right now
+  function load() {
+    return Math.min(
+      maxFactor,
+      Math.max(1, latencyMs / targetMs, 1 + errorRate * (maxFactor - 1))
+    );
+  }
+
+  function update(now) {
+    const target = load();
+    if (target >= factor || updated === null) {
+      factor = target;
+    } else {
+      const decay = Math.exp(-(now - updated) / decayMs);
+      factor = target + (factor - target) * decay;
+    }
+    updated = now;
+  }
+
+  // Marks the start of one ingest; returns its start time for end()
+  function begin(now = Date.now()) {
+    pending++;
+    update(now);
+    return now;
+  }
+
+  function end(started, ok, now = Date.now()) {
+    pending--;
+    latencyMs += LATENCY_WEIGHT * (now - started - latencyMs);
+    errorRate += LATENCY_WEIGHT * ((ok ? 0 : 1) - errorRate);
+    update(now);
+  }
+
+  // Times an ingest promise
+  async function track(promise) {
+    const started = begin();
+    try {
+      const result = await promise;
+      end(started, true);
+      return result;
+    } catch (err) {
+      end(started, false);
+      throw err;
+    }
+  }
+
+  // True when a new upload should be turned away
+  function saturated() {
+    return pending >= maxPending;
+  }
+
+  // Rate hints for an upload response, empty while the load is normal
+  function hints(now = Date.now()) {
+    update(now);
+    if (factor < 1.05) {
+      return {};
+    }
+    return {
+      upload_interval: Math.round(intervalMs * factor),
+      upload_batch: Math.min(Math.ceil(batch * factor), batch * maxFactor),
+    };
+  }
+
+  // Milliseconds a turned-away or failed upload should wait
+  function retryAfter(now = Date.now()) {
+    update(now);
+    return Math.round(intervalMs * factor * (0.5 + Math.random() / 2));
+  }
+
+  function stats(now = Date.now()) {
+    update(now);
+    return {
+      pending,
+      latency_ms: Math.round(latencyMs),
+      error_rate: Number(errorRate.toFixed(3)),
+      factor: Number(factor.toFixed(2)),
+    };
+  }
+
+  return { begin, end, track, saturated, hints, retryAfter, stats };
+}
@@ -0,0 +1,199 @@
+// Minimal CBOR (RFC 8949) codec for device payloads. Supports definite
+// length items only, which is all the firmware emits. The encoder covers
+// the small control blocks sent back to devices: integers, booleans,
+// arrays and maps.
+
+function decodeHalf(bits) {
+  const exponent = (bits >> 10) & 0x1f;
+  const mantissa = bits & 0x3ff;
+  const sign = bits & 0x8000 ? -1 : 1;
+  if (exponent === 0) {
+    return sign * mantissa * 2 ** -24;
+  }
+  if (exponent === 0x1f) {
+    return mantissa ? NaN : sign * Infinity;
+  }
+  return sign * (mantissa + 1024) * 2 ** (exponent - 25);
+}
+
+function readArgument(state, info) {
+  const { view } = state;
+  let value;
+  if (info < 24) {
+    return info;
+  }
+  switch (info) {
+    case 24:
+      value = view.getUint8(state.offset);
+      state.offset += 1;
+      return value;
+    case 25:
+      value = view.getUint16(state.offset);
+      state.offset += 2;
+      return value;
+    case 26:
+      value = view.getUint32(state.offset);
+      state.offset += 4;
+      return value;
+    case 27:
+      value = Number(view.getBigUint64(state.offset));
+      state.offset += 8;
+      return value;
+    default:
+      throw new Error(`Unsupported CBOR additional info: ${info}`);
+  }
+}
+
+function readItem(state) {
+  const { view, bytes } = state;
+  const initial = view.getUint8(state.offset);
+  state.offset += 1;
+  const major = initial >> 5;
+  const info = initial & 0x1f;
+
+  if (major === 7) {
+    switch (info) {
+      case 20:
+        return false;
+      case 21:
+        return true;
+      case 22:
+        return null;
+      case 23:
+        return undefined;
+      case 25: {
+        const value = decodeHalf(view.getUint16(state.offset));
+        state.offset += 2;
+        return value;
+      }
+      case 26: {
+        const value = view.getFloat32(state.offset);
+        state.offset += 4;
+        return value;
+      }
+      case 27: {
+        const value = view.getFloat64(state.offset);
+        state.offset += 8;
+        return value;
+      }
+      default:
+        throw new Error(`Unsupported CBOR simple value: ${info}`);
+    }
+  }
+
+  const argument = readArgument(state, info);
+  switch (major) {
+    case 0:
+      return argument;
+    case 1:
+      return -1 - argument;
+    case 2: {
+      const value = bytes.subarray(state.offset, state.offset + argument);
+      state.offset += argument;
+      return value;
+    }
+    case 3: {
+      const value = new TextDecoder().decode(
+        bytes.subarray(state.offset, state.offset + argument)
+      );
+      state.offset += argument;
+      return value;
+    }
+    case 4: {
+      const value = new Array(argument);
+      for (let i = 0; i < argument; i++) {
+        value[i] = readItem(state);
+      }
+      return value;
+    }
+    case 5: {
+      const value = {};
+      for (let i = 0; i < argument; i++) {
+        const key = readItem(state);
+        value[key] = readItem(state);
+      }
+      return value;
+    }
+    default:
+      // Tags (major 6) carry no meaning for sensor payloads
+      return readItem(state);
+  }
+}
+
+export function decodeCbor(bytes) {
+  const state = {
+    bytes,
+    view: new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength),
+    offset: 0,
+  };
+  const value = readItem(state);
+  if (state.offset !== bytes.length) {
+    throw new Error("Trailing bytes after CBOR item");
+  }
+  return value;
+}
+
+function writeHead(out, major, argument) {
+  if (argument < 24) {
+    out.push((major << 5) | argument);
+  } else if (argument < 0x100) {
+    out.push((major << 5) | 24, argument);
+  } else if (argument < 0x10000) {
+    out.push((major << 5) | 25, argument >> 8, argument & 0xff);
+  } else if (argument < 0x100000000) {
+    out.push(
+      (major << 5) | 26,
+      (argument >>> 24) & 0xff,
+      (argument >> 16) & 0xff,
+      (argument >> 8) & 0xff,
+      argument & 0xff
+    );
+  } else {
+    throw new Error(`CBOR argument out of range: ${argument}`);
+  }
+}
+
+function writeItem(out, value) {
+  if (typeof value === "boolean") {
+    out.push(value ? 0xf5 : 0xf4);
+  } else if (Number.isInteger(value)) {
+    if (value >= 0) {
+      writeHead(out, 0, value);
+    } else {
+      writeHead(out, 1, -1 - value);
+    }
+  } else if (typeof value === "number") {
+    // Single precision, as cborPutFloat() in the sketch
+    const bytes = Buffer.alloc(4);
+    bytes.writeFloatBE(value);
+    out.push(0xfa, ...bytes);
+  } else if (Array.isArray(value)) {
+    writeHead(out, 4, value.length);
+    for (const item of value) {
+      writeItem(out, item);
+    }
+  } else if (Buffer.isBuffer(value)) {
+    writeHead(out, 2, value.length);
+    out.push(...value);
+  } else if (value !== null && typeof value === "object") {
+    const entries = Object.entries(value);
+    writeHead(out, 5, entries.length);
+    for (const [key, item] of entries) {
+      // Integer-like keys go out as integers, as the firmware expects
+      writeItem(out, /^\d+$/.test(key) ? Number(key) : key);
+      writeItem(out, item);
+    }
+  } else if (typeof value === "string") {
+    const bytes = Buffer.from(value, "utf8");
+    writeHead(out, 3, bytes.length);
+    out.push(...bytes);
+  } else {
+    throw new Error(`Unsupported CBOR value: ${value}`);
+  }
+}
+
+export function encodeCbor(value) {
+  const out = [];
+  writeItem(out, value);
+  return Buffer.from(out);
+}
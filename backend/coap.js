@@ -0,0 +1,315 @@
+import dgram from "node:dgram";
+
+// Minimal CoAP (RFC 7252) server: POST requests only, no block-wise
+// transfer, responses piggybacked on ACKs for confirmable messages.
+// Non-confirmable requests get a non-confirmable response echoing their
+// token, so a device keeps its readings until a 2.xx arrives. The same
+// socket sends confirmable POSTs to devices (command pushes),
+// retransmitted until ACKed.
+
+const TYPE_CON = 0;
+const TYPE_ACK = 2;
+const TYPE_RST = 3;
+
+const CODE_POST = 0x02;
+const CODE_CHANGED = 0x44; // 2.04
+export const CODE_BAD_REQUEST = 0x80; // 4.00
+const CODE_NOT_FOUND = 0x84; // 4.04
+const CODE_METHOD_NOT_ALLOWED = 0x85; // 4.05
+const CODE_UNSUPPORTED_FORMAT = 0x8f; // 4.15
+const CODE_INTERNAL_ERROR = 0xa0; // 5.00
+export const CODE_SERVICE_UNAVAILABLE = 0xa3; // 5.03
+
+const TYPE_NON = 1;
+
+const OPTION_URI_PATH = 11;
+const OPTION_CONTENT_FORMAT = 12;
+const OPTION_URI_QUERY = 15;
+
+// Registered CoAP Content-Format numbers, plus 65000 from the experimental
+// range for the firmware's delta batch format
+export const CONTENT_FORMATS = {
+  50: "application/json",
+  60: "application/cbor",
+  65000: "application/vnd.envmon.delta",
+};
+
+const PAYLOAD_MARKER = 0xff;
+const EXCHANGE_LIFETIME = 247 * 1000;
+
+// Devices only read their socket once per control tick (2 s), so the
+// first retransmission waits a little longer than RFC 7252's default
+const REQUEST_ACK_TIMEOUT = 3000;
+const REQUEST_MAX_RETRANSMIT = 4;
+
+function readOptionNibble(packet, offset, nibble) {
+  if (nibble < 13) {
+    return { value: nibble, offset };
+  }
+  if (nibble === 13) {
+    return { value: packet[offset] + 13, offset: offset + 1 };
+  }
+  if (nibble === 14) {
+    return { value: packet.readUInt16BE(offset) + 269, offset: offset + 2 };
+  }
+  throw new Error("Malformed CoAP option");
+}
+
+export function parseCoapMessage(packet) {
+  if (packet.length < 4 || packet[0] >> 6 !== 1) {
+    throw new Error("Malformed CoAP header");
+  }
+  const type = (packet[0] >> 4) & 0x03;
+  const tokenLength = packet[0] & 0x0f;
+  const message = {
+    type,
+    code: packet[1],
+    messageId: packet.readUInt16BE(2),
+    token: packet.subarray(4, 4 + tokenLength),
+    uriPath: [],
+    uriQuery: {},
+    contentFormat: undefined,
+    payload: Buffer.alloc(0),
+  };
+
+  let offset = 4 + tokenLength;
+  let optionNumber = 0;
+  while (offset < packet.length) {
+    if (packet[offset] === PAYLOAD_MARKER) {
+      message.payload = packet.subarray(offset + 1);
+      break;
+    }
+    const header = packet[offset++];
+    const delta = readOptionNibble(packet, offset, header >> 4);
+    const length = readOptionNibble(packet, delta.offset, header & 0x0f);
+    optionNumber += delta.value;
+    offset = length.offset;
+    const value = packet.subarray(offset, offset + length.value);
+    offset += length.value;
+
+    if (optionNumber === OPTION_URI_PATH) {
+      message.uriPath.push(value.toString("utf8"));
+    } else if (optionNumber === OPTION_URI_QUERY) {
+      const [name, ...rest] = value.toString("utf8").split("=");
+      message.uriQuery[name] = rest.join("=");
+    } else if (optionNumber === OPTION_CONTENT_FORMAT) {
+      message.contentFormat = value.length ? value.readUIntBE(0, value.length) : 0;
+    }
+  }
+  return message;
+}
+
+function buildResponse(type, code, messageId, token, payload) {
+  const marker = payload && payload.length ? 1 : 0;
+  const packet = Buffer.alloc(
+    4 + token.length + (marker ? 1 + payload.length : 0)
+  );
+  packet[0] = (1 << 6) | (type << 4) | token.length;
+  packet[1] = code;
+  packet.writeUInt16BE(messageId, 2);
+  token.copy(packet, 4);
+  if (marker) {
+    packet[4 + token.length] = PAYLOAD_MARKER;
+    payload.copy(packet, 5 + token.length);
+  }
+  return packet;
+}
+
+function buildRequest(messageId, token, path, payload) {
+  const pathBytes = Buffer.from(path, "utf8");
+  if (pathBytes.length >= 13) {
+    throw new Error(`CoAP path too long: ${path}`);
+  }
+  return Buffer.concat([
+    Buffer.from([
+      (1 << 6) | (TYPE_CON << 4) | token.length,
+      CODE_POST,
+      messageId >> 8,
+      messageId & 0xff,
+    ]),
+    token,
+    Buffer.from([(OPTION_URI_PATH << 4) | pathBytes.length]),
+    pathBytes,
+    Buffer.from([PAYLOAD_MARKER]),
+    payload,
+  ]);
+}
+
+// routes maps a Uri-Path (e.g. "sensor-data") to
+// async (payload, contentType, query, remote) => response payload or
+// undefined. A route rejects with an error carrying coapCode (and
+// optionally a payload, e.g. when to retry) to answer with that code;
+// any other error is a 5.00. Returns { socket, request, close }, where
+// request(remote, path, payload) resolves with the ACK's response code and
+// close() stops taking requests, answers the ones being handled, then
+// closes the socket.
+export function startCoapServer({ port, routes }) {
+  const socket = dgram.createSocket("udp4");
+  // Recent exchanges, used to drop duplicates and replay ACKs
+  const exchanges = new Map();
+  // Outgoing confirmable requests waiting for their ACK, by message id
+  const outgoing = new Map();
+  let nextMessageId = Math.floor(Math.random() * 0x10000);
+  let listening = false;
+  let closing = false;
+  // Requests being handled, settled once their response is sent
+  const answering = new Set();
+
+  setInterval(() => {
+    const now = Date.now();
+    for (const [key, exchange] of exchanges) {
+      if (now - exchange.time > EXCHANGE_LIFETIME) {
+        exchanges.delete(key);
+      }
+    }
+  }, EXCHANGE_LIFETIME).unref();
+
+  function request(remote, path, payload) {
+    nextMessageId = (nextMessageId + 1) & 0xffff;
+    const messageId = nextMessageId;
+    const packet = buildRequest(messageId, Buffer.alloc(0), path, payload);
+    if (!listening) {
+      return Promise.reject(new Error("CoAP server is not listening"));
+    }
+    return new Promise((resolve, reject) => {
+      let attempts = 0;
+      let timeout = REQUEST_ACK_TIMEOUT;
+      const send = () => {
+        if (attempts++ > REQUEST_MAX_RETRANSMIT) {
+          outgoing.delete(messageId);
+          reject(new Error("CoAP request timed out"));
+          return;
+        }
+        socket.send(packet, remote.port, remote.address);
+        entry.timer = setTimeout(send, timeout);
+        timeout *= 2;
+      };
+      const entry = {
+        resolve: (code) => {
+          clearTimeout(entry.timer);
+          outgoing.delete(messageId);
+          resolve(code);
+        },
+        timer: null,
+      };
+      outgoing.set(messageId, entry);
+      send();
+    });
+  }
+
+  async function handleRequest(message, remote) {
+    if (message.code !== CODE_POST) {
+      return { code: CODE_METHOD_NOT_ALLOWED };
+    }
+    const handler = routes[message.uriPath.join("/")];
+    if (!handler) {
+      return { code: CODE_NOT_FOUND };
+    }
+    // CBOR is assumed when the Content-Format option is absent
+    const contentType = CONTENT_FORMATS[message.contentFormat ?? 60];
+    if (!contentType) {
+      return { code: CODE_UNSUPPORTED_FORMAT };
+    }
+    try {
+      const payload = await handler(
+        message.payload,
+        contentType,
+        message.uriQuery,
+        remote
+      );
+      return { code: CODE_CHANGED, payload };
+    } catch (err) {
+      if (err.coapCode) {
+        return { code: err.coapCode, payload: err.payload };
+      }
+      console.log(err);
+      return { code: CODE_INTERNAL_ERROR };
+    }
+  }
+
+  function send(packet, remote) {
+    return new Promise((resolve) => {
+      socket.send(packet, remote.port, remote.address, () => resolve());
+    });
+  }
+
+  async function answer(message, remote, exchange) {
+    const { code, payload } = await handleRequest(message, remote);
+    if (message.type === TYPE_CON) {
+      exchange.response = buildResponse(
+        TYPE_ACK,
+        code,
+        message.messageId,
+        message.token,
+        payload
+      );
+    } else {
+      nextMessageId = (nextMessageId + 1) & 0xffff;
+      exchange.response = buildResponse(
+        TYPE_NON,
+        code,
+        nextMessageId,
+        message.token,
+        payload
+      );
+    }
+    await send(exchange.response, remote);
+  }
+
+  socket.on("message", async (packet, remote) => {
+    let message;
+    try {
+      message = parseCoapMessage(packet);
+    } catch (err) {
+      console.log(err.message);
+      return;
+    }
+    if (message.type === TYPE_ACK || message.type === TYPE_RST) {
+      // An RST (code 0) rejects the request like an error code would
+      outgoing.get(message.messageId)?.resolve(message.code);
+      return;
+    }
+
+    const key = `${remote.address}:${remote.port}:${message.messageId}`;
+    const previous = exchanges.get(key);
+    if (previous) {
+      if (previous.response) {
+        socket.send(previous.response, remote.port, remote.address);
+      }
+      return;
+    }
+    if (closing) {
+      return;
+    }
+    const exchange = { time: Date.now(), response: null };
+    exchanges.set(key, exchange);
+
+    const answered = answer(message, remote, exchange);
+    answering.add(answered);
+    await answered;
+    answering.delete(answered);
+  });
+
+  socket.on("listening", () => {
+    listening = true;
+  });
+  // A bind failure (port in use) or a later socket error only takes CoAP
+  // down; without a listener it would crash the HTTP server as well
+  socket.on("error", (err) => {
+    listening = false;
+    console.log(`CoAP server on port ${port} stopped: ${err.message}`);
+    socket.close();
+  });
+
+  async function close() {
+    closing = true;
+    await Promise.all(answering);
+    if (listening) {
+      listening = false;
+      socket.close();
+    }
+  }
+
+  socket.bind(port);
+  return { socket, request, close };
+}
@@ -0,0 +1,138 @@
+// Per-device downlink command queues with at-least-once delivery. A
+// command stays queued, and is delivered again, until the device acks it
+// or it expires. Ids only grow, so a device applies each command at most
+// once by remembering the highest id it has applied, and one ack covers
+// every command up to its id.
+//
+// With a pool, ids come in blocks of ID_BLOCK from a Postgres sequence,
+// so they keep growing across backend restarts however many commands
+// were queued before one (a restart skips the rest of its block). The
+// next block is reserved while half of the current one is left; until
+// start() has reserved the first, enqueue() throws. Without a pool (the
+// tools) ids are seeded from the clock in seconds.
+
+const ID_BLOCK = 1000;
+export const COMMAND_ID_SEQUENCE = "command_ids";
+
+export function createCommandQueue({
+  pool = null,
+  ttlMs = 10 * 60 * 1000,
+} = {}) {
+  const queues = new Map();
+  const seed = Math.floor(Date.now() / 1000);
+  // Reserved [next, end) id ranges, lowest first
+  const blocks = pool ? [] : [{ next: seed + 1, end: Infinity }];
+  let reserving = null;
+  let sequenceReady = false;
+  const roundTrips = [];
+
+  function reserve() {
+    reserving ??= pool
+      .query(`SELECT nextval('${COMMAND_ID_SEQUENCE}') AS start`)
+      .then(({ rows }) => {
+        const start = Number(rows[0].start);
+        blocks.push({ next: start, end: start + ID_BLOCK });
+      })
+      .finally(() => {
+        reserving = null;
+      });
+    return reserving;
+  }
+
+  // Starts above every clock-seeded id issued before the sequence existed
+  async function start() {
+    await pool.query(
+      `CREATE SEQUENCE IF NOT EXISTS ${COMMAND_ID_SEQUENCE}
+         INCREMENT BY ${ID_BLOCK} START WITH ${seed + ID_BLOCK}`
+    );
+    sequenceReady = true;
+    await reserve();
+  }
+
+  function takeId() {
+    while (blocks.length && blocks[0].next >= blocks[0].end) {
+      blocks.shift();
+    }
+    const left = blocks.reduce((sum, block) => sum + block.end - block.next, 0);
+    if (sequenceReady && left <= ID_BLOCK / 2 && !reserving) {
+      reserve().catch((err) => {
+        console.log(`Command id reservation failed: ${err.message}`);
+      });
+    }
+    if (!blocks.length) {
+      throw new Error("No command ids reserved");
+    }
+    return blocks[0].next++;
+  }
+
+  function pending(deviceId, now = Date.now()) {
+    const queue = queues.get(deviceId) ?? [];
+    while (queue.length && now - queue[0].enqueuedAt > ttlMs) {
+      queue.shift();
+    }
+    return queue;
+  }
+
+  function enqueue(deviceId, command, now = Date.now()) {
+    const entry = { id: takeId(), ...command, enqueuedAt: now };
+    if (!queues.has(deviceId)) {
+      queues.set(deviceId, []);
+    }
+    queues.get(deviceId).push(entry);
+    return entry;
+  }
+
+  // Oldest command the device has not acked yet, or null
+  function next(deviceId, now = Date.now()) {
+    return pending(deviceId, now)[0] ?? null;
+  }
+
+  function ack(deviceId, id, now = Date.now()) {
+    const queue = queues.get(deviceId);
+    while (queue?.length && queue[0].id <= id) {
+      roundTrips.push(now - queue.shift().enqueuedAt);
+      if (roundTrips.length > 1000) {
+        roundTrips.shift();
+      }
+    }
+  }
+
+  // Enqueue-to-ack round trips of the last 1000 acked commands
+  function stats() {
+    const sorted = [...roundTrips].sort((a, b) => a - b);
+    const count = sorted.length;
+    return {
+      acked: count,
+      mean_ms: count ? sorted.reduce((a, b) => a + b, 0) / count : null,
+      p95_ms: count ? sorted[Math.floor(count * 0.95)] : null,
+      max_ms: count ? sorted[count - 1] : null,
+    };
+  }
+
+  return { start, enqueue, next, pending, ack, stats };
+}
+
+// Pushes a device's queued commands one at a time. send(deviceId, command)
+// resolves true once the device acknowledged the command; anything else
+// leaves it queued for the next upload response.
+export function createCommandPusher(queue, send) {
+  const pushing = new Set();
+  return async function push(deviceId) {
+    if (pushing.has(deviceId)) {
+      return;
+    }
+    pushing.add(deviceId);
+    try {
+      for (let command; (command = queue.next(deviceId)); ) {
+        if (!(await send(deviceId, command))) {
+          break;
+        }
+        queue.ack(deviceId, command.id);
+      }
+    } catch (err) {
+      console.log(`Command push to ${deviceId} failed: ${err.message}`);
+    } finally {
+      pushing.delete(deviceId);
+    }
+  };
+}
@@ -0,0 +1,66 @@
+import { encodeCbor } from "./cbor.js";
+
+// Control block sent to devices in CoAP responses and command pushes: a
+// CBOR map with integer keys, must match CONTROL KEYS in the sketch
+export const CONTROL_KEYS = {
+  zone_fan: 1,
+  command_id: 2,
+  command: 3,
+  command_value: 4,
+  command_duration: 5,
+  command_data: 6, // Byte string
+  upload_interval: 7, // Suggested upload interval in ms while overloaded
+  upload_batch: 8, // Samples per upload while overloaded
+  retry_after: 9, // ms before a turned-away upload is retried
+};
+
+// Downlink commands, must match COMMAND_* in the sketch. fan and light
+// force the actuator to value for duration seconds, silence holds the
+// buzzer off, clear drops every forced state, schedule replaces the
+// device's schedule with data (see schedule.js).
+export const COMMANDS = {
+  fan: 1,
+  light: 2,
+  silence: 3,
+  clear: 4,
+  schedule: 5,
+};
+
+// Control block fields for a queued command
+export function commandFields(command) {
+  const fields = {
+    command_id: command.id,
+    command: COMMANDS[command.command],
+    command_value: command.value ? 1 : 0,
+    command_duration: command.duration,
+  };
+  if (command.data) {
+    fields.command_data = command.data;
+  }
+  return fields;
+}
+
+// Same fields as one response header: id;command;value;duration, then the
+// data in hex when there is any
+export function commandHeader(command) {
+  const fields = commandFields(command);
+  return [
+    fields.command_id,
+    fields.command,
+    fields.command_value,
+    fields.command_duration,
+    ...(fields.command_data ? [fields.command_data.toString("hex")] : []),
+  ].join(";");
+}
+
+export function encodeControlBlock(control) {
+  const block = {};
+  for (const [name, value] of Object.entries(control)) {
+    const key = CONTROL_KEYS[name];
+    if (key === undefined) {
+      throw new Error(`Unknown control field: ${name}`);
+    }
+    block[key] = value;
+  }
+  return encodeCbor(block);
+}
@@ -0,0 +1,202 @@
+import { once } from "node:events";
+
+// Binary COPY of readings into `data` (PGCOPY format, see "COPY" in the
+// PostgreSQL docs). Tuples are written straight into 64 KiB chunks that
+// are handed to the socket as it drains, so a large flush never holds more
+// than a chunk of encoded rows and allocates nothing per field.
+
+const SIGNATURE = Buffer.from("PGCOPY\n\xff\r\n\0", "latin1");
+const CHUNK_SIZE = 64 * 1024;
+// timestamptz is microseconds since 2000-01-01 UTC
+const POSTGRES_EPOCH_MS = Date.UTC(2000, 0, 1);
+const NUMERIC_POS = 0x0000;
+const NUMERIC_NEG = 0x4000;
+const NUMERIC_SCALE = 2; // numeric(5,2) columns
+
+// Binary numeric: digit count, weight of the first base-10000 digit, sign,
+// display scale, then the digits. With scale 2 the fraction is always one
+// base-10000 digit.
+function writeNumeric(buffer, offset, value) {
+  const scaled = Math.round(Math.abs(value) * 10 ** NUMERIC_SCALE);
+  const digits = [];
+  for (let integer = Math.floor(scaled / 100); integer > 0; ) {
+    digits.unshift(integer % 10000);
+    integer = Math.floor(integer / 10000);
+  }
+  let weight = digits.length - 1;
+  digits.push((scaled % 100) * 100);
+  while (digits.length && digits[digits.length - 1] === 0) {
+    digits.pop();
+  }
+  if (digits.length === 0) {
+    weight = 0;
+  }
+  offset = buffer.writeInt16BE(digits.length, offset);
+  offset = buffer.writeInt16BE(weight, offset);
+  offset = buffer.writeUInt16BE(
+    value < 0 && digits.length ? NUMERIC_NEG : NUMERIC_POS,
+    offset
+  );
+  offset = buffer.writeInt16BE(NUMERIC_SCALE, offset);
+  for (const digit of digits) {
+    offset = buffer.writeUInt16BE(digit, offset);
+  }
+  return offset;
+}
+
+// Writers return the offset after the field; maxLength bounds the field
+const FIELD_WRITERS = {
+  uuid: {
+    maxLength: 16,
+    write: (buffer, offset, value) =>
+      offset + buffer.write(value.replace(/-/g, ""), offset, "hex"),
+  },
+  timestamptz: {
+    maxLength: 8,
+    write: (buffer, offset, value) => {
+      const ms = (value instanceof Date ? value : new Date(value)).getTime();
+      return buffer.writeBigInt64BE(
+        BigInt(ms - POSTGRES_EPOCH_MS) * 1000n,
+        offset
+      );
+    },
+  },
+  // Doubles need at most 78 base-10000 digits
+  numeric: {
+    maxLength: 8 + 2 * 80,
+    write: (buffer, offset, value) =>
+      writeNumeric(buffer, offset, Number(value)),
+  },
+  boolean: {
+    maxLength: 1,
+    write: (buffer, offset, value) => buffer.writeUInt8(value ? 1 : 0, offset),
+  },
+};
+
+function writeTuple(buffer, offset, row, columns, writers) {
+  offset = buffer.writeInt16BE(columns.length, offset);
+  for (let i = 0; i < columns.length; i++) {
+    const value = row[columns[i]];
+    if (value === null || value === undefined) {
+      offset = buffer.writeInt32BE(-1, offset);
+      continue;
+    }
+    const start = offset + 4;
+    const end = writers[i].write(buffer, start, value);
+    buffer.writeInt32BE(end - start, offset);
+    offset = end;
+  }
+  return offset;
+}
+
+// Header, tuples in chunks of up to CHUNK_SIZE bytes, trailer
+export function* encodeCopyBinary(rows, columns, types) {
+  const writers = columns.map((column) => FIELD_WRITERS[types[column]]);
+  const maxTuple =
+    2 + writers.reduce((sum, writer) => sum + 4 + writer.maxLength, 0);
+  let buffer = Buffer.allocUnsafe(Math.max(CHUNK_SIZE, maxTuple));
+  let offset = SIGNATURE.copy(buffer, 0);
+  offset = buffer.writeInt32BE(0, offset); // Flags
+  offset = buffer.writeInt32BE(0, offset); // Header extension length
+  for (const row of rows) {
+    if (offset + maxTuple > buffer.length) {
+      yield buffer.subarray(0, offset);
+      buffer = Buffer.allocUnsafe(buffer.length);
+      offset = 0;
+    }
+    offset = writeTuple(buffer, offset, row, columns, writers);
+  }
+  if (offset + 2 > buffer.length) {
+    yield buffer.subarray(0, offset);
+    buffer = Buffer.allocUnsafe(2);
+    offset = 0;
+  }
+  offset = buffer.writeInt16BE(-1, offset); // Trailer
+  yield buffer.subarray(0, offset);
+}
+
+// Frontend messages of the COPY sub-protocol ("Message Formats" in the
+// PostgreSQL docs): type byte, int32 length including itself, body
+const COPY_DATA = 0x64; // 'd'
+const COPY_DONE = Buffer.from([0x63, 0, 0, 0, 4]); // 'c'
+const COPY_FAIL = 0x66; // 'f'
+
+function copyMessage(type, body) {
+  const header = Buffer.allocUnsafe(5);
+  header[0] = type;
+  header.writeInt32BE(body.length + 4, 1);
+  return header;
+}
+
+// COPY ... FROM STDIN as a query object for pg's client.query(), the way
+// pg hands COPY to submittables: submit() sends the statement, the server
+// answers CopyInResponse and pg passes its connection to
+// handleCopyInResponse(), which streams the chunks as CopyData and ends
+// with CopyDone (CopyFail when encoding throws). done settles with the
+// row count from CommandComplete, or with the server's error.
+class CopyIn {
+  constructor(text, chunks) {
+    this.text = text;
+    this.chunks = chunks;
+    this.rowCount = null;
+    this.failed = false;
+    this.encodeError = null;
+    this.done = new Promise((resolve, reject) => {
+      this.resolve = resolve;
+      this.reject = reject;
+    });
+  }
+
+  submit(connection) {
+    connection.query(this.text);
+  }
+
+  async handleCopyInResponse(connection) {
+    const stream = connection.stream;
+    try {
+      for (const chunk of this.chunks) {
+        if (this.failed) {
+          return; // The server stops reading after an error
+        }
+        stream.write(copyMessage(COPY_DATA, chunk));
+        if (!stream.write(chunk)) {
+          await once(stream, "drain");
+        }
+      }
+      stream.write(COPY_DONE);
+    } catch (err) {
+      this.encodeError = err;
+      const reason = Buffer.from(`${err.message}\0`, "utf8");
+      stream.write(copyMessage(COPY_FAIL, reason));
+      stream.write(reason);
+    }
+  }
+
+  handleCommandComplete(message) {
+    this.rowCount = Number(message.text.split(" ").at(-1));
+  }
+
+  // After a CopyFail the server's error only echoes the encoder's
+  handleError(err) {
+    this.failed = true;
+    this.reject(this.encodeError ?? err);
+  }
+
+  handleReadyForQuery() {
+    this.resolve(this.rowCount);
+  }
+}
+
+export async function copyRows(pool, table, rows, columns, types) {
+  const client = await pool.connect();
+  try {
+    const copy = new CopyIn(
+      `COPY ${table} (${columns.join(", ")}) FROM STDIN (FORMAT binary)`,
+      encodeCopyBinary(rows, columns, types)
+    );
+    client.query(copy);
+    return await copy.done;
+  } finally {
+    client.release();
+  }
+}
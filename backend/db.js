@@ -0,0 +1,165 @@
+import pg from "pg";
+import { config } from "dotenv";
+import { copyRows } from "./copy.js";
+import { STAGING_TABLE } from "./staging.js";
+
+config();
+
+// Direct Postgres access for the hot paths (ingest, recent readings,
+// bucket rollups), skipping the HTTP hop of the Supabase REST client.
+// Every query is a named statement, so each pooled connection parses and
+// plans it once and then only binds parameters.
+
+// Postgres connections are shared by every backend worker process; each
+// worker's pool gets an equal share of PG_MAX_CONNECTIONS
+export const WORKERS =
+  Number(process.env.WEB_CONCURRENCY) || Number(process.env.WORKERS) || 1;
+const maxConnections = Number(process.env.PG_MAX_CONNECTIONS) || 20;
+
+export const pool = new pg.Pool({
+  connectionString: process.env.POSTGRES_URL,
+  max:
+    Number(process.env.PG_POOL_SIZE) ||
+    Math.max(2, Math.floor(maxConnections / WORKERS)),
+  // Prepared statements live with their connection, so idle connections
+  // are kept long enough to survive the gaps between upload bursts
+  idleTimeoutMillis: Number(process.env.PG_IDLE_TIMEOUT_MS) || 10 * 60 * 1000,
+  connectionTimeoutMillis: 5000,
+  // Recycled hourly so long-lived backends do not pin server memory
+  maxLifetimeSeconds: 60 * 60,
+});
+
+pool.on("error", (err) => {
+  console.log(`Postgres pool error: ${err.message}`);
+});
+
+// Optional streaming replica for dashboard reads (see reads.js), sized
+// like the primary pool; the primary itself when there is none
+export const readPool = process.env.POSTGRES_READ_URL
+  ? new pg.Pool({
+      connectionString: process.env.POSTGRES_READ_URL,
+      max: pool.options.max,
+      idleTimeoutMillis: pool.options.idleTimeoutMillis,
+      connectionTimeoutMillis: 5000,
+      maxLifetimeSeconds: 60 * 60,
+    })
+  : pool;
+
+if (readPool !== pool) {
+  readPool.on("error", (err) => {
+    console.log(`Postgres read pool error: ${err.message}`);
+  });
+}
+
+// Column order of the `data` table as written by ingest
+export const DATA_COLUMNS = [
+  "id",
+  "created_at",
+  "temperature",
+  "humidity",
+  "light_intensity",
+  "fan",
+  "fan_led",
+  "light",
+  "light_led",
+  "alram_led",
+  "buzzer",
+];
+
+export const COLUMN_TYPES = {
+  id: "uuid",
+  created_at: "timestamptz",
+  temperature: "numeric",
+  humidity: "numeric",
+  light_intensity: "numeric",
+  fan: "boolean",
+  fan_led: "boolean",
+  light: "boolean",
+  light_led: "boolean",
+  alram_led: "boolean",
+  buzzer: "boolean",
+};
+
+// One array parameter per column, so a single statement (and plan) covers
+// every batch size
+const INSERT_READINGS = {
+  name: "insert-readings",
+  text: `INSERT INTO data (${DATA_COLUMNS.join(", ")})
+         SELECT * FROM unnest(${DATA_COLUMNS.map(
+           (column, i) => `$${i + 1}::${COLUMN_TYPES[column]}[]`
+         ).join(", ")})
+         RETURNING *`,
+};
+
+const RECENT_READINGS = {
+  name: "recent-readings",
+  text: `SELECT * FROM data
+          WHERE created_at >= now() - make_interval(mins => $1)
+          ORDER BY created_at DESC
+          LIMIT $2`,
+};
+
+const READING_BUCKETS = {
+  name: "reading-buckets",
+  text: `SELECT to_timestamp(floor(extract(epoch FROM created_at) / $1) * $1)
+                  AS bucket,
+                count(*)::int AS readings,
+                avg(temperature) AS temperature,
+                max(temperature) AS max_temperature,
+                avg(humidity) AS humidity,
+                avg(light_intensity) AS light_intensity
+           FROM data
+          WHERE created_at >= now() - make_interval(mins => $2)
+          GROUP BY bucket
+          ORDER BY bucket`,
+};
+
+export async function insertReadings(rows) {
+  const values = DATA_COLUMNS.map((column) =>
+    rows.map((row) => row[column] ?? null)
+  );
+  const { rows: inserted } = await pool.query({ ...INSERT_READINGS, values });
+  return inserted;
+}
+
+// Flushes of at least this many rows are streamed with binary COPY; below
+// it the single prepared INSERT is cheaper than setting up a COPY
+export const COPY_MIN_ROWS = Number(process.env.COPY_MIN_ROWS) || 500;
+
+// With STAGING_INGEST=1, flushes of at least this many rows are bursts
+// and go to the unlogged staging table (see staging.js), once
+// enableStaging() has been called after the table was created
+export const STAGING_ENABLED = process.env.STAGING_INGEST === "1";
+export const STAGING_MIN_ROWS = Number(process.env.STAGING_MIN_ROWS) || 2000;
+let stagingReady = false;
+
+export function enableStaging() {
+  stagingReady = STAGING_ENABLED;
+}
+
+// Writes rows of any batch size; resolves with the written rows
+export async function writeRows(rows) {
+  if (rows.length < COPY_MIN_ROWS) {
+    return insertReadings(rows);
+  }
+  const table =
+    stagingReady && rows.length >= STAGING_MIN_ROWS ? STAGING_TABLE : "data";
+  await copyRows(pool, table, rows, DATA_COLUMNS, COLUMN_TYPES);
+  return rows;
+}
+
+export async function recentReadings(minutes, limit, client = pool) {
+  const { rows } = await client.query({
+    ...RECENT_READINGS,
+    values: [minutes, limit],
+  });
+  return rows;
+}
+
+export async function readingBuckets(intervalSeconds, minutes, client = pool) {
+  const { rows } = await client.query({
+    ...READING_BUCKETS,
+    values: [intervalSeconds, minutes],
+  });
+  return rows;
+}
@@ -0,0 +1,86 @@
+// Decoder for the firmware's delta+varint batch format (see DELTA BATCH
+// ENCODING FUNCTIONS in the sketch). The whole batch is decoded at once:
+// express.raw() has already buffered the body (at most its 100 kB limit,
+// a device sends a few dozen samples), and a truncated batch must be
+// rejected with a 400 before any of it is ingested.
+//
+// Version 2 adds a base time after the count: epoch seconds of the first
+// sample, whose time deltas are then aligned seconds (sampled_at). A base
+// of 0, and every version 1 batch, carries sample ages in ms (age_ms).
+
+export const DELTA_FORMAT_VERSION = 2;
+
+const FLAG_COLUMNS = [
+  [0x01, "fan"],
+  [0x02, "fan_led"],
+  [0x04, "light"],
+  [0x08, "light_led"],
+  [0x10, "alram_led"],
+  [0x20, "buzzer"],
+];
+
+function readVarint(state) {
+  let value = 0;
+  let shift = 0;
+  for (;;) {
+    if (state.offset >= state.bytes.length) {
+      throw new Error("Truncated delta batch");
+    }
+    const byte = state.bytes[state.offset++];
+    value += (byte & 0x7f) * 2 ** shift;
+    if (byte < 0x80) {
+      return value;
+    }
+    shift += 7;
+    if (shift > 28) {
+      throw new Error("Varint too long in delta batch");
+    }
+  }
+}
+
+function readSigned(state) {
+  const value = readVarint(state);
+  return value % 2 ? -(value + 1) / 2 : value / 2;
+}
+
+export function decodeDeltaBatch(bytes) {
+  const state = { bytes, offset: 0 };
+  const version = bytes[state.offset++];
+  if (version !== 1 && version !== DELTA_FORMAT_VERSION) {
+    throw new Error(`Unsupported delta batch version: ${version}`);
+  }
+
+  const count = readVarint(state);
+  const baseTime = version >= 2 ? readVarint(state) : 0;
+  let time = 0;
+  let temperature = 0;
+  let humidity = 0;
+  let light = 0;
+  const readings = [];
+  for (let i = 0; i < count; i++) {
+    time += readSigned(state);
+    temperature += readSigned(state);
+    humidity += readSigned(state);
+    light += readSigned(state);
+    if (state.offset >= bytes.length) {
+      throw new Error("Truncated delta batch");
+    }
+    const flags = bytes[state.offset++];
+
+    const reading = {
+      temperature: temperature / 100,
+      humidity: humidity / 100,
+      light_intensity: light,
+    };
+    if (baseTime) {
+      reading.sampled_at = baseTime + time;
+    } else {
+      reading.age_ms = time;
+    }
+    for (const [mask, column] of FLAG_COLUMNS) {
+      reading[column] = (flags & mask) !== 0;
+    }
+    readings.push(reading);
+  }
+  return readings;
+}
@@ -0,0 +1,169 @@
+import {
+  countMinAdd,
+  countMinCells,
+  countMinCombine,
+  countMinEstimate,
+  createCountMin,
+  createTopK,
+  topKEntries,
+  topKOffer,
+  topKRescore,
+} from "./heavyhitters.js";
+import {
+  createHll,
+  hash32,
+  hllAddHash,
+  hllClear,
+  hllEstimate,
+  hllUnion,
+} from "./hll.js";
+
+// Fleet-wide operational counters over a sliding window, maintained on
+// ingest in memory independent of the fleet size: distinct devices that
+// reported and that raised an alarm (HyperLogLog), and the devices that
+// upload or alarm the most (count-min for counts, a top-k heap of the
+// largest window estimates for candidates). The window is a ring of
+// slots; each slot keeps its own HyperLogLogs and count-min tables, and
+// the window's are kept merged as readings arrive and when a slot
+// expires, so summary() reads them in constant time.
+
+const TRACKED = ["readings", "alarms"];
+
+export function createFleetSummary({
+  windowMinutes = 60,
+  slotMinutes = 5,
+  precision = 14,
+  width = 8192,
+  depth = 4,
+  candidates = 100,
+  topK = 10,
+} = {}) {
+  const slotMs = slotMinutes * 60 * 1000;
+  const slotCount = Math.ceil(windowMinutes / slotMinutes);
+
+  function createSlot() {
+    const slot = {
+      index: null,
+      reporting: createHll(precision),
+      alarming: createHll(precision),
+      totals: { readings: 0, alarms: 0 },
+    };
+    for (const name of TRACKED) {
+      slot[name] = createCountMin(width, depth);
+    }
+    return slot;
+  }
+
+  const slots = Array.from({ length: slotCount }, createSlot);
+  const window = {
+    reporting: createHll(precision),
+    alarming: createHll(precision),
+    totals: { readings: 0, alarms: 0 },
+    readings: createCountMin(width, depth),
+    alarms: createCountMin(width, depth),
+  };
+  const leaders = {
+    readings: createTopK(candidates),
+    alarms: createTopK(candidates),
+  };
+  let current = null; // Index of the newest slot
+
+  // Expires the slots that fell out of the window ending at now
+  function advance(now) {
+    const index = Math.floor(now / slotMs);
+    if (current !== null && index <= current) {
+      return;
+    }
+    let expired = false;
+    for (const slot of slots) {
+      if (slot.index === null || slot.index > index - slotCount) {
+        continue;
+      }
+      for (const name of TRACKED) {
+        countMinCombine(window[name], slot[name], -1);
+        slot[name].table.fill(0);
+        window.totals[name] -= slot.totals[name];
+        slot.totals[name] = 0;
+      }
+      hllClear(slot.reporting);
+      hllClear(slot.alarming);
+      slot.index = null;
+      expired = true;
+    }
+    if (expired) {
+      const live = slots.filter((slot) => slot.index !== null);
+      hllUnion(window.reporting, live.map((slot) => slot.reporting));
+      hllUnion(window.alarming, live.map((slot) => slot.alarming));
+      for (const name of TRACKED) {
+        topKRescore(leaders[name], (device) =>
+          countMinEstimate(window[name], countMinCells(window[name], device))
+        );
+      }
+    }
+    current = index;
+    slots[index % slotCount].index = index;
+  }
+
+  // Counts one upload; rows as written by ingest
+  function record(deviceId, rows, now = Date.now()) {
+    advance(now);
+    if (!deviceId) {
+      return;
+    }
+    const slot = slots[current % slotCount];
+    const alarms = rows.filter((row) => row.alram_led).length;
+    const hash = hash32(deviceId);
+    hllAddHash(slot.reporting, hash);
+    hllAddHash(window.reporting, hash);
+    const counts = { readings: rows.length, alarms };
+    const cells = countMinCells(window.readings, deviceId);
+    for (const name of TRACKED) {
+      if (!counts[name]) {
+        continue;
+      }
+      countMinAdd(slot[name], cells, counts[name]);
+      countMinAdd(window[name], cells, counts[name]);
+      topKOffer(
+        leaders[name],
+        deviceId,
+        countMinEstimate(window[name], cells)
+      );
+      slot.totals[name] += counts[name];
+      window.totals[name] += counts[name];
+    }
+    if (alarms) {
+      hllAddHash(slot.alarming, hash);
+      hllAddHash(window.alarming, hash);
+    }
+  }
+
+  // The topK devices by estimated window count
+  function top(name) {
+    return topKEntries(leaders[name], topK)
+      .filter(({ estimate }) => estimate > 0)
+      .map(({ key, estimate }) => ({ device: key, count: estimate }));
+  }
+
+  function summary(now = Date.now()) {
+    advance(now);
+    return {
+      window_minutes: slotCount * slotMinutes,
+      devices_reporting: Math.round(hllEstimate(window.reporting)),
+      devices_alarming: Math.round(hllEstimate(window.alarming)),
+      readings: window.totals.readings,
+      alarms: window.totals.alarms,
+      top_reporting: top("readings"),
+      top_alarming: top("alarms"),
+    };
+  }
+
+  // Bytes held by the summaries, fixed at construction apart from the
+  // candidate keys
+  function memoryBytes() {
+    const hllBytes = 1 << precision;
+    const countMinBytes = width * depth * 4;
+    return (slotCount + 1) * (2 * hllBytes + TRACKED.length * countMinBytes);
+  }
+
+  return { record, summary, memoryBytes };
+}
@@ -0,0 +1,136 @@
+import { hash32 } from "./hll.js";
+
+// Heavy-hitter summaries: a count-min sketch (Cormode and Muthukrishnan)
+// for per-key counts that never underestimate, and a bounded min-heap of
+// the keys with the largest estimates. Count-min tables are linear, so a
+// sliding window is kept by adding each slot's table into a window table
+// and subtracting it again when the slot expires; tables of the same
+// shape share cell positions, so a key is hashed once per update.
+
+export function createCountMin(width = 8192, depth = 4) {
+  return { width, depth, table: new Uint32Array(width * depth) };
+}
+
+// Cell of each row by double hashing: h1 + i * h2
+export function countMinCells(sketch, key) {
+  const h1 = hash32(key, 0x9747b28c);
+  const h2 = hash32(key, 0x5bd1e995) | 1;
+  const cells = new Array(sketch.depth);
+  for (let row = 0; row < sketch.depth; row++) {
+    const column = ((h1 + Math.imul(row, h2)) >>> 0) % sketch.width;
+    cells[row] = row * sketch.width + column;
+  }
+  return cells;
+}
+
+export function countMinAdd(sketch, cells, count = 1) {
+  for (const cell of cells) {
+    sketch.table[cell] += count;
+  }
+}
+
+export function countMinEstimate(sketch, cells) {
+  let estimate = Infinity;
+  for (const cell of cells) {
+    estimate = Math.min(estimate, sketch.table[cell]);
+  }
+  return estimate;
+}
+
+// into += sign * from, cell by cell
+export function countMinCombine(into, from, sign = 1) {
+  for (let i = 0; i < into.table.length; i++) {
+    into.table[i] += sign * from.table[i];
+  }
+}
+
+// The capacity keys with the largest estimates seen, in a binary min-heap
+// so a key that beats the smallest replaces it in O(log capacity)
+export function createTopK(capacity = 100) {
+  return { capacity, heap: [], positions: new Map() };
+}
+
+function swap(topK, i, j) {
+  const { heap, positions } = topK;
+  [heap[i], heap[j]] = [heap[j], heap[i]];
+  positions.set(heap[i].key, i);
+  positions.set(heap[j].key, j);
+}
+
+function siftUp(topK, i) {
+  const { heap } = topK;
+  while (i > 0) {
+    const parent = (i - 1) >> 1;
+    if (heap[parent].estimate <= heap[i].estimate) {
+      return;
+    }
+    swap(topK, i, parent);
+    i = parent;
+  }
+}
+
+function siftDown(topK, i) {
+  const { heap } = topK;
+  for (;;) {
+    let smallest = i;
+    for (const child of [2 * i + 1, 2 * i + 2]) {
+      if (
+        child < heap.length &&
+        heap[child].estimate < heap[smallest].estimate
+      ) {
+        smallest = child;
+      }
+    }
+    if (smallest === i) {
+      return;
+    }
+    swap(topK, i, smallest);
+    i = smallest;
+  }
+}
+
+export function topKOffer(topK, key, estimate) {
+  const { heap, positions } = topK;
+  const position = positions.get(key);
+  if (position !== undefined) {
+    const previous = heap[position].estimate;
+    heap[position].estimate = estimate;
+    if (estimate < previous) {
+      siftUp(topK, position);
+    } else {
+      siftDown(topK, position);
+    }
+    return;
+  }
+  if (heap.length < topK.capacity) {
+    heap.push({ key, estimate });
+    positions.set(key, heap.length - 1);
+    siftUp(topK, heap.length - 1);
+    return;
+  }
+  if (estimate <= heap[0].estimate) {
+    return;
+  }
+  positions.delete(heap[0].key);
+  heap[0] = { key, estimate };
+  positions.set(key, 0);
+  siftDown(topK, 0);
+}
+
+// Re-estimates every held key, e.g. after counts were taken out of the
+// sketch behind the estimates
+export function topKRescore(topK, estimate) {
+  const { heap, positions } = topK;
+  for (const entry of heap) {
+    entry.estimate = estimate(entry.key);
+  }
+  heap.sort((a, b) => a.estimate - b.estimate);
+  heap.forEach((entry, i) => positions.set(entry.key, i));
+}
+
+export function topKEntries(topK, limit = topK.capacity) {
+  return topK.heap
+    .slice()
+    .sort((a, b) => b.estimate - a.estimate)
+    .slice(0, limit);
+}
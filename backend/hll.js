@@ -0,0 +1,118 @@
+// Hashing and HyperLogLog (Flajolet et al.) for distinct-device counts.
+// A histogram of register values is kept up to date as registers change,
+// so an estimate reads the 32 - precision + 2 histogram entries instead of
+// the 2^precision registers.
+
+// 32-bit MurmurHash3 of a string's UTF-16 code units
+export function hash32(key, seed = 0) {
+  let h = seed >>> 0;
+  for (let i = 0; i < key.length; i++) {
+    let k = Math.imul(key.charCodeAt(i), 0xcc9e2d51);
+    k = (k << 15) | (k >>> 17);
+    h ^= Math.imul(k, 0x1b873593);
+    h = (h << 13) | (h >>> 19);
+    h = (Math.imul(h, 5) + 0xe6546b64) | 0;
+  }
+  h ^= key.length;
+  h ^= h >>> 16;
+  h = Math.imul(h, 0x85ebca6b);
+  h ^= h >>> 13;
+  h = Math.imul(h, 0xc2b2ae35);
+  h ^= h >>> 16;
+  return h >>> 0;
+}
+
+export function createHll(precision = 14) {
+  const m = 1 << precision;
+  const histogram = new Float64Array(32 - precision + 2); // By rank
+  histogram[0] = m;
+  return { precision, registers: new Uint8Array(m), histogram };
+}
+
+export function hllAddHash(hll, hash) {
+  const index = hash >>> (32 - hll.precision);
+  // Rank of the first set bit of the remaining bits, from 1
+  const rest = (hash << hll.precision) >>> 0;
+  const rank = rest ? Math.clz32(rest) + 1 : 32 - hll.precision + 1;
+  const old = hll.registers[index];
+  if (rank > old) {
+    hll.registers[index] = rank;
+    hll.histogram[old]--;
+    hll.histogram[rank]++;
+  }
+}
+
+export function hllAdd(hll, key) {
+  hllAddHash(hll, hash32(key));
+}
+
+function sigma(x) {
+  if (x === 1) {
+    return Infinity;
+  }
+  let y = 1;
+  let z = x;
+  for (let previous = -1; z !== previous; ) {
+    x *= x;
+    previous = z;
+    z += x * y;
+    y += y;
+  }
+  return z;
+}
+
+function tau(x) {
+  if (x === 0 || x === 1) {
+    return 0;
+  }
+  let y = 1;
+  let z = 1 - x;
+  for (let previous = -1; z !== previous; ) {
+    x = Math.sqrt(x);
+    previous = z;
+    y *= 0.5;
+    z -= (1 - x) * (1 - x) * y;
+  }
+  return z / 3;
+}
+
+// Ertl's improved raw estimator ("New cardinality estimation algorithms
+// for HyperLogLog sketches", 2017), unbiased from small to large
+// cardinalities without empirical correction tables; it only needs the
+// register histogram, so it costs O(32 - precision)
+export function hllEstimate(hll) {
+  const { histogram } = hll;
+  const m = hll.registers.length;
+  const q = 32 - hll.precision;
+  let z = m * tau(1 - histogram[q + 1] / m);
+  for (let k = q; k >= 1; k--) {
+    z = 0.5 * (z + histogram[k]);
+  }
+  z += m * sigma(histogram[0] / m);
+  return (m * m) / (2 * Math.LN2 * z);
+}
+
+export function hllClear(hll) {
+  hll.registers.fill(0);
+  hll.histogram.fill(0);
+  hll.histogram[0] = hll.registers.length;
+}
+
+// Sets into to the union (register-wise max) of sources
+export function hllUnion(into, sources) {
+  const { registers, histogram } = into;
+  registers.fill(0);
+  for (const source of sources) {
+    const other = source.registers;
+    for (let i = 0; i < registers.length; i++) {
+      if (other[i] > registers[i]) {
+        registers[i] = other[i];
+      }
+    }
+  }
+  histogram.fill(0);
+  for (let i = 0; i < registers.length; i++) {
+    histogram[registers[i]]++;
+  }
+  return into;
+}
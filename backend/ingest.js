@@ -0,0 +1,49 @@
+import { EventEmitter } from "node:events";
+import { v4 } from "uuid";
+import { writeRows } from "./db.js";
+import { createBatchWriter } from "./writer.js";
+
+// Devices with an SNTP-synced clock send sampled_at, the wall-clock aligned
+// epoch seconds of the sample, which becomes created_at as is so readings of
+// different devices fall on the same bucket boundaries. Otherwise readings
+// may carry age_ms (time since the device sampled them) when they were
+// batched; created_at is back-dated accordingly.
+function toRow(reading, now) {
+  const { age_ms: ageMs = 0, sampled_at: sampledAt, ...columns } = reading;
+  const createdAt = sampledAt ? sampledAt * 1000 : now - ageMs;
+  return {
+    id: v4(),
+    ...columns,
+    created_at: new Date(createdAt).toISOString(),
+  };
+}
+
+const writer = createBatchWriter({
+  write: writeRows,
+  maxRows: Number(process.env.INGEST_BATCH_ROWS) || 5000,
+  maxDelayMs: Number(process.env.INGEST_FLUSH_MS) || 20,
+});
+
+// Emits "rows" with every committed batch and the id of the device that
+// sent it (if known), for read models and other consumers that must not
+// query `data` on the write path
+export const ingestEvents = new EventEmitter();
+
+// Shared ingest pipeline for every transport (HTTP, CoAP)
+export async function ingestReadings(readings, deviceId) {
+  const now = Date.now();
+  const rows = readings.map((reading) => toRow(reading, now));
+  try {
+    const written = await writer.add(rows);
+    ingestEvents.emit("rows", written, deviceId);
+    return written;
+  } catch (err) {
+    console.log(err);
+    throw err;
+  }
+}
+
+// Writes every reading already accepted; for shutdown
+export function drainIngest() {
+  return writer.drain();
+}
@@ -0,0 +1,41 @@
+// Detects upload bursts (e.g. a fleet rebooting together after a power
+// outage) from per-second arrival counts and hands the devices that arrive
+// during a burst a random delay, spreading their next uploads out.
+
+export function createUploadPacer({
+  windowSeconds = 60,
+  burstFactor = 2,
+  minBurst = 10,
+  spreadMs = 30000,
+} = {}) {
+  const counts = new Uint32Array(windowSeconds);
+  let total = 0;
+  let currentSecond = Math.floor(Date.now() / 1000);
+
+  function advance(second) {
+    const elapsed = Math.min(second - currentSecond, windowSeconds);
+    for (let i = 1; i <= elapsed; i++) {
+      const slot = (currentSecond + i) % windowSeconds;
+      total -= counts[slot];
+      counts[slot] = 0;
+    }
+    currentSecond = Math.max(currentSecond, second);
+  }
+
+  // Records one upload and returns the delay hint in ms (0 for none)
+  function arrive(now = Date.now()) {
+    advance(Math.floor(now / 1000));
+    const slot = currentSecond % windowSeconds;
+    counts[slot] += 1;
+    total += 1;
+
+    const current = counts[slot];
+    const mean = (total - current) / (windowSeconds - 1);
+    if (current < minBurst || current <= burstFactor * mean) {
+      return 0;
+    }
+    return Math.floor(Math.random() * spreadMs);
+  }
+
+  return { arrive };
+}
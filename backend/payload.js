@@ -0,0 +1,116 @@
+import { decodeCbor } from "./cbor.js";
+import { decodeDeltaBatch } from "./delta.js";
+
+export const CONTENT_TYPE_JSON = "application/json";
+export const CONTENT_TYPE_CBOR = "application/cbor";
+export const CONTENT_TYPE_DELTA = "application/vnd.envmon.delta";
+
+// CBOR integer keys used by the firmware, see PAYLOAD KEYS in the sketch
+export const SENSOR_FIELD_KEYS = {
+  1: "temperature",
+  2: "humidity",
+  3: "light_intensity",
+  4: "fan",
+  5: "fan_led",
+  6: "light",
+  7: "light_led",
+  8: "alram_led",
+  9: "buzzer",
+  10: "age_ms",
+  11: "sampled_at",
+};
+
+// Maps a compact integer-keyed reading to the `data` table column names
+export function expandReading(compact) {
+  const reading = {};
+  for (const [key, value] of Object.entries(compact)) {
+    const column = SENSOR_FIELD_KEYS[key];
+    if (!column) {
+      throw new Error(`Unknown payload key: ${key}`);
+    }
+    reading[column] = value;
+  }
+  return reading;
+}
+
+// Column types of the measures
+const NUMBER_MEASURES = ["temperature", "humidity", "light_intensity"];
+const BOOLEAN_MEASURES = [
+  "fan",
+  "fan_led",
+  "light",
+  "light_led",
+  "alram_led",
+  "buzzer",
+];
+// sampled_at is only sent once the device clock is set (TIME_VALID_AFTER
+// in the sketch) and fits its uint32_t wallTime; no batch is a day old
+const MIN_SAMPLED_AT = 1700000000;
+const MAX_SAMPLED_AT = 2 ** 32 - 1;
+const MAX_AGE_MS = 24 * 60 * 60 * 1000;
+
+// Rejects a reading ingest could not write (an invalid created_at, a
+// measure of the wrong type) so the device gets a 400 instead of a 500
+// that it would retry
+function checkReading(reading) {
+  if (typeof reading !== "object" || reading === null) {
+    throw new Error("Reading is not an object");
+  }
+  const { sampled_at: sampledAt, age_ms: ageMs } = reading;
+  if (
+    sampledAt !== undefined &&
+    !(
+      Number.isInteger(sampledAt) &&
+      sampledAt >= MIN_SAMPLED_AT &&
+      sampledAt <= MAX_SAMPLED_AT
+    )
+  ) {
+    throw new Error(`Invalid sampled_at: ${sampledAt}`);
+  }
+  if (
+    ageMs !== undefined &&
+    !(typeof ageMs === "number" && ageMs >= 0 && ageMs <= MAX_AGE_MS)
+  ) {
+    throw new Error(`Invalid age_ms: ${ageMs}`);
+  }
+  for (const column of NUMBER_MEASURES) {
+    const value = reading[column];
+    if (value != null && !Number.isFinite(value)) {
+      throw new Error(`Invalid ${column}: ${value}`);
+    }
+  }
+  for (const column of BOOLEAN_MEASURES) {
+    const value = reading[column];
+    if (value != null && typeof value !== "boolean") {
+      throw new Error(`Invalid ${column}: ${value}`);
+    }
+  }
+  return reading;
+}
+
+// Devices send either a single reading or a batch
+function toReadings(value) {
+  return Array.isArray(value) ? value : [value];
+}
+
+// Decodes a request body into an array of readings, each checked before
+// it gets near the database. JSON bodies may arrive already parsed by
+// express.json().
+export function decodeSensorPayload(contentType, body) {
+  return decodeReadings(contentType, body).map(checkReading);
+}
+
+function decodeReadings(contentType, body) {
+  switch (contentType) {
+    case CONTENT_TYPE_CBOR:
+      return toReadings(decodeCbor(body)).map(expandReading);
+    case CONTENT_TYPE_DELTA:
+      return decodeDeltaBatch(body);
+    case CONTENT_TYPE_JSON:
+      return toReadings(
+        Buffer.isBuffer(body) ? JSON.parse(body.toString("utf8")) : body
+      );
+    default:
+      throw new Error(`Unsupported content type: ${contentType}`);
+  }
+}
@@ -0,0 +1,138 @@
+// Device presence: the last upload of every device, and offline/online
+// transitions when a device misses its expected interval. The expected
+// interval is learned per device (a moving average of the gaps between
+// its uploads, starting from intervalMs); a device is overdue once
+// missFactor intervals have passed without an upload.
+//
+// Deadlines are timers of a shared timer wheel (timerwheel.js) with ticks
+// of tickMs: an upload moves its device's timer in O(1), and each tick
+// only handles the timers that came due, so the cost of detection
+// follows the devices expiring, not the fleet size.
+
+import { createTimerWheel } from "./timerwheel.js";
+
+const GAP_WEIGHT = 0.2; // Weight of the newest gap in the moving average
+
+export function createPresenceTracker({
+  intervalMs = 60 * 1000,
+  missFactor = 3,
+  tickMs = 1000,
+  historyLimit = 256,
+  onTransition = () => {},
+} = {}) {
+  const devices = new Map(); // Device -> entry
+  const offline = new Set(); // Entries of the devices that went silent
+  const history = []; // Newest transitions, oldest first
+  const wheel = createTimerWheel({ tickMs });
+
+  function transition(event) {
+    history.push(event);
+    if (history.length > historyLimit) {
+      history.shift();
+    }
+    onTransition(event);
+  }
+
+  function expire(entry, now) {
+    entry.online = false;
+    offline.add(entry);
+    transition({
+      device: entry.device,
+      state: "offline",
+      last_seen: new Date(entry.lastSeen).toISOString(),
+      at: new Date(now).toISOString(),
+    });
+  }
+
+  // Processes every tick up to now
+  function advance(now = Date.now()) {
+    wheel.advance(now);
+  }
+
+  // Records an upload from a device; expectedMs is the interval it was
+  // asked to keep until its next upload, if any (see backpressure.js)
+  function seen(deviceId, now = Date.now(), expectedMs = 0) {
+    advance(now);
+    let entry = devices.get(deviceId);
+    if (!entry) {
+      entry = {
+        device: deviceId,
+        lastSeen: now,
+        intervalMs,
+        online: false,
+        timer: null,
+      };
+      devices.set(deviceId, entry);
+    } else {
+      const gap = now - entry.lastSeen;
+      if (entry.online && gap > 0) {
+        entry.intervalMs += GAP_WEIGHT * (gap - entry.intervalMs);
+      }
+      entry.lastSeen = now;
+    }
+    if (!entry.online) {
+      entry.online = true;
+      offline.delete(entry);
+      transition({
+        device: deviceId,
+        state: "online",
+        at: new Date(now).toISOString(),
+      });
+    }
+    const deadline =
+      entry.lastSeen + missFactor * Math.max(entry.intervalMs, expectedMs);
+    if (entry.timer) {
+      wheel.reschedule(entry.timer, deadline);
+    } else {
+      entry.timer = wheel.schedule(deadline, expire, entry);
+    }
+  }
+
+  function describe(entry) {
+    return {
+      device: entry.device,
+      state: entry.online ? "online" : "offline",
+      last_seen: new Date(entry.lastSeen).toISOString(),
+      expected_interval_ms: Math.round(entry.intervalMs),
+    };
+  }
+
+  // Counts and recent transitions, plus up to limit devices in state
+  // ("online", "offline" or undefined for both), the longest silent
+  // first. Listing offline devices only walks the offline set.
+  function status({ state, limit = 100 } = {}, now = Date.now()) {
+    advance(now);
+    let listed;
+    if (state === "offline") {
+      listed = [...offline];
+    } else {
+      listed = [...devices.values()];
+      if (state === "online") {
+        listed = listed.filter((entry) => entry.online);
+      }
+    }
+    listed.sort((a, b) => a.lastSeen - b.lastSeen);
+    return {
+      devices: devices.size,
+      online: devices.size - offline.size,
+      offline: offline.size,
+      listed: listed.slice(0, limit).map(describe),
+      transitions: history.slice(-limit),
+    };
+  }
+
+  function device(deviceId, now = Date.now()) {
+    advance(now);
+    const entry = devices.get(deviceId);
+    return entry ? describe(entry) : null;
+  }
+
+  return {
+    start: wheel.start,
+    stop: wheel.stop,
+    seen,
+    advance,
+    status,
+    device,
+  };
+}
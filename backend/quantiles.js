@@ -0,0 +1,282 @@
+import {
+  createSketch,
+  DEFAULT_ALPHA,
+  decodeSketch,
+  encodeSketch,
+  sketchAdd,
+  sketchMerge,
+  sketchQuantile,
+  validAlpha,
+} from "./sketch.js";
+
+// Per-device, per-bucket quantile sketches (sketch.js) of every reading,
+// built from the ingest event stream. Open buckets live in memory; once a
+// bucket has been closed for graceMs its sketches are written to
+// reading_sketches, a few dozen bytes per device, metric and bucket.
+// Readings arriving later for a written bucket start a new sketch that is
+// written as another row, so a (device, bucket, metric) may have several
+// rows and queries always merge. Quantiles for any range and grouping
+// (fleet, zone, device) are then merges of stored sketches instead of
+// sorts over the raw rows, within a relative error of alpha.
+//
+// Open buckets (up to bucketSeconds + graceMs of readings) exist only in
+// this process: close() writes them on a clean shutdown, but a crash
+// loses them, and with several workers each keeps its own.
+
+export const SKETCH_METRICS = ["temperature", "humidity", "light_intensity"];
+export const SKETCH_TABLE = "reading_sketches";
+
+const INSERT_SKETCHES = {
+  name: "insert-sketches",
+  text: `INSERT INTO ${SKETCH_TABLE}
+           (device_id, bucket, metric, readings, sketch)
+         SELECT * FROM unnest($1::text[], $2::timestamptz[], $3::text[],
+                              $4::int[], $5::bytea[])`,
+};
+
+const SELECT_SKETCHES = {
+  name: "select-sketches",
+  text: `SELECT device_id, bucket, sketch FROM ${SKETCH_TABLE}
+          WHERE metric = $1 AND bucket >= $2 AND bucket < $3`,
+};
+
+export function createQuantileStore({
+  pool,
+  zones,
+  bucketSeconds = 3600,
+  graceMs = 5 * 60 * 1000,
+  flushMs = 60 * 1000,
+  alpha = DEFAULT_ALPHA,
+}) {
+  if (!validAlpha(alpha)) {
+    throw new Error(`Sketch alpha must be between 0 and 1, got ${alpha}`);
+  }
+  const bucketMs = bucketSeconds * 1000;
+  const open = new Map(); // Bucket start -> device -> metric -> sketch
+  let timer = null;
+  let written = 0;
+  let writtenBytes = 0;
+
+  // deviceId may be undefined for devices that do not identify themselves;
+  // they count toward the fleet only
+  function record(deviceId, rows) {
+    const device = deviceId ?? "";
+    for (const row of rows) {
+      const createdAt = Date.parse(row.created_at);
+      const bucket = createdAt - (createdAt % bucketMs);
+      let devices = open.get(bucket);
+      if (!devices) {
+        devices = new Map();
+        open.set(bucket, devices);
+      }
+      let sketches = devices.get(device);
+      if (!sketches) {
+        sketches = {};
+        for (const metric of SKETCH_METRICS) {
+          sketches[metric] = createSketch(alpha);
+        }
+        devices.set(device, sketches);
+      }
+      for (const metric of SKETCH_METRICS) {
+        if (row[metric] !== undefined && row[metric] !== null) {
+          sketchAdd(sketches[metric], Number(row[metric]));
+        }
+      }
+    }
+  }
+
+  async function ensureTable() {
+    await pool.query(
+      `CREATE TABLE IF NOT EXISTS ${SKETCH_TABLE} (
+         device_id text NOT NULL,
+         bucket timestamptz NOT NULL,
+         metric text NOT NULL,
+         readings integer NOT NULL,
+         sketch bytea NOT NULL)`
+    );
+    await pool.query(
+      `CREATE INDEX IF NOT EXISTS ${SKETCH_TABLE}_metric_bucket
+         ON ${SKETCH_TABLE} (metric, bucket)`
+    );
+  }
+
+  // Puts sketches back after a failed write, merging with any readings
+  // that arrived meanwhile
+  function restore(bucket, devices) {
+    const current = open.get(bucket);
+    if (!current) {
+      open.set(bucket, devices);
+      return;
+    }
+    for (const [device, sketches] of devices) {
+      const into = current.get(device);
+      if (!into) {
+        current.set(device, sketches);
+        continue;
+      }
+      for (const metric of SKETCH_METRICS) {
+        sketchMerge(into[metric], sketches[metric]);
+      }
+    }
+  }
+
+  // Writes and forgets every bucket closed for at least graceMs. Buckets
+  // are detached first, so readings arriving during the write start new
+  // sketches instead of being dropped with the written ones.
+  async function flush(now = Date.now()) {
+    const closed = [...open.entries()].filter(
+      ([bucket]) => bucket + bucketMs + graceMs <= now
+    );
+    if (!closed.length) {
+      return 0;
+    }
+    const columns = [[], [], [], [], []];
+    let bytes = 0;
+    for (const [bucket, devices] of closed) {
+      open.delete(bucket);
+      const at = new Date(bucket);
+      for (const [device, sketches] of devices) {
+        for (const metric of SKETCH_METRICS) {
+          const sketch = sketches[metric];
+          if (!sketch.count) {
+            continue;
+          }
+          const encoded = encodeSketch(sketch);
+          [device, at, metric, sketch.count, encoded].forEach((value, i) =>
+            columns[i].push(value)
+          );
+          bytes += encoded.length;
+        }
+      }
+    }
+    try {
+      await pool.query({ ...INSERT_SKETCHES, values: columns });
+    } catch (err) {
+      for (const [bucket, devices] of closed) {
+        restore(bucket, devices);
+      }
+      throw err;
+    }
+    written += columns[0].length;
+    writtenBytes += bytes;
+    return columns[0].length;
+  }
+
+  function groupOf(group, device) {
+    if (group === "device") {
+      return device || null;
+    }
+    if (group === "zone") {
+      return zones?.zoneOf(device) ?? null;
+    }
+    return "fleet";
+  }
+
+  // Quantiles of metric per group ("fleet", "zone" or "device") and per
+  // interval of intervalSeconds (a multiple of bucketSeconds, or 0 for the
+  // whole range) over [from, to), merging stored and open sketches
+  async function query({
+    metric,
+    quantiles,
+    group,
+    intervalSeconds,
+    from,
+    to,
+  }) {
+    if (!SKETCH_METRICS.includes(metric)) {
+      throw new Error(`Invalid metric: ${metric}`);
+    }
+    if (intervalSeconds % bucketSeconds) {
+      throw new Error(`interval must be a multiple of ${bucketSeconds}`);
+    }
+    const intervalMs = intervalSeconds * 1000;
+    const merged = new Map(); // "group interval" -> {group, start, sketch}
+    const add = (device, bucket, sketch) => {
+      const name = groupOf(group, device);
+      if (name === null) {
+        return;
+      }
+      const start = intervalMs ? bucket - (bucket % intervalMs) : from;
+      const key = `${name} ${start}`;
+      const entry = merged.get(key);
+      if (entry) {
+        sketchMerge(entry.sketch, sketch);
+      } else {
+        merged.set(key, {
+          group: name,
+          start,
+          sketch: sketchMerge(createSketch(sketch.alpha), sketch),
+        });
+      }
+    };
+
+    const { rows } = await pool.query({
+      ...SELECT_SKETCHES,
+      values: [metric, new Date(from), new Date(to)],
+    });
+    for (const row of rows) {
+      const bucket = new Date(row.bucket).getTime();
+      add(row.device_id, bucket, decodeSketch(row.sketch));
+    }
+    for (const [bucket, devices] of open) {
+      if (bucket < from || bucket >= to) {
+        continue;
+      }
+      for (const [device, sketches] of devices) {
+        if (sketches[metric].count) {
+          add(device, bucket, sketches[metric]);
+        }
+      }
+    }
+
+    return [...merged.values()]
+      .sort((a, b) => a.start - b.start || a.group.localeCompare(b.group))
+      .map(({ group: name, start, sketch }) => {
+        const result = {
+          group: name,
+          start: new Date(start).toISOString(),
+          readings: sketch.count,
+        };
+        for (const q of quantiles) {
+          result[`p${q}`] = sketchQuantile(sketch, q / 100);
+        }
+        return result;
+      });
+  }
+
+  async function start() {
+    await ensureTable();
+    timer = setInterval(() => {
+      flush().catch((err) => {
+        console.log(`Sketch flush failed: ${err.message}`);
+      });
+    }, flushMs);
+    timer.unref();
+  }
+
+  function stop() {
+    clearInterval(timer);
+    timer = null;
+  }
+
+  // Stops the timer and writes every bucket, open ones included
+  async function close() {
+    stop();
+    return flush(Infinity);
+  }
+
+  function stats() {
+    let sketches = 0;
+    for (const devices of open.values()) {
+      sketches += devices.size * SKETCH_METRICS.length;
+    }
+    return {
+      open_buckets: open.size,
+      open_sketches: sketches,
+      written_sketches: written,
+      written_bytes: writtenBytes,
+    };
+  }
+
+  return { start, stop, close, record, flush, query, stats, bucketSeconds };
+}
@@ -0,0 +1,163 @@
+// In-memory read model of the recent readings for dashboard queries, fed
+// by the ingest event stream instead of reading `data`. Rows are kept for
+// windowMinutes; bucket queries are answered from per-BASE_BUCKET_SECONDS
+// aggregates maintained on apply, so they cost one pass over the buckets
+// in range rather than over the rows.
+//
+// The model starts empty: until load() has been given the window's rows
+// from the database it answers nothing (the read path falls back to the
+// primary), and rows applied meanwhile are held back and merged with the
+// loaded ones by id, so a row both loaded and applied is counted once.
+
+const BASE_BUCKET_SECONDS = 10; // The firmware's sample interval
+
+// Rows from the database carry Date objects, rows from ingest strings
+const timeOf = (row) => new Date(row.created_at).getTime();
+
+export function createReadModel({ windowMinutes = 60 } = {}) {
+  const windowMs = windowMinutes * 60 * 1000;
+  let rows = []; // Newest last, by arrival
+  const buckets = new Map(); // Base bucket start (ms) -> aggregate
+  let lastAppliedAt = null;
+  let pending = []; // Applied before load(), null once loaded
+
+  function prune(now) {
+    const cutoff = now - windowMs;
+    if (rows.length && timeOf(rows[0]) < cutoff) {
+      rows = rows.filter((row) => timeOf(row) >= cutoff);
+    }
+    for (const start of buckets.keys()) {
+      if (start < cutoff - BASE_BUCKET_SECONDS * 1000) {
+        buckets.delete(start);
+      }
+    }
+  }
+
+  function add(written, now) {
+    for (const row of written) {
+      const createdAt = timeOf(row);
+      if (createdAt < now - windowMs) {
+        continue;
+      }
+      rows.push(row);
+      const start =
+        Math.floor(createdAt / (BASE_BUCKET_SECONDS * 1000)) *
+        BASE_BUCKET_SECONDS *
+        1000;
+      let bucket = buckets.get(start);
+      if (!bucket) {
+        bucket = {
+          readings: 0,
+          temperature: 0,
+          max_temperature: -Infinity,
+          humidity: 0,
+          light_intensity: 0,
+        };
+        buckets.set(start, bucket);
+      }
+      bucket.readings += 1;
+      bucket.temperature += Number(row.temperature);
+      bucket.max_temperature = Math.max(
+        bucket.max_temperature,
+        Number(row.temperature)
+      );
+      bucket.humidity += Number(row.humidity);
+      bucket.light_intensity += Number(row.light_intensity);
+    }
+  }
+
+  function apply(written, now = Date.now()) {
+    if (pending) {
+      pending.push(...written);
+      return;
+    }
+    add(written, now);
+    lastAppliedAt = now;
+    prune(now);
+  }
+
+  // Seeds the model with the last windowMinutes of rows as stored
+  function load(stored, now = Date.now()) {
+    const applied = new Set(pending.map((row) => row.id));
+    add(
+      stored
+        .filter((row) => !applied.has(row.id))
+        .sort((a, b) => timeOf(a) - timeOf(b)),
+      now
+    );
+    add(pending, now);
+    pending = null;
+    lastAppliedAt = now;
+    prune(now);
+  }
+
+  // Same shape as recentReadings in db.js; null before load() or when
+  // the window is too short for the question
+  function recent(minutes, limit, now = Date.now()) {
+    if (pending || minutes > windowMinutes) {
+      return null;
+    }
+    const cutoff = now - minutes * 60 * 1000;
+    return rows
+      .filter((row) => timeOf(row) >= cutoff)
+      .sort((a, b) => timeOf(b) - timeOf(a))
+      .slice(0, limit);
+  }
+
+  // Same shape as readingBuckets in db.js; null before load() and for
+  // intervals the base buckets cannot be merged into
+  function bucketed(intervalSeconds, minutes, now = Date.now()) {
+    if (
+      pending ||
+      minutes > windowMinutes ||
+      intervalSeconds % BASE_BUCKET_SECONDS
+    ) {
+      return null;
+    }
+    const intervalMs = intervalSeconds * 1000;
+    const cutoff = now - minutes * 60 * 1000;
+    const merged = new Map();
+    for (const [start, bucket] of buckets) {
+      if (start < cutoff) {
+        continue;
+      }
+      const key = Math.floor(start / intervalMs) * intervalMs;
+      const into = merged.get(key) ?? {
+        readings: 0,
+        temperature: 0,
+        max_temperature: -Infinity,
+        humidity: 0,
+        light_intensity: 0,
+      };
+      into.readings += bucket.readings;
+      into.temperature += bucket.temperature;
+      into.max_temperature = Math.max(
+        into.max_temperature,
+        bucket.max_temperature
+      );
+      into.humidity += bucket.humidity;
+      into.light_intensity += bucket.light_intensity;
+      merged.set(key, into);
+    }
+    return [...merged.entries()]
+      .sort(([a], [b]) => a - b)
+      .map(([start, bucket]) => ({
+        bucket: new Date(start).toISOString(),
+        readings: bucket.readings,
+        temperature: bucket.temperature / bucket.readings,
+        max_temperature: bucket.max_temperature,
+        humidity: bucket.humidity / bucket.readings,
+        light_intensity: bucket.light_intensity / bucket.readings,
+      }));
+  }
+
+  return {
+    windowMinutes,
+    apply,
+    load,
+    recent,
+    bucketed,
+    loaded: () => pending === null,
+    lastAppliedAt: () => lastAppliedAt,
+  };
+}
@@ -0,0 +1,145 @@
+// Read path for dashboard queries, kept off the primary that ingest writes
+// to. READ_PATH selects where GET /data?minutes and /data/buckets go:
+//   primary  the ingest pool (default)
+//   replica  POSTGRES_READ_URL, a streaming replica
+//   memory   the in-memory read model fed by ingest (readmodel.js)
+// Every answer carries its source and how stale it may be. A replica that
+// lags more than maxStalenessMs, or a question the read model cannot
+// answer, falls back to the primary.
+//
+// The read model lives in this process and only sees its own ingests, so
+// it is refused when there is more than one worker. It is seeded with its
+// window from the primary at startup and answers nothing until then.
+
+import {
+  pool,
+  readingBuckets,
+  readPool,
+  recentReadings,
+  WORKERS,
+} from "./db.js";
+
+const LOAD_RETRY_MS = 5000;
+
+export function createReadPath({
+  mode = "primary",
+  readModel = null,
+  maxStalenessMs = 10000,
+  lagCheckMs = 2000,
+}) {
+  if (mode === "replica" && readPool === pool) {
+    throw new Error("READ_PATH=replica needs POSTGRES_READ_URL");
+  }
+  if (mode === "memory" && !readModel) {
+    throw new Error("READ_PATH=memory needs a read model");
+  }
+  if (mode === "memory" && WORKERS > 1) {
+    throw new Error("READ_PATH=memory needs a single worker process");
+  }
+
+  // Resolves once the read model holds its whole window
+  const ready =
+    mode === "memory"
+      ? new Promise((resolve) => {
+          const load = async () => {
+            try {
+              const stored = await recentReadings(
+                readModel.windowMinutes,
+                Number.MAX_SAFE_INTEGER,
+                pool
+              );
+              readModel.load(stored);
+              resolve();
+            } catch (err) {
+              console.log(`Read model load failed: ${err.message}`);
+              setTimeout(load, LOAD_RETRY_MS).unref();
+            }
+          };
+          load();
+        })
+      : Promise.resolve();
+
+  // Replica lag, sampled in the background so queries never wait on it.
+  // Receive and replay positions are only comparable while the WAL
+  // receiver is streaming; a disconnected replica has replayed all it
+  // received and still lags, so its lag is unknown. Seeing the receiver's
+  // status needs pg_monitor (or pg_read_all_stats) on the read role;
+  // without it the lag stays unknown and reads go to the primary.
+  let replicaLagMs = null;
+  if (mode === "replica") {
+    const sample = async () => {
+      try {
+        const { rows } = await readPool.query({
+          name: "replica-lag",
+          text: `SELECT CASE
+                          WHEN NOT EXISTS (
+                                 SELECT FROM pg_stat_wal_receiver
+                                  WHERE status = 'streaming') THEN NULL
+                          WHEN pg_last_wal_receive_lsn() =
+                               pg_last_wal_replay_lsn() THEN 0
+                          ELSE extract(epoch FROM
+                                 now() - pg_last_xact_replay_timestamp())
+                               * 1000
+                        END AS lag_ms`,
+        });
+        replicaLagMs = rows[0].lag_ms === null ? null : Number(rows[0].lag_ms);
+      } catch (err) {
+        replicaLagMs = null;
+        console.log(`Replica lag check failed: ${err.message}`);
+      }
+    };
+    sample();
+    setInterval(sample, lagCheckMs).unref();
+  }
+
+  async function fromPrimary(query, reason) {
+    const data = await query(pool);
+    return { data, source: "primary", staleness_ms: 0, reason };
+  }
+
+  async function read(query, fromModel) {
+    if (mode === "memory") {
+      const data = fromModel();
+      if (data === null) {
+        return fromPrimary(
+          query,
+          readModel.loaded()
+            ? "outside read model window"
+            : "read model loading"
+        );
+      }
+      // The model holds the window as stored at startup plus every write
+      // of the only worker, applied as it commits and before the device's
+      // upload is answered, so every acknowledged reading is in it
+      return { data, source: "memory", staleness_ms: 0 };
+    }
+    if (mode === "replica") {
+      if (replicaLagMs === null || replicaLagMs > maxStalenessMs) {
+        return fromPrimary(query, "replica lag unknown or over bound");
+      }
+      return {
+        data: await query(readPool),
+        source: "replica",
+        // The lag sample itself may be up to lagCheckMs old
+        staleness_ms: Math.round(replicaLagMs + lagCheckMs),
+      };
+    }
+    return fromPrimary(query);
+  }
+
+  function recent(minutes, limit) {
+    return read(
+      (client) => recentReadings(minutes, limit, client),
+      () => readModel.recent(minutes, limit)
+    );
+  }
+
+  function buckets(intervalSeconds, minutes) {
+    return read(
+      (client) => readingBuckets(intervalSeconds, minutes, client),
+      () => readModel.bucketed(intervalSeconds, minutes)
+    );
+  }
+
+  return { recent, buckets, ready };
+}
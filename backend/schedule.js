@@ -0,0 +1,126 @@
+// Per-device fan and light schedules, delivered to the device in the
+// binary format of IOT/schedule.h as a "schedule" downlink command.
+// Devices keep their schedule in RAM only, so it is queued again when a
+// device comes back without having acked it (after a reboot its acks
+// start over from 0).
+
+export const SCHEDULE_FORMAT_VERSION = 1;
+export const SCHEDULE_MAX_WINDOWS = 8; // Per actuator, after midnight splits
+
+const MINUTES_PER_DAY = 1440;
+const ACTUATORS = ["fan", "light"];
+
+function parseMinute(time) {
+  const match = /^(\d{1,2}):(\d{2})$/.exec(time ?? "");
+  if (!match || Number(match[1]) > 24 || Number(match[2]) > 59) {
+    throw new Error(`Invalid time of day: ${time}`);
+  }
+  const minute = Number(match[1]) * 60 + Number(match[2]);
+  if (minute > MINUTES_PER_DAY) {
+    throw new Error(`Invalid time of day: ${time}`);
+  }
+  return minute;
+}
+
+// Validates {utc_offset_minutes, fan: [{start: "22:00", end: "06:00",
+// state: false}], light: [...]} into sorted, non-overlapping windows in
+// minutes of the local day, splitting windows across midnight
+export function parseSchedule(body) {
+  const utcOffset = body?.utc_offset_minutes ?? 0;
+  if (!Number.isInteger(utcOffset) || Math.abs(utcOffset) > 14 * 60) {
+    throw new Error("Invalid utc_offset_minutes");
+  }
+  const schedule = { utc_offset_minutes: utcOffset };
+  for (const actuator of ACTUATORS) {
+    const windows = [];
+    for (const window of body?.[actuator] ?? []) {
+      const start = parseMinute(window.start) % MINUTES_PER_DAY;
+      const end = parseMinute(window.end);
+      const state = Boolean(window.state ?? true);
+      if (start === end) {
+        throw new Error(`Empty ${actuator} window ${window.start}`);
+      }
+      if (start < end) {
+        windows.push({ start, end, state });
+      } else {
+        windows.push({ start, end: MINUTES_PER_DAY, state });
+        if (end > 0) {
+          windows.push({ start: 0, end, state });
+        }
+      }
+    }
+    windows.sort((a, b) => a.start - b.start);
+    for (let i = 1; i < windows.length; i++) {
+      if (windows[i].start < windows[i - 1].end) {
+        throw new Error(`Overlapping ${actuator} windows`);
+      }
+    }
+    if (windows.length > SCHEDULE_MAX_WINDOWS) {
+      throw new Error(`Too many ${actuator} windows`);
+    }
+    schedule[actuator] = windows;
+  }
+  return schedule;
+}
+
+// Header (version, UTC offset, window counts) then 3 bytes per window:
+// start (11 bits), end (11 bits), state (1 bit), 1 bit unused
+export function encodeSchedule(schedule) {
+  const windows = ACTUATORS.flatMap((actuator) => schedule[actuator]);
+  const bytes = Buffer.alloc(5 + windows.length * 3);
+  bytes[0] = SCHEDULE_FORMAT_VERSION;
+  bytes.writeInt16BE(schedule.utc_offset_minutes, 1);
+  bytes[3] = schedule.fan.length;
+  bytes[4] = schedule.light.length;
+  windows.forEach((window, i) => {
+    const packed =
+      (window.start << 13) | (window.end << 2) | ((window.state ? 1 : 0) << 1);
+    bytes.writeUIntBE(packed, 5 + i * 3, 3);
+  });
+  return bytes;
+}
+
+export function createScheduleStore(commands) {
+  const schedules = new Map();
+
+  function enqueue(deviceId, entry) {
+    entry.commandId = commands.enqueue(deviceId, {
+      command: "schedule",
+      value: false,
+      duration: 0,
+      data: entry.encoded,
+    }).id;
+  }
+
+  function set(deviceId, schedule) {
+    const entry = { schedule, encoded: encodeSchedule(schedule) };
+    enqueue(deviceId, entry); // Throws without an id, keeping the old one
+    schedules.set(deviceId, entry);
+    return entry.commandId;
+  }
+
+  function get(deviceId) {
+    return schedules.get(deviceId)?.schedule ?? null;
+  }
+
+  // Called with the command id a device acked on upload; queues the
+  // schedule again when the device has not applied it since booting
+  function resync(deviceId, ackedId) {
+    const entry = schedules.get(deviceId);
+    if (
+      entry &&
+      ackedId < entry.commandId &&
+      !commands.pending(deviceId).some(({ id }) => id === entry.commandId)
+    ) {
+      // Runs in the upload path, which must not fail for it; the next
+      // upload tries again
+      try {
+        enqueue(deviceId, entry);
+      } catch (err) {
+        console.log(`Schedule resync for ${deviceId} failed: ${err.message}`);
+      }
+    }
+  }
+
+  return { set, get, resync };
+}
@@ -1,16 +1,167 @@
 import express from "express";
-import { Pool } from "pg";
+import https from "node:https";
+import { readFileSync } from "node:fs";
 import { config } from "dotenv";
 import { supabase } from "./supabase.js";
-import { v4 } from "uuid";
+import { drainIngest, ingestEvents, ingestReadings } from "./ingest.js";
+import { enableStaging, pool, STAGING_ENABLED } from "./db.js";
+import { createStagingMerger } from "./staging.js";
+import { createReadModel } from "./readmodel.js";
+import { createReadPath } from "./reads.js";
+import { createArchive } from "./archive.js";
+import { createQuantileStore, SKETCH_METRICS } from "./quantiles.js";
+import { createFleetSummary } from "./fleet.js";
+import { createPresenceTracker } from "./presence.js";
+import {
+  ANALYTICS_QUERIES,
+  createAnalytics,
+  parseAnalyticsQuery,
+} from "./analytics.js";
+import {
+  CONTENT_TYPE_CBOR,
+  CONTENT_TYPE_DELTA,
+  CONTENT_TYPE_JSON,
+  decodeSensorPayload,
+} from "./payload.js";
+import {
+  CODE_BAD_REQUEST,
+  CODE_SERVICE_UNAVAILABLE,
+  startCoapServer,
+} from "./coap.js";
+import { createUploadPacer } from "./pacing.js";
+import { createBackpressure } from "./backpressure.js";
+import { createZoneRegistry } from "./zones.js";
+import { createCommandPusher, createCommandQueue } from "./commands.js";
+import { createScheduleStore, parseSchedule } from "./schedule.js";
+import {
+  COMMANDS,
+  commandFields,
+  commandHeader,
+  encodeControlBlock,
+} from "./control.js";
 
 config();
 
 const app = express();
 app.use(express.json());
+app.use(express.raw({ type: [CONTENT_TYPE_CBOR, CONTENT_TYPE_DELTA] }));
 
-const pool = new Pool({
-  connectionString: process.env.POSTGRES_URL,
+const pacer = createUploadPacer({
+  spreadMs: Number(process.env.UPLOAD_SPREAD_MS) || 30000,
+});
+
+// Upload rate hints while ingest is overloaded, relative to the devices'
+// own upload interval and batch size (UPLOAD_INTERVAL and
+// UPLOAD_BATCH_SIZE in the sketch)
+const backpressure = createBackpressure({
+  intervalMs: Number(process.env.UPLOAD_INTERVAL_MS) || 60 * 1000,
+  batch: Number(process.env.UPLOAD_BATCH_SIZE) || 6,
+  targetMs: Number(process.env.INGEST_TARGET_MS) || 500,
+  maxPending: Number(process.env.INGEST_MAX_PENDING) || 1000,
+});
+
+function setRetryAfter(res) {
+  res.set("Retry-After", String(Math.ceil(backpressure.retryAfter() / 1000)));
+}
+
+// Zone membership, e.g. {"greenhouse-1": {"devices": ["a0b1c2d3e4f5"],
+// "temp_high": 30}}; devices outside any zone keep their local rules
+const zones = createZoneRegistry({
+  zones: process.env.ZONES_PATH
+    ? JSON.parse(readFileSync(process.env.ZONES_PATH, "utf8"))
+    : {},
+});
+
+// Downlink commands, pushed to CoAP devices at their last seen address and
+// repeated in upload responses until acked
+const commands = createCommandQueue({ pool });
+commands.start().catch((err) => {
+  console.log(`Command ids unavailable: ${err.message}`);
+});
+const deviceEndpoints = new Map();
+const schedules = createScheduleStore(commands);
+
+// Burst absorption: large flushes land in an unlogged staging table and
+// are merged into `data` in the background. Until the table exists they
+// keep going straight to `data`.
+const staging = STAGING_ENABLED
+  ? createStagingMerger({
+      pool,
+      batchRows: Number(process.env.STAGING_MERGE_ROWS) || 10000,
+      intervalMs: Number(process.env.STAGING_MERGE_MS) || 1000,
+    })
+  : null;
+staging
+  ?.start()
+  .then(enableStaging)
+  .catch((err) => {
+    console.log(`Staging table unavailable: ${err.message}`);
+  });
+
+// Dashboard reads (READ_PATH=primary|replica|memory, see reads.js), kept
+// off the primary so they do not compete with ingest
+const readMode = process.env.READ_PATH || "primary";
+const readModel =
+  readMode === "memory"
+    ? createReadModel({
+        windowMinutes: Number(process.env.READ_MODEL_MINUTES) || 60,
+      })
+    : null;
+if (readModel) {
+  ingestEvents.on("rows", (rows) => readModel.apply(rows));
+}
+const reads = createReadPath({
+  mode: readMode,
+  readModel,
+  maxStalenessMs: Number(process.env.READ_MAX_STALENESS_MS) || 10000,
+});
+
+// Quantile sketches per device and hour, fed by ingest and merged at
+// query time for GET /data/quantiles
+const quantiles = createQuantileStore({
+  pool,
+  zones,
+  bucketSeconds: Number(process.env.SKETCH_BUCKET_SECONDS) || 3600,
+  alpha:
+    process.env.SKETCH_ALPHA === undefined
+      ? undefined
+      : Number(process.env.SKETCH_ALPHA),
+});
+ingestEvents.on("rows", (rows, deviceId) => quantiles.record(deviceId, rows));
+quantiles.start().catch((err) => {
+  console.log(`Sketch table unavailable: ${err.message}`);
+});
+
+// Distinct and heavy-hitter device counts over the last FLEET_WINDOW_MINUTES
+const fleet = createFleetSummary({
+  windowMinutes: Number(process.env.FLEET_WINDOW_MINUTES) || 60,
+});
+ingestEvents.on("rows", (rows, deviceId) => fleet.record(deviceId, rows));
+
+// Last upload of every identified device and offline/online transitions
+// when one misses its expected interval
+const presence = createPresenceTracker({
+  intervalMs: Number(process.env.PRESENCE_INTERVAL_MS) || 60 * 1000,
+  missFactor: Number(process.env.PRESENCE_MISS_FACTOR) || 3,
+  onTransition: ({ device, state }) => {
+    console.log(`Device ${device} is ${state}`);
+  },
+});
+presence.start();
+
+// Historical analytics over a columnar archive of closed days, kept in
+// ANALYTICS_DIR (see archive.js)
+const archive = process.env.ANALYTICS_DIR
+  ? createArchive({
+      pool,
+      dir: process.env.ANALYTICS_DIR,
+      graceMs: (Number(process.env.ARCHIVE_GRACE_HOURS) || 1) * 3600 * 1000,
+      cacheRows: Number(process.env.ARCHIVE_CACHE_ROWS) || 50000000,
+    })
+  : null;
+const analytics = archive ? createAnalytics({ archive }) : null;
+archive?.start().catch((err) => {
+  console.log(`Analytics archive unavailable: ${err.message}`);
 });
 
 app.get("/test", (req, res) => {
@@ -18,26 +169,109 @@ app.get("/test", (req, res) => {
 });
 
 app.post("/sensor-data", async (req, res) => {
-  const info = {
-    id: v4(),
-    ...req.body,
-    created_at: new Date().toISOString(),
-  };
+  let readings;
   try {
-    const { data, error } = await supabase.from("data").insert(info).select();
-    if (error) {
-      console.log(error);
-      throw error;
+    const contentType = req.is([
+      CONTENT_TYPE_JSON,
+      CONTENT_TYPE_CBOR,
+      CONTENT_TYPE_DELTA,
+    ]);
+    readings = decodeSensorPayload(contentType, req.body);
+  } catch (err) {
+    return res.status(400).json({ error: err.message });
+  }
+  const uploadDelay = pacer.arrive();
+  if (uploadDelay > 0) {
+    res.set("X-Upload-Delay", String(uploadDelay));
+  }
+  const rates = backpressure.hints();
+  if (rates.upload_interval) {
+    res.set("X-Upload-Interval", String(rates.upload_interval));
+    res.set("X-Upload-Batch", String(rates.upload_batch));
+  }
+  const deviceId = req.get("X-Device-Id");
+  if (deviceId) {
+    presence.seen(deviceId, Date.now(), rates.upload_interval);
+  }
+  const control = deviceId ? zones.record(deviceId, readings.at(-1)) : null;
+  if (control) {
+    res.set("X-Zone-Fan", control.zone_fan ? "1" : "0");
+  }
+  if (deviceId) {
+    const ackedId = Number(req.get("X-Command-Ack")) || 0;
+    commands.ack(deviceId, ackedId);
+    schedules.resync(deviceId, ackedId);
+    const command = commands.next(deviceId);
+    if (command) {
+      res.set("X-Command", commandHeader(command));
     }
+  }
+  // Turned away before queueing; the readings stay on the device
+  if (backpressure.saturated()) {
+    setRetryAfter(res);
+    return res.status(503).json({ error: "Ingest overloaded" });
+  }
+  try {
+    const data = await backpressure.track(
+      ingestReadings(readings, deviceId || undefined)
+    );
     res.json({ success: true, message: "Successfully Inserted data", data });
   } catch (err) {
+    setRetryAfter(res);
     res.status(500).json({ error: err.message });
   } finally {
     console.log("Data inserted");
   }
 });
 
+const MAX_RECENT_LIMIT = 10000;
+const MAX_QUERY_MINUTES = 7 * 24 * 60;
+const MAX_BUCKET_SECONDS = 24 * 60 * 60;
+
+// A query parameter as an integer in 1..max, its fallback when absent,
+// or null when it is anything else (make_interval and the bucket width
+// take integers, so 1.5 would otherwise fail in SQL)
+function positiveInteger(value, fallback, max) {
+  if (value === undefined) {
+    return fallback;
+  }
+  const number = Number(value);
+  return Number.isInteger(number) && number >= 1 && number <= max
+    ? number
+    : null;
+}
+
+// ?minutes=N (up to MAX_QUERY_MINUTES) returns the newest readings of the
+// last N minutes (at most ?limit, default 1000, up to MAX_RECENT_LIMIT)
+// from the read path, with where they came from and how stale they may be;
+// without it every row is fetched through the REST client
 app.get("/data", async (req, res) => {
+  if (req.query.minutes !== undefined) {
+    const minutes = positiveInteger(req.query.minutes, 0, MAX_QUERY_MINUTES);
+    const limit = positiveInteger(req.query.limit, 1000, MAX_RECENT_LIMIT);
+    if (minutes === null) {
+      return res.status(400).json({ error: "Invalid minutes" });
+    }
+    if (limit === null) {
+      return res.status(400).json({ error: "Invalid limit" });
+    }
+    try {
+      const { data, source, staleness_ms, reason } = await reads.recent(
+        minutes,
+        limit
+      );
+      return res.status(200).json({
+        success: true,
+        message: "Successfully Fetched data",
+        source,
+        staleness_ms,
+        reason,
+        data,
+      });
+    } catch (err) {
+      return res.status(500).json({ error: err.message });
+    }
+  }
   try {
     const { data, error } = await supabase.from("data").select("*");
     if (error) {
@@ -52,4 +286,358 @@ app.get("/data", async (req, res) => {
   }
 });
 
-app.listen(4000);
+// Exports readings in the firmware's trace format (see TRACE FUNCTIONS in
+// the sketch) for host replay: epoch ms,temp*100,humidity*100,light
+app.get("/data/trace", async (req, res) => {
+  const pageSize = 1000;
+  try {
+    res.type("text/csv");
+    for (let from = 0; ; from += pageSize) {
+      const { data, error } = await supabase
+        .from("data")
+        .select("created_at, temperature, humidity, light_intensity")
+        .order("created_at")
+        .range(from, from + pageSize - 1);
+      if (error) {
+        console.log(error);
+        throw error;
+      }
+      res.write(
+        data
+          .map(
+            (row) =>
+              `${Date.parse(row.created_at)},${Math.round(
+                row.temperature * 100
+              )},${Math.round(row.humidity * 100)},${Math.round(
+                row.light_intensity
+              )}\n`
+          )
+          .join("")
+      );
+      if (data.length < pageSize) {
+        break;
+      }
+    }
+    res.end();
+  } catch (err) {
+    if (res.headersSent) {
+      res.destroy(err);
+    } else {
+      res.status(500).json({ error: err.message });
+    }
+  }
+});
+
+// Online/offline counts, recent transitions and the longest silent
+// devices, e.g. ?state=offline&limit=50
+app.get("/devices/status", (req, res) => {
+  const state = req.query.state;
+  if (state !== undefined && state !== "online" && state !== "offline") {
+    return res.status(400).json({ error: "Invalid state" });
+  }
+  const limit = Math.min(Number(req.query.limit) || 100, 10000);
+  res
+    .status(200)
+    .json({ success: true, data: presence.status({ state, limit }) });
+});
+
+app.get("/devices/:id/status", (req, res) => {
+  const status = presence.device(req.params.id);
+  if (!status) {
+    return res.status(404).json({ error: "Device never seen" });
+  }
+  res.status(200).json({ success: true, data: status });
+});
+
+// Queues a command ({command: "fan", value: true, duration: 600}) for a
+// device and pushes it right away when the device talks CoAP
+app.post("/devices/:id/commands", (req, res) => {
+  const { command, value = false, duration = 600 } = req.body ?? {};
+  // Own keys only: "toString" or "constructor" would queue a function
+  // that the device can never parse, blocking its queue until the TTL
+  if (
+    !Object.hasOwn(COMMANDS, command) ||
+    typeof value !== "boolean" ||
+    !Number.isInteger(duration) ||
+    duration < 0
+  ) {
+    return res.status(400).json({ error: "Invalid command" });
+  }
+  if (command === "schedule") {
+    return res.status(400).json({ error: "Use PUT /devices/:id/schedule" });
+  }
+  let entry;
+  try {
+    entry = commands.enqueue(req.params.id, { command, value, duration });
+  } catch (err) {
+    return res.status(503).json({ error: err.message });
+  }
+  pushCommands(req.params.id);
+  res.status(202).json({ success: true, id: entry.id });
+});
+
+app.get("/devices/:id/commands", (req, res) => {
+  res.status(200).json({
+    success: true,
+    pending: commands.pending(req.params.id),
+    round_trip: commands.stats(),
+  });
+});
+
+// Replaces a device's time-of-day schedule, e.g. {"utc_offset_minutes": 60,
+// "fan": [{"start": "22:00", "end": "06:00", "state": false}], "light":
+// [{"start": "18:00", "end": "23:00", "state": true}]}. Scheduled windows
+// take precedence over thresholds and zone control, commands over both.
+app.put("/devices/:id/schedule", (req, res) => {
+  let schedule;
+  try {
+    schedule = parseSchedule(req.body);
+  } catch (err) {
+    return res.status(400).json({ error: err.message });
+  }
+  let id;
+  try {
+    id = schedules.set(req.params.id, schedule);
+  } catch (err) {
+    return res.status(503).json({ error: err.message });
+  }
+  pushCommands(req.params.id);
+  res.status(202).json({ success: true, id, schedule });
+});
+
+app.get("/devices/:id/schedule", (req, res) => {
+  res
+    .status(200)
+    .json({ success: true, schedule: schedules.get(req.params.id) });
+});
+
+// Ingest load and the stretch factor of the rate hints
+app.get("/ingest/load", (req, res) => {
+  res.status(200).json({ success: true, data: backpressure.stats() });
+});
+
+// Merge progress of the staging path; oldest_staged bounds how far behind
+// queries on `data` are during a burst
+app.get("/ingest/staging", (req, res) => {
+  if (!staging) {
+    return res.status(404).json({ error: "Staging ingest is disabled" });
+  }
+  res.status(200).json({ success: true, data: staging.stats() });
+});
+
+// Approximate quantiles (within SKETCH_ALPHA relative error) of a metric,
+// e.g. ?metric=temperature&q=50,95&group=zone&interval=3600&minutes=1440;
+// group is fleet (default), zone or device, interval 0 merges the range
+app.get("/data/quantiles", async (req, res) => {
+  const metric = req.query.metric ?? "temperature";
+  const percentiles = String(req.query.q ?? "50,95,99")
+    .split(",")
+    .map(Number);
+  const group = req.query.group ?? "fleet";
+  const intervalSeconds = Number(req.query.interval ?? 3600);
+  const to = req.query.to ? Date.parse(req.query.to) : Date.now();
+  const from = req.query.from
+    ? Date.parse(req.query.from)
+    : to - (Number(req.query.minutes) || 1440) * 60 * 1000;
+  if (
+    !SKETCH_METRICS.includes(metric) ||
+    percentiles.some((p) => !(p >= 0 && p <= 100)) ||
+    !["fleet", "zone", "device"].includes(group) ||
+    !(intervalSeconds >= 0) ||
+    intervalSeconds % quantiles.bucketSeconds ||
+    !(from < to)
+  ) {
+    return res.status(400).json({ error: "Invalid quantile query" });
+  }
+  try {
+    const data = await quantiles.query({
+      metric,
+      quantiles: percentiles,
+      group,
+      intervalSeconds,
+      from,
+      to,
+    });
+    res.status(200).json({ success: true, metric, group, data });
+  } catch (err) {
+    res.status(500).json({ error: err.message });
+  }
+});
+
+// Runs one of ANALYTICS_QUERIES, e.g. {"query": "hourly_percentiles",
+// "params": {"metric": "temperature", "percentiles": [50, 95],
+// "from": "2026-01-01T00:00:00Z", "utc_offset_minutes": 60}}
+app.post("/analytics/query", async (req, res) => {
+  if (!analytics) {
+    return res.status(404).json({ error: "Analytics archive is disabled" });
+  }
+  let query;
+  try {
+    query = parseAnalyticsQuery(req.body);
+  } catch (err) {
+    return res
+      .status(400)
+      .json({ error: err.message, queries: ANALYTICS_QUERIES });
+  }
+  try {
+    const start = performance.now();
+    const data = await analytics.run(query);
+    res.status(200).json({
+      success: true,
+      query: query.name,
+      elapsed_ms: Math.round(performance.now() - start),
+      archive: archive.stats(),
+      ...data,
+    });
+  } catch (err) {
+    res.status(500).json({ error: err.message });
+  }
+});
+
+// Approximate fleet counters: devices reporting and alarming in the
+// window, and the devices that upload or alarm the most
+app.get("/fleet/summary", (req, res) => {
+  res.status(200).json({ success: true, data: fleet.summary() });
+});
+
+// Live per-zone aggregates kept up to date by ingest
+app.get("/zones", (req, res) => {
+  res.status(200).json({ success: true, data: zones.summary() });
+});
+
+// Cross-device aggregates per wall-clock bucket. Synced devices sample on
+// aligned boundaries, so a bucket of the sample interval holds exactly one
+// reading per device and no interpolation is needed.
+app.get("/data/buckets", async (req, res) => {
+  const interval = positiveInteger(req.query.interval, 10, MAX_BUCKET_SECONDS);
+  const minutes = positiveInteger(req.query.minutes, 60, MAX_QUERY_MINUTES);
+  if (interval === null) {
+    return res.status(400).json({ error: "Invalid interval" });
+  }
+  if (minutes === null) {
+    return res.status(400).json({ error: "Invalid minutes" });
+  }
+  try {
+    const { data, source, staleness_ms, reason } = await reads.buckets(
+      interval,
+      minutes
+    );
+    res
+      .status(200)
+      .json({ success: true, interval, source, staleness_ms, reason, data });
+  } catch (err) {
+    res.status(500).json({ error: err.message });
+  }
+});
+
+const server = app.listen(4000);
+
+// Optional HTTPS listener for devices uploading over TLS. Node issues
+// session tickets by default; the keep-alive timeout outlasts a device
+// batch interval so most uploads reuse the open connection instead of
+// handshaking again.
+let httpsServer = null;
+if (process.env.TLS_KEY_PATH && process.env.TLS_CERT_PATH) {
+  httpsServer = https.createServer(
+    {
+      key: readFileSync(process.env.TLS_KEY_PATH),
+      cert: readFileSync(process.env.TLS_CERT_PATH),
+    },
+    app
+  );
+  httpsServer.keepAliveTimeout = 120 * 1000;
+  httpsServer.listen(Number(process.env.HTTPS_PORT) || 4443);
+}
+
+const coap = startCoapServer({
+  port: Number(process.env.COAP_PORT) || 5683,
+  routes: {
+    "sensor-data": async (payload, contentType, query, remote) => {
+      // CoAP devices get no hint, but still count toward the arrival rate
+      pacer.arrive();
+      let readings;
+      try {
+        readings = decodeSensorPayload(contentType, payload);
+      } catch (err) {
+        err.coapCode = CODE_BAD_REQUEST;
+        throw err;
+      }
+      const rates = backpressure.hints();
+      let control = null;
+      if (query.d) {
+        presence.seen(query.d, Date.now(), rates.upload_interval);
+        deviceEndpoints.set(query.d, remote);
+        commands.ack(query.d, Number(query.a) || 0);
+        schedules.resync(query.d, Number(query.a) || 0);
+        control = zones.record(query.d, readings.at(-1));
+        const command = commands.next(query.d);
+        if (command) {
+          control = { ...control, ...commandFields(command) };
+        }
+      }
+      // Turned away before queueing; the device keeps the readings until
+      // an upload gets a 2.xx, non-confirmable ones included
+      if (backpressure.saturated()) {
+        const err = new Error("Ingest overloaded");
+        err.coapCode = CODE_SERVICE_UNAVAILABLE;
+        err.payload = encodeControlBlock({
+          ...rates,
+          retry_after: backpressure.retryAfter(),
+        });
+        throw err;
+      }
+      await backpressure.track(ingestReadings(readings, query.d));
+      control = { ...control, ...rates };
+      return Object.keys(control).length
+        ? encodeControlBlock(control)
+        : undefined;
+    },
+  },
+});
+
+// The device's CoAP ACK of a pushed command acks the command
+async function sendCommand(deviceId, command) {
+  const remote = deviceEndpoints.get(deviceId);
+  if (!remote) {
+    return false;
+  }
+  const code = await coap.request(
+    remote,
+    "command",
+    encodeControlBlock(commandFields(command))
+  );
+  return code >> 5 === 2;
+}
+
+const pushCommands = createCommandPusher(commands, sendCommand);
+
+// Connections still open this long after a shutdown signal (a client
+// that keeps its keep-alive connection busy) are not waited for
+const SHUTDOWN_TIMEOUT = 10 * 1000;
+
+const closeListener = (listener) =>
+  new Promise((resolve) => listener.close(resolve));
+
+// A deploy stops the listeners, lets the uploads already accepted be
+// written and answered, then writes the open quantile buckets, which
+// live in memory and hold up to an hour of sketches
+for (const signal of ["SIGTERM", "SIGINT"]) {
+  process.once(signal, async () => {
+    const listeners = [server, httpsServer].filter(Boolean);
+    const closed = Promise.all([...listeners.map(closeListener), coap.close()]);
+    for (const listener of listeners) {
+      listener.closeIdleConnections();
+    }
+    await Promise.race([
+      closed,
+      new Promise((resolve) => setTimeout(resolve, SHUTDOWN_TIMEOUT)),
+    ]);
+    await drainIngest();
+    try {
+      await quantiles.close();
+    } catch (err) {
+      console.log(`Sketch flush on ${signal} failed: ${err.message}`);
+    }
+    process.exit(0);
+  });
+}
@@ -0,0 +1,229 @@
+// DDSketch (Masson et al., "DDSketch: a fast and fully-mergeable quantile
+// sketch with relative-error guarantees"): values are counted in
+// logarithmic bins of ratio gamma = (1 + alpha) / (1 - alpha), so every
+// quantile is answered within a relative error of alpha and two sketches
+// with the same alpha merge exactly by adding bin counts. Readings are
+// clustered (one device, one hour), so the bins of a sketch are kept as a
+// dense array from its lowest index. Sketches of different alpha (after a
+// change of SKETCH_ALPHA) still merge: the finer one is re-binned into the
+// coarser one's bins at its bin representatives, which bounds the result's
+// error by about the sum of the two alphas.
+
+export const DEFAULT_ALPHA = 0.01;
+const FORMAT_VERSION = 2;
+const FORMAT_VERSION_ALPHA_1E4 = 1; // Alpha rounded to 1e-4
+
+export function validAlpha(alpha) {
+  return typeof alpha === "number" && alpha > 0 && alpha < 1;
+}
+
+function createStore() {
+  return { offset: 0, counts: [] };
+}
+
+function storeAdd(store, index, count) {
+  if (!store.counts.length) {
+    store.offset = index;
+  }
+  if (index < store.offset) {
+    store.counts.unshift(...new Array(store.offset - index).fill(0));
+    store.offset = index;
+  }
+  const at = index - store.offset;
+  while (store.counts.length <= at) {
+    store.counts.push(0);
+  }
+  store.counts[at] += count;
+}
+
+export function createSketch(alpha = DEFAULT_ALPHA) {
+  if (!validAlpha(alpha)) {
+    throw new Error(`Invalid sketch alpha: ${alpha}`);
+  }
+  return {
+    alpha,
+    lnGamma: Math.log((1 + alpha) / (1 - alpha)),
+    count: 0,
+    zero: 0,
+    min: Infinity,
+    max: -Infinity,
+    positive: createStore(),
+    negative: createStore(), // Indexed by |value|
+  };
+}
+
+// Values closer to zero than this are counted as zero
+const MIN_INDEXABLE = 1e-9;
+
+export function sketchAdd(sketch, value, count = 1) {
+  const magnitude = Math.abs(value);
+  if (magnitude < MIN_INDEXABLE) {
+    sketch.zero += count;
+  } else {
+    const index = Math.ceil(Math.log(magnitude) / sketch.lnGamma);
+    storeAdd(value > 0 ? sketch.positive : sketch.negative, index, count);
+  }
+  sketch.count += count;
+  if (value < sketch.min) sketch.min = value;
+  if (value > sketch.max) sketch.max = value;
+}
+
+// Representative value of a bin, within alpha of everything counted in it
+const binValue = (lnGamma, index) =>
+  (2 * Math.exp(lnGamma * index)) / (Math.exp(lnGamma) + 1);
+
+// Adds the bins of from, indexed with fromLnGamma, to store, indexed with
+// lnGamma
+function addBins(store, lnGamma, from, fromLnGamma) {
+  const { offset, counts } = from;
+  for (let i = 0; i < counts.length; i++) {
+    if (!counts[i]) {
+      continue;
+    }
+    const index =
+      fromLnGamma === lnGamma
+        ? offset + i
+        : Math.ceil(Math.log(binValue(fromLnGamma, offset + i)) / lnGamma);
+    storeAdd(store, index, counts[i]);
+  }
+}
+
+// Adds from to into, coarsening into first when from has the larger
+// alpha; from is never changed
+export function sketchMerge(into, from) {
+  if (from.alpha > into.alpha) {
+    const { lnGamma, positive, negative } = into;
+    const coarse = createSketch(from.alpha);
+    addBins(coarse.positive, coarse.lnGamma, positive, lnGamma);
+    addBins(coarse.negative, coarse.lnGamma, negative, lnGamma);
+    Object.assign(into, {
+      alpha: coarse.alpha,
+      lnGamma: coarse.lnGamma,
+      positive: coarse.positive,
+      negative: coarse.negative,
+    });
+  }
+  for (const sign of ["positive", "negative"]) {
+    addBins(into[sign], into.lnGamma, from[sign], from.lnGamma);
+  }
+  into.zero += from.zero;
+  into.count += from.count;
+  into.min = Math.min(into.min, from.min);
+  into.max = Math.max(into.max, from.max);
+  return into;
+}
+
+// Value at quantile q (0..1): the representative of the bin holding the
+// reading of rank q * (count - 1), clamped to the exact min and max
+export function sketchQuantile(sketch, q) {
+  if (!sketch.count) {
+    return null;
+  }
+  const rank = q * (sketch.count - 1);
+  const value = (index) => binValue(sketch.lnGamma, index);
+  const clamp = (v) => Math.min(sketch.max, Math.max(sketch.min, v));
+  let seen = 0;
+  const negative = sketch.negative;
+  for (let i = negative.counts.length - 1; i >= 0; i--) {
+    seen += negative.counts[i];
+    if (seen > rank) {
+      return clamp(-value(negative.offset + i));
+    }
+  }
+  seen += sketch.zero;
+  if (seen > rank) {
+    return clamp(0);
+  }
+  const positive = sketch.positive;
+  for (let i = 0; i < positive.counts.length; i++) {
+    seen += positive.counts[i];
+    if (seen > rank) {
+      return clamp(value(positive.offset + i));
+    }
+  }
+  return sketch.max;
+}
+
+// Compact binary form: version, alpha as a float64 LE (version 1 stored
+// it in 1e-4, which rounds an alpha like 0.00125), zigzag varints for the
+// min and max in hundredths (the precision of the data columns) and the
+// store offsets, plain varints for everything else
+function writeVarint(bytes, value) {
+  while (value >= 0x80) {
+    bytes.push((value % 0x80) | 0x80);
+    value = Math.floor(value / 0x80);
+  }
+  bytes.push(value);
+}
+
+const zigzag = (value) => (value < 0 ? -2 * value - 1 : 2 * value);
+const unzigzag = (value) => (value % 2 ? -(value + 1) / 2 : value / 2);
+
+export function encodeSketch(sketch) {
+  const alpha = Buffer.alloc(8);
+  alpha.writeDoubleLE(sketch.alpha);
+  const bytes = [FORMAT_VERSION, ...alpha];
+  writeVarint(bytes, sketch.zero);
+  const empty = !sketch.count;
+  writeVarint(bytes, empty ? 0 : zigzag(Math.round(sketch.min * 100)));
+  writeVarint(bytes, empty ? 0 : zigzag(Math.round(sketch.max * 100)));
+  for (const store of [sketch.positive, sketch.negative]) {
+    writeVarint(bytes, zigzag(store.offset));
+    writeVarint(bytes, store.counts.length);
+    for (const count of store.counts) {
+      writeVarint(bytes, count);
+    }
+  }
+  return Buffer.from(bytes);
+}
+
+export function decodeSketch(buffer) {
+  let offset = 0;
+  const readVarint = () => {
+    let value = 0;
+    let scale = 1;
+    for (;;) {
+      if (offset >= buffer.length) {
+        throw new Error("Truncated sketch");
+      }
+      const byte = buffer[offset++];
+      value += (byte & 0x7f) * scale;
+      if (byte < 0x80) {
+        return value;
+      }
+      scale *= 0x80;
+    }
+  };
+  const version = buffer[offset++];
+  let alpha;
+  if (version === FORMAT_VERSION) {
+    if (buffer.length < offset + 8) {
+      throw new Error("Truncated sketch");
+    }
+    alpha = buffer.readDoubleLE(offset);
+    offset += 8;
+  } else if (version === FORMAT_VERSION_ALPHA_1E4) {
+    alpha = readVarint() / 10000;
+  } else {
+    throw new Error("Unknown sketch format");
+  }
+  const sketch = createSketch(alpha);
+  sketch.zero = readVarint();
+  sketch.min = unzigzag(readVarint()) / 100;
+  sketch.max = unzigzag(readVarint()) / 100;
+  sketch.count = sketch.zero;
+  for (const store of [sketch.positive, sketch.negative]) {
+    store.offset = unzigzag(readVarint());
+    const length = readVarint();
+    for (let i = 0; i < length; i++) {
+      const count = readVarint();
+      store.counts.push(count);
+      sketch.count += count;
+    }
+  }
+  if (!sketch.count) {
+    sketch.min = Infinity;
+    sketch.max = -Infinity;
+  }
+  return sketch;
+}
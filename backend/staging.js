@@ -0,0 +1,122 @@
+// Optional burst path for ingest (STAGING_INGEST=1). Large flushes, such
+// as devices draining their offline queues after an outage, are copied
+// into data_staging: an UNLOGGED table whose only index is on created_at,
+// so a write costs no WAL and little index maintenance. A background
+// merger then moves the rows into `data` in created_at order, a bounded
+// batch per transaction, so the indexes of `data` are filled in key order
+// and dashboard queries only ever compete with one small merge at a time.
+// Each batch is an index range scan from the oldest row, not a sort of
+// the whole table, and the table is vacuumed after every drain so the
+// deleted rows do not pile up in front of that scan.
+//
+// Trade-offs: staged rows are invisible to queries until merged (the lag
+// is reported by stats()), and an unlogged table is emptied by crash
+// recovery, so rows staged at the moment Postgres crashes are lost.
+
+export const STAGING_TABLE = "data_staging";
+
+export function createStagingMerger({
+  pool,
+  batchRows = 10000,
+  intervalMs = 1000,
+}) {
+  let timer = null;
+  let merging = false;
+  let merged = 0;
+  let lastMergeMs = null;
+  let oldestStaged = null;
+
+  async function ensureTable() {
+    await pool.query(
+      `CREATE UNLOGGED TABLE IF NOT EXISTS ${STAGING_TABLE}
+         (LIKE data INCLUDING DEFAULTS)`
+    );
+    await pool.query(
+      `CREATE INDEX IF NOT EXISTS ${STAGING_TABLE}_created_at
+         ON ${STAGING_TABLE} (created_at)`
+    );
+  }
+
+  // Moves the oldest batchRows rows; resolves with the number moved
+  async function mergeBatch() {
+    const client = await pool.connect();
+    try {
+      await client.query("BEGIN");
+      const { rowCount } = await client.query({
+        name: "merge-staged-readings",
+        text: `WITH moved AS (
+                 DELETE FROM ${STAGING_TABLE}
+                  WHERE ctid = ANY (ARRAY(
+                    SELECT ctid FROM ${STAGING_TABLE}
+                     ORDER BY created_at
+                     LIMIT $1
+                       FOR UPDATE SKIP LOCKED))
+                 RETURNING *)
+               INSERT INTO data
+               SELECT * FROM moved ORDER BY created_at
+               ON CONFLICT DO NOTHING`,
+        values: [batchRows],
+      });
+      await client.query("COMMIT");
+      return rowCount;
+    } catch (err) {
+      await client.query("ROLLBACK");
+      throw err;
+    } finally {
+      client.release();
+    }
+  }
+
+  // Drains the staging table one batch at a time, yielding to other
+  // queries between batches
+  async function merge() {
+    if (merging) {
+      return;
+    }
+    merging = true;
+    try {
+      const start = performance.now();
+      let moved;
+      let drained = 0;
+      do {
+        moved = await mergeBatch();
+        merged += moved;
+        drained += moved;
+      } while (moved === batchRows);
+      if (drained > 0) {
+        await pool.query(`VACUUM ${STAGING_TABLE}`);
+      }
+      lastMergeMs = performance.now() - start;
+      const { rows } = await pool.query(
+        `SELECT min(created_at) AS oldest FROM ${STAGING_TABLE}`
+      );
+      oldestStaged = rows[0].oldest;
+    } catch (err) {
+      console.log(`Staging merge failed: ${err.message}`);
+    } finally {
+      merging = false;
+    }
+  }
+
+  // Resolves once the staging table exists; only then may writes be
+  // routed to it
+  async function start() {
+    await ensureTable();
+    timer = setInterval(merge, intervalMs);
+    timer.unref();
+  }
+
+  function stop() {
+    clearInterval(timer);
+  }
+
+  function stats() {
+    return {
+      merged_rows: merged,
+      last_merge_ms: lastMergeMs,
+      oldest_staged: oldestStaged,
+    };
+  }
+
+  return { start, stop, merge, stats };
+}
@@ -0,0 +1,177 @@
+// Hierarchical timer wheel (Varghese and Lauck, scheme 7) for large
+// numbers of per-device timers: heartbeat expiry, sustained-threshold
+// rules, batch flush deadlines. Time advances in ticks of tickMs, and a
+// timer fires on the first tick at or after its time, so timers due in
+// the same tick are handled as one batch.
+//
+// Each level is a ring of SLOTS slots; a slot of level l spans SLOTS^l
+// ticks. A timer goes into the lowest level whose ring still covers its
+// tick, in O(1), and is unlinked from its slot's list in O(1) to cancel
+// or move it. When the current tick enters a slot of a higher level, the
+// timers of that slot are redistributed to the levels below; a timer is
+// moved at most once per level before it fires. Timers beyond the top
+// level's range wait in its furthest slot and are placed again from
+// there.
+//
+// One setInterval per wheel (start()) replaces a setTimeout per device;
+// advance(now) can also be driven by hand, e.g. in simulated time.
+
+const SLOTS = 64;
+
+export function createTimerWheel({ tickMs = 100, levels = 4 } = {}) {
+  // spans[l] is the number of ticks one slot of level l covers
+  const spans = Array.from({ length: levels + 1 }, (_, l) => SLOTS ** l);
+  const heads = new Array(levels * SLOTS).fill(null);
+  let current = null; // Tick processed last
+  let size = 0;
+  let timer = null;
+
+  const digit = (tick, level) => Math.floor(tick / spans[level]) % SLOTS;
+
+  function link(entry) {
+    let level = 0;
+    while (
+      level < levels - 1 &&
+      Math.floor(entry.tick / spans[level + 1]) !==
+        Math.floor(current / spans[level + 1])
+    ) {
+      level++;
+    }
+    // Past the top level's range: its furthest slot from the current one
+    const slot =
+      level === levels - 1 && entry.tick - current >= spans[levels]
+        ? level * SLOTS + ((digit(current, level) + SLOTS - 1) % SLOTS)
+        : level * SLOTS + digit(entry.tick, level);
+    entry.slot = slot;
+    entry.prev = null;
+    entry.next = heads[slot];
+    if (entry.next) {
+      entry.next.prev = entry;
+    }
+    heads[slot] = entry;
+  }
+
+  function unlink(entry) {
+    if (entry.prev) {
+      entry.prev.next = entry.next;
+    } else {
+      heads[entry.slot] = entry.next;
+    }
+    if (entry.next) {
+      entry.next.prev = entry.prev;
+    }
+    entry.slot = -1;
+    entry.prev = entry.next = null;
+  }
+
+  function place(entry, at) {
+    if (current === null) {
+      current = Math.floor(Date.now() / tickMs);
+    }
+    entry.at = at;
+    entry.tick = Math.max(Math.ceil(at / tickMs), current + 1);
+    link(entry);
+    size++;
+  }
+
+  // Calls callback(data, now) once the wheel reaches time at (ms since
+  // the epoch). Returns the timer, for cancel() and reschedule().
+  function schedule(at, callback, data) {
+    const entry = {
+      at,
+      tick: 0,
+      callback,
+      data,
+      slot: -1,
+      prev: null,
+      next: null,
+    };
+    place(entry, at);
+    return entry;
+  }
+
+  // Returns whether the timer was still pending
+  function cancel(entry) {
+    if (entry.slot === -1) {
+      return false;
+    }
+    unlink(entry);
+    size--;
+    return true;
+  }
+
+  // Moves a pending timer to time at, or arms a fired or cancelled one
+  // again with the same callback
+  function reschedule(entry, at) {
+    cancel(entry);
+    place(entry, at);
+    return entry;
+  }
+
+  // Moves the timers of a higher-level slot down to where they now belong
+  function cascade(level) {
+    const slot = level * SLOTS + digit(current, level);
+    let entry = heads[slot];
+    heads[slot] = null;
+    while (entry) {
+      const next = entry.next;
+      link(entry);
+      entry = next;
+    }
+  }
+
+  // Processes every tick up to now, firing the timers that came due
+  function advance(now = Date.now()) {
+    const target = Math.floor(now / tickMs);
+    if (current === null || size === 0) {
+      current = Math.max(current ?? target, target);
+      return;
+    }
+    while (current < target && size > 0) {
+      current++;
+      // From the highest level whose slot boundary this tick crosses
+      let top = 0;
+      while (top < levels - 1 && current % spans[top + 1] === 0) {
+        top++;
+      }
+      for (let level = top; level > 0; level--) {
+        cascade(level);
+      }
+      const slot = current % SLOTS;
+      // Timers scheduled by callbacks land in later ticks, so the slot
+      // empties; ones cancelled by callbacks are already unlinked
+      while (heads[slot]) {
+        const entry = heads[slot];
+        unlink(entry);
+        if (entry.tick > current) {
+          link(entry); // Out of range of a single-level wheel
+          continue;
+        }
+        size--;
+        entry.callback(entry.data, now);
+      }
+    }
+    current = Math.max(current, target);
+  }
+
+  function start() {
+    timer = setInterval(() => advance(), tickMs);
+    timer.unref();
+  }
+
+  function stop() {
+    clearInterval(timer);
+    timer = null;
+  }
+
+  return {
+    tickMs,
+    schedule,
+    cancel,
+    reschedule,
+    advance,
+    start,
+    stop,
+    size: () => size,
+  };
+}
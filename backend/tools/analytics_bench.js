@@ -0,0 +1,223 @@
+// Latency of the curated analytics queries on the column archive, and of
+// the same questions asked of Postgres in SQL.
+//
+// Usage: node tools/analytics_bench.js [--rows <n>] [--days <n>]
+//        [--dir <archive dir>] [--load]
+//
+// Writes --rows synthetic readings spread over --days archive partitions
+// (default 100M rows over a year) into --dir, then runs every query cold
+// (partitions read from disk) and warm (from the partition cache). With
+// --load and POSTGRES_URL the same rows are also copied into `data` under
+// a far-future created_at, the SQL equivalents are timed, and the rows
+// are deleted afterwards.
+
+import { mkdir, rm } from "node:fs/promises";
+import { v4 } from "uuid";
+import {
+  allocatePartition,
+  createArchive,
+  dayKey,
+  FLAGS,
+  writePartition,
+} from "../archive.js";
+import { createAnalytics, parseAnalyticsQuery } from "../analytics.js";
+import { copyRows } from "../copy.js";
+import { COLUMN_TYPES, DATA_COLUMNS, pool } from "../db.js";
+
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+const DAY_MS = 24 * 60 * 60 * 1000;
+
+const options = {
+  rows: 100000000,
+  days: 365,
+  dir: "/tmp/analytics_bench",
+  load: false,
+};
+for (let i = 2; i < process.argv.length; i++) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (key === "load") {
+    options.load = true;
+  } else if (key in options && i + 1 < process.argv.length) {
+    options[key] =
+      key === "dir" ? process.argv[++i] : Number(process.argv[++i]);
+  } else {
+    console.error(
+      "usage: analytics_bench.js [--rows <n>] [--days <n>] [--dir <dir>]" +
+        " [--load]"
+    );
+    process.exit(2);
+  }
+}
+if (options.load && !process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set");
+  process.exit(2);
+}
+
+// Deterministic readings for a day: a diurnal temperature curve with
+// noise, humidity falling as it warms, light following the sun
+function generateDay(dayIndex, rows) {
+  let seed = (dayIndex + 1) * 2654435761;
+  const random = () => {
+    seed ^= seed << 13;
+    seed ^= seed >>> 17;
+    seed ^= seed << 5;
+    return (seed >>> 0) / 4294967296;
+  };
+  const columns = allocatePartition(rows);
+  const start = BENCH_EPOCH + dayIndex * DAY_MS;
+  for (let i = 0; i < rows; i++) {
+    const ms = start + Math.floor((i * DAY_MS) / rows);
+    const phase = Math.sin(((ms % DAY_MS) / DAY_MS) * 2 * Math.PI - 2);
+    const temperature = 2200 + 600 * phase + (random() - 0.5) * 400;
+    columns.created_at[i] = ms;
+    columns.temperature[i] = Math.round(temperature);
+    columns.humidity[i] = Math.round(
+      9000 - temperature * 1.5 + (random() - 0.5) * 600
+    );
+    columns.light_intensity[i] = Math.max(
+      0,
+      Math.round(50000 * phase + random() * 5000)
+    );
+    columns.flags[i] =
+      (temperature > 2600 ? FLAGS.fan : 0) |
+      (phase < 0 ? FLAGS.light : 0) |
+      (temperature > 2950 ? FLAGS.alram_led : 0);
+  }
+  return columns;
+}
+
+async function loadDay(columns) {
+  const batch = 20000;
+  for (let first = 0; first < columns.created_at.length; first += batch) {
+    const rows = [];
+    const end = Math.min(columns.created_at.length, first + batch);
+    for (let i = first; i < end; i++) {
+      rows.push({
+        id: v4(),
+        created_at: new Date(columns.created_at[i]),
+        temperature: columns.temperature[i] / 100,
+        humidity: columns.humidity[i] / 100,
+        light_intensity: columns.light_intensity[i] / 100,
+        fan: Boolean(columns.flags[i] & FLAGS.fan),
+        fan_led: false,
+        light: Boolean(columns.flags[i] & FLAGS.light),
+        light_led: false,
+        alram_led: Boolean(columns.flags[i] & FLAGS.alram_led),
+        buzzer: false,
+      });
+    }
+    await copyRows(pool, "data", rows, DATA_COLUMNS, COLUMN_TYPES);
+  }
+}
+
+const from = new Date(BENCH_EPOCH).toISOString();
+const to = new Date(BENCH_EPOCH + options.days * DAY_MS).toISOString();
+
+// Each curated query with the SQL answering the same question
+const QUERIES = [
+  {
+    query: "hourly_profile",
+    params: { metric: "temperature" },
+    sql: `SELECT extract(hour FROM created_at AT TIME ZONE 'UTC') AS hour,
+                 count(*), avg(temperature), min(temperature),
+                 max(temperature)
+            FROM data WHERE created_at >= $1 AND created_at < $2
+           GROUP BY hour`,
+  },
+  {
+    query: "hourly_percentiles",
+    params: { metric: "temperature", percentiles: [50, 95, 99] },
+    sql: `SELECT extract(hour FROM created_at AT TIME ZONE 'UTC') AS hour,
+                 percentile_disc(ARRAY[0.5, 0.95, 0.99])
+                   WITHIN GROUP (ORDER BY temperature)
+            FROM data WHERE created_at >= $1 AND created_at < $2
+           GROUP BY hour`,
+  },
+  {
+    query: "correlation",
+    params: { x: "temperature", y: "humidity" },
+    sql: `SELECT date_trunc('day', created_at AT TIME ZONE 'UTC') AS day,
+                 count(*), corr(temperature, humidity)
+            FROM data WHERE created_at >= $1 AND created_at < $2
+           GROUP BY day`,
+  },
+  {
+    query: "daily_summary",
+    params: { metric: "humidity" },
+    sql: `SELECT date_trunc('day', created_at AT TIME ZONE 'UTC') AS day,
+                 count(*), avg(humidity), min(humidity), max(humidity),
+                 avg(fan::int), avg(light::int), avg(alram_led::int)
+            FROM data WHERE created_at >= $1 AND created_at < $2
+           GROUP BY day`,
+  },
+];
+
+const rowsPerDay = Math.ceil(options.rows / options.days);
+await rm(options.dir, { recursive: true, force: true });
+await mkdir(options.dir, { recursive: true });
+const start = performance.now();
+for (let day = 0; day < options.days; day++) {
+  const columns = generateDay(day, rowsPerDay);
+  const key = dayKey(BENCH_EPOCH + day * DAY_MS);
+  await writePartition(options.dir, key, columns);
+  if (options.load) {
+    await loadDay(columns);
+  }
+}
+console.log(
+  `${rowsPerDay * options.days} rows in ${options.days} partitions, ` +
+    `written in ${((performance.now() - start) / 1000).toFixed(1)} s\n`
+);
+
+async function time(run) {
+  const begin = performance.now();
+  await run();
+  return performance.now() - begin;
+}
+
+const archive = createArchive({ pool: null, dir: options.dir });
+await archive.load();
+const analytics = createAnalytics({ archive });
+
+console.log(
+  "query                 archive cold   archive warm     rows/s warm" +
+    (options.load ? "     postgres" : "")
+);
+try {
+  if (options.load) {
+    await pool.query("ANALYZE data");
+  }
+  for (const { query, params, sql } of QUERIES) {
+    const parsed = parseAnalyticsQuery({
+      query,
+      params: { ...params, from, to },
+    });
+    // Cold: a fresh archive reads every partition from disk
+    const coldArchive = createArchive({ pool: null, dir: options.dir });
+    await coldArchive.load();
+    const cold = await time(() =>
+      createAnalytics({ archive: coldArchive }).run(parsed)
+    );
+    await analytics.run(parsed); // Fill the cache
+    let scanned = 0;
+    const warm = await time(async () => {
+      scanned = (await analytics.run(parsed)).rows_scanned;
+    });
+    let line =
+      `${query.padEnd(20)} ${cold.toFixed(0).padStart(10)} ms ` +
+      `${warm.toFixed(0).padStart(11)} ms ` +
+      `${((scanned / warm) * 1000).toExponential(2).padStart(15)}`;
+    if (options.load) {
+      const elapsed = await time(() => pool.query(sql, [from, to]));
+      line += ` ${elapsed.toFixed(0).padStart(9)} ms`;
+    }
+    console.log(line);
+  }
+  console.log(`\ncache: ${JSON.stringify(archive.stats())}`);
+} finally {
+  if (options.load) {
+    await pool.query("DELETE FROM data WHERE created_at >= $1", [from]);
+  }
+  await pool.end();
+  await rm(options.dir, { recursive: true, force: true });
+}
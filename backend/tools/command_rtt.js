@@ -0,0 +1,165 @@
+// Measures command round trips (enqueue to ack) through the real CoAP
+// server, command queue and pusher against simulated devices on loopback
+// UDP, and compares them with waiting for upload responses as HTTP devices
+// do.
+//
+// Usage: node tools/command_rtt.js [--devices <n>] [--commands <n>]
+//                                  [--loss <0..1>] [--upload-seconds <n>]
+//
+// A simulated device only reads its socket once per control tick, like the
+// firmware's pollCoapResponses, applies each command id once and ACKs every
+// confirmable push. loss drops packets in both directions.
+
+import dgram from "node:dgram";
+import { decodeCbor } from "../cbor.js";
+import { createCommandPusher, createCommandQueue } from "../commands.js";
+import { startCoapServer } from "../coap.js";
+import { commandFields, encodeControlBlock } from "../control.js";
+
+const SENSOR_READ_INTERVAL = 2000;
+
+const options = {
+  devices: 5,
+  commands: 4,
+  loss: 0.1,
+  uploadSeconds: 60,
+};
+
+for (let i = 2; i < process.argv.length; i += 2) {
+  const name = process.argv[i].replace(/^--/, "");
+  const key = name.replace(/-(\w)/g, (_, c) => c.toUpperCase());
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: command_rtt.js [--devices <n>] [--commands <n>] " +
+        "[--loss <0..1>] [--upload-seconds <n>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+function percentile(values, p) {
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+function summary({ mean, p95, max }) {
+  return (
+    `mean ${(mean / 1000).toFixed(1)} s, p95 ${(p95 / 1000).toFixed(1)} s, ` +
+    `max ${(max / 1000).toFixed(1)} s`
+  );
+}
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function startDevice(id) {
+  const socket = dgram.createSocket("udp4");
+  const inbox = [];
+  const device = { id, socket, applied: 0, duplicates: 0 };
+  socket.on("message", (packet, remote) => {
+    if (Math.random() >= options.loss) {
+      inbox.push({ packet, remote });
+    }
+  });
+  device.timer = setInterval(() => {
+    for (const { packet, remote } of inbox.splice(0)) {
+      const tokenLength = packet[0] & 0x0f;
+      const marker = packet.indexOf(0xff, 4 + tokenLength);
+      const control = decodeCbor(packet.subarray(marker + 1));
+      if (control[2] > device.applied) {
+        device.applied = control[2];
+      } else {
+        device.duplicates += 1;
+      }
+      const ack = Buffer.from([
+        (1 << 6) | (2 << 4) | tokenLength,
+        0x44,
+        packet[2],
+        packet[3],
+        ...packet.subarray(4, 4 + tokenLength),
+      ]);
+      if (Math.random() >= options.loss) {
+        socket.send(ack, remote.port, remote.address);
+      }
+    }
+  }, SENSOR_READ_INTERVAL);
+  return new Promise((resolve) =>
+    socket.bind(0, "127.0.0.1", () => resolve(device))
+  );
+}
+
+const coap = startCoapServer({ port: 0, routes: {} });
+await new Promise((resolve) => coap.socket.once("listening", resolve));
+
+const devices = await Promise.all(
+  Array.from({ length: options.devices }, (_, i) => startDevice(`board-${i}`))
+);
+const endpoints = new Map(
+  devices.map((device) => [
+    device.id,
+    { address: "127.0.0.1", port: device.socket.address().port },
+  ])
+);
+
+const queue = createCommandQueue();
+const push = createCommandPusher(queue, async (deviceId, command) => {
+  const payload = encodeControlBlock(commandFields(command));
+  const code = await coap.request(endpoints.get(deviceId), "command", payload);
+  return code >> 5 === 2;
+});
+
+// Commands arrive at random points of the devices' tick phase
+const pushes = [];
+for (let i = 0; i < options.commands; i++) {
+  await sleep(Math.random() * SENSOR_READ_INTERVAL * 2);
+  for (const device of devices) {
+    queue.enqueue(device.id, { command: "fan", value: true, duration: 600 });
+    pushes.push(push(device.id));
+  }
+}
+await Promise.all(pushes);
+// Commands left queued after a failed push would go out with the next
+// upload response; keep pushing, as uploads would trigger it
+while (devices.some((device) => queue.pending(device.id).length)) {
+  await Promise.all(devices.map((device) => push(device.id)));
+}
+
+const pushed = queue.stats();
+for (const device of devices) {
+  clearInterval(device.timer);
+  device.socket.close();
+}
+coap.socket.close();
+
+// HTTP devices get a command in the response to their next upload and ack
+// it with the one after that
+const uploadMs = options.uploadSeconds * 1000;
+const polled = Array.from(
+  { length: 10000 },
+  () => uploadMs * (Math.random() + 1)
+);
+
+const total = options.devices * options.commands;
+const duplicates = devices.reduce((sum, device) => sum + device.duplicates, 0);
+console.log(
+  `${options.devices} devices, ${options.commands} commands each, ` +
+    `${(options.loss * 100).toFixed(0)}% packet loss\n`
+);
+console.log(
+  `CoAP push       ${summary({
+    mean: pushed.mean_ms,
+    p95: pushed.p95_ms,
+    max: pushed.max_ms,
+  })}`
+);
+console.log(
+  `upload polling  ${summary({
+    mean: polled.reduce((a, b) => a + b, 0) / polled.length,
+    p95: percentile(polled, 0.95),
+    max: Math.max(...polled),
+  })}`
+);
+console.log(
+  `\n${pushed.acked}/${total} acked, ${duplicates} duplicate deliveries ` +
+    `ignored by id`
+);
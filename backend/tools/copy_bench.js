@@ -0,0 +1,104 @@
+// Rows per second of the prepared INSERT and the binary COPY path of db.js
+// at batch sizes from 10 to 100k rows, to place COPY_MIN_ROWS.
+//
+// Usage: node tools/copy_bench.js [--rows <total per size>] [--encode-only]
+//
+// Needs POSTGRES_URL unless --encode-only, which only times the COPY
+// encoder. Rows are written with a far-future created_at and deleted
+// afterwards.
+
+import { v4 } from "uuid";
+import { copyRows, encodeCopyBinary } from "../copy.js";
+import {
+  COLUMN_TYPES,
+  COPY_MIN_ROWS,
+  DATA_COLUMNS,
+  insertReadings,
+  pool,
+} from "../db.js";
+
+const BATCH_SIZES = [10, 100, 1000, 10000, 100000];
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+
+const options = { rows: 200000, encodeOnly: false };
+for (let i = 2; i < process.argv.length; i++) {
+  if (process.argv[i] === "--encode-only") {
+    options.encodeOnly = true;
+  } else if (process.argv[i] === "--rows" && i + 1 < process.argv.length) {
+    options.rows = Number(process.argv[++i]);
+  } else {
+    console.error("usage: copy_bench.js [--rows <n>] [--encode-only]");
+    process.exit(2);
+  }
+}
+
+function benchRows(count) {
+  return Array.from({ length: count }, (_, i) => ({
+    id: v4(),
+    created_at: new Date(BENCH_EPOCH + i * 10000).toISOString(),
+    temperature: 20 + Math.random() * 10,
+    humidity: 40 + Math.random() * 30,
+    light_intensity: Math.round(Math.random() * 999),
+    fan: false,
+    fan_led: false,
+    light: true,
+    light_led: true,
+    alram_led: false,
+    buzzer: false,
+  }));
+}
+
+// Rows per second writing options.rows rows in batches of size
+async function rate(size, write) {
+  const batches = Math.max(1, Math.floor(options.rows / size));
+  const rows = benchRows(size);
+  const start = performance.now();
+  for (let i = 0; i < batches; i++) {
+    rows.forEach((row) => (row.id = v4()));
+    await write(rows);
+  }
+  return (batches * size) / ((performance.now() - start) / 1000);
+}
+
+const format = (value) => value.toFixed(0).padStart(12);
+
+if (options.encodeOnly) {
+  console.log("batch     encode rows/s    bytes/row");
+  for (const size of BATCH_SIZES) {
+    let bytes = 0;
+    const perSecond = await rate(size, async (rows) => {
+      for (const chunk of encodeCopyBinary(rows, DATA_COLUMNS, COLUMN_TYPES)) {
+        bytes += chunk.length;
+      }
+    });
+    const batches = Math.max(1, Math.floor(options.rows / size));
+    console.log(
+      `${String(size).padEnd(7)} ${format(perSecond)}` +
+        ` ${(bytes / (batches * size)).toFixed(1).padStart(12)}`
+    );
+  }
+  process.exit(0);
+}
+
+if (!process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set (or use --encode-only)");
+  process.exit(2);
+}
+console.log(
+  `${options.rows} rows per batch size, COPY_MIN_ROWS ${COPY_MIN_ROWS}\n`
+);
+console.log("batch     INSERT rows/s  COPY rows/s");
+try {
+  for (const size of BATCH_SIZES) {
+    const insert = await rate(size, (rows) => insertReadings(rows));
+    const copy = await rate(size, (rows) =>
+      copyRows(pool, "data", rows, DATA_COLUMNS, COLUMN_TYPES)
+    );
+    console.log(`${String(size).padEnd(7)} ${format(insert)} ${format(copy)}`);
+  }
+} finally {
+  await pool.query("DELETE FROM data WHERE created_at >= $1", [
+    new Date(BENCH_EPOCH).toISOString(),
+  ]);
+  await pool.end();
+}
@@ -0,0 +1,166 @@
+// Server-side decode throughput of the upload encodings (payload.js): JSON,
+// CBOR with the firmware's integer keys, and the delta+varint batch.
+//
+// Usage: node tools/decode_bench.js [--batch <samples>] [--bodies <n>]
+//
+// Builds --bodies upload bodies of --batch slowly varying samples each,
+// encoded the way the sketch encodes them, and times decodeSensorPayload()
+// over all of them. Reported per encoding: body size, bodies and readings
+// decoded per second.
+
+import { encodeCbor } from "../cbor.js";
+import { DELTA_FORMAT_VERSION } from "../delta.js";
+import {
+  CONTENT_TYPE_CBOR,
+  CONTENT_TYPE_DELTA,
+  CONTENT_TYPE_JSON,
+  SENSOR_FIELD_KEYS,
+  decodeSensorPayload,
+} from "../payload.js";
+
+const DATA_SEND_INTERVAL_S = 10;
+const ROUNDS = 5;
+
+const options = { batch: 6, bodies: 20000 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error("usage: decode_bench.js [--batch <n>] [--bodies <n>]");
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+const FIELD_KEYS = Object.fromEntries(
+  Object.entries(SENSOR_FIELD_KEYS).map(([key, column]) => [column, key])
+);
+const FLAG_COLUMNS = [
+  "fan",
+  "fan_led",
+  "light",
+  "light_led",
+  "alram_led",
+  "buzzer",
+];
+
+// A batch as the sketch records it: aligned sample times, hundredths
+function makeBatch(start) {
+  let temperature = 2400 + Math.floor(Math.random() * 600);
+  let humidity = 5000 + Math.floor(Math.random() * 2000);
+  let light = Math.floor(Math.random() * 1000);
+  return Array.from({ length: options.batch }, (_, i) => {
+    temperature += Math.floor(Math.random() * 7) - 3;
+    humidity += Math.floor(Math.random() * 11) - 5;
+    light += Math.floor(Math.random() * 5) - 2;
+    return {
+      temperature: temperature / 100,
+      humidity: humidity / 100,
+      light_intensity: light,
+      fan: temperature >= 3000,
+      fan_led: temperature >= 3000,
+      light: light < 500,
+      light_led: light < 500,
+      alram_led: false,
+      buzzer: false,
+      sampled_at: start + i * DATA_SEND_INTERVAL_S,
+    };
+  });
+}
+
+function compact(reading) {
+  return Object.fromEntries(
+    Object.entries(reading).map(([column, value]) => [
+      Number(FIELD_KEYS[column]),
+      value,
+    ])
+  );
+}
+
+function writeVarint(out, value) {
+  while (value >= 0x80) {
+    out.push((value & 0x7f) | 0x80);
+    value = Math.floor(value / 128);
+  }
+  out.push(value);
+}
+
+const writeSigned = (out, value) =>
+  writeVarint(out, value < 0 ? -value * 2 - 1 : value * 2);
+
+// Mirrors encodeDeltaBatch() in the sketch
+function encodeDelta(batch) {
+  const out = [DELTA_FORMAT_VERSION];
+  writeVarint(out, batch.length);
+  writeVarint(out, batch[0].sampled_at);
+  const last = { time: batch[0].sampled_at, t: 0, h: 0, l: 0 };
+  for (const reading of batch) {
+    const t = Math.round(reading.temperature * 100);
+    const h = Math.round(reading.humidity * 100);
+    writeSigned(out, reading.sampled_at - last.time);
+    writeSigned(out, t - last.t);
+    writeSigned(out, h - last.h);
+    writeSigned(out, reading.light_intensity - last.l);
+    Object.assign(last, {
+      time: reading.sampled_at,
+      t,
+      h,
+      l: reading.light_intensity,
+    });
+    out.push(
+      FLAG_COLUMNS.reduce(
+        (flags, column, bit) => flags | (reading[column] ? 1 << bit : 0),
+        0
+      )
+    );
+  }
+  return Buffer.from(out);
+}
+
+const start = Math.floor(Date.now() / 1000);
+const batches = Array.from({ length: options.bodies }, (_, i) =>
+  makeBatch(start + i)
+);
+const encodings = [
+  [
+    CONTENT_TYPE_JSON,
+    (batch) => Buffer.from(JSON.stringify(batch), "utf8"),
+  ],
+  [CONTENT_TYPE_CBOR, (batch) => encodeCbor(batch.map(compact))],
+  [CONTENT_TYPE_DELTA, encodeDelta],
+];
+
+console.log(
+  `${options.bodies} bodies of ${options.batch} samples, ` +
+    `best of ${ROUNDS} rounds\n`
+);
+console.log(
+  "encoding".padEnd(30) +
+    "bytes".padStart(8) +
+    "bodies/s".padStart(12) +
+    "readings/s".padStart(13)
+);
+for (const [contentType, encode] of encodings) {
+  const bodies = batches.map(encode);
+  // Round trip check before timing
+  const first = decodeSensorPayload(contentType, bodies[0]);
+  if (first.length !== options.batch) {
+    throw new Error(`${contentType} decoded ${first.length} readings`);
+  }
+  let best = Infinity;
+  for (let round = 0; round < ROUNDS; round++) {
+    const begin = performance.now();
+    for (const body of bodies) {
+      decodeSensorPayload(contentType, body);
+    }
+    best = Math.min(best, performance.now() - begin);
+  }
+  const bytes =
+    bodies.reduce((sum, body) => sum + body.length, 0) / bodies.length;
+  const perSecond = (options.bodies / best) * 1000;
+  console.log(
+    contentType.padEnd(30) +
+      bytes.toFixed(0).padStart(8) +
+      perSecond.toFixed(0).padStart(12) +
+      (perSecond * options.batch).toFixed(0).padStart(13)
+  );
+}
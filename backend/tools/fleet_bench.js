@@ -0,0 +1,134 @@
+// Accuracy, memory and speed of the fleet summary (fleet.js) against
+// exact per-device counting.
+//
+// Usage: node tools/fleet_bench.js [--devices <n>]
+//        [--minutes <simulated>] [--window <minutes>]
+//
+// Simulates --devices boards uploading six readings once a minute. A
+// small share alarm often (heavier the lower their number), the rest
+// rarely, and half of the fleet goes silent halfway through, so the
+// window has to forget them. The summary is then compared with exact
+// counts over the same slot-aligned window, kept in a Map per device.
+
+import { createFleetSummary } from "../fleet.js";
+
+const SLOT_MINUTES = 5;
+const MINUTE_MS = 60 * 1000;
+
+const options = { devices: 100000, minutes: 150, window: 60 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: fleet_bench.js [--devices <n>] [--minutes <n>] [--window <n>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+const noisy = Math.max(1, Math.floor(options.devices / 100));
+// Alarms in an upload of six readings
+function alarmsOf(device) {
+  if (device < noisy) {
+    return Math.random() < 0.9 / (1 + device / 50) ? 6 : 0;
+  }
+  return Math.random() < 0.001 ? 1 : 0;
+}
+
+const rowsOf = (alarms) =>
+  Array.from({ length: 6 }, (_, i) => ({ alram_led: i < alarms }));
+const names = Array.from({ length: options.devices }, (_, i) => `dev-${i}`);
+
+const fleet = createFleetSummary({
+  windowMinutes: options.window,
+  slotMinutes: SLOT_MINUTES,
+});
+const events = []; // [minute, device, alarms], for the exact answer
+let uploads = 0;
+let recordMs = 0;
+const start = Date.UTC(2026, 0, 1);
+for (let minute = 0; minute < options.minutes; minute++) {
+  const active =
+    minute < options.minutes / 2 ? options.devices : options.devices / 2;
+  const batch = [];
+  for (let device = 0; device < active; device++) {
+    const alarms = alarmsOf(device);
+    batch.push([device, alarms, rowsOf(alarms)]);
+    events.push([minute, device, alarms]);
+  }
+  const begin = performance.now();
+  for (const [device, , rows] of batch) {
+    fleet.record(names[device], rows, start + minute * MINUTE_MS);
+  }
+  recordMs += performance.now() - begin;
+  uploads += batch.length;
+}
+
+// Exact counts over the slots the summary's window covers
+const lastSlot = Math.floor(
+  (start + (options.minutes - 1) * MINUTE_MS) / (SLOT_MINUTES * MINUTE_MS)
+);
+const windowStart =
+  (lastSlot - Math.ceil(options.window / SLOT_MINUTES) + 1) *
+  SLOT_MINUTES *
+  MINUTE_MS;
+let exactMs = performance.now();
+const exact = new Map();
+for (const [minute, device, alarms] of events) {
+  if (start + minute * MINUTE_MS < windowStart) {
+    continue;
+  }
+  const counts = exact.get(names[device]) ?? { readings: 0, alarms: 0 };
+  counts.readings += 6;
+  counts.alarms += alarms;
+  exact.set(names[device], counts);
+}
+const exactTop = [...exact.entries()]
+  .sort((a, b) => b[1].alarms - a[1].alarms)
+  .slice(0, 10);
+const exactAlarming = [...exact.values()].filter((c) => c.alarms).length;
+exactMs = performance.now() - exactMs;
+
+const summaryStart = performance.now();
+const summary = fleet.summary(start + (options.minutes - 1) * MINUTE_MS);
+const summaryMs = performance.now() - summaryStart;
+
+const relative = (got, want) =>
+  `${got} vs ${want} (${(((got - want) / want) * 100).toFixed(2)}%)`;
+// Ties at the tenth place count as found
+const tenth = exactTop.at(-1)?.[1].alarms ?? 0;
+const found = summary.top_alarming.filter(
+  ({ device }) => (exact.get(device)?.alarms ?? 0) >= tenth
+);
+const overcount = Math.max(
+  ...summary.top_alarming.map(
+    ({ device, count }) => count - (exact.get(device)?.alarms ?? 0)
+  )
+);
+
+console.log(
+  `${options.devices} devices, ${options.minutes} min simulated, ` +
+    `${options.window} min window, ${uploads} uploads\n`
+);
+console.log(
+  `record: ${(uploads / recordMs / 1000).toFixed(2)}M uploads/s`
+);
+console.log(
+  `devices reporting: ${relative(summary.devices_reporting, exact.size)}`
+);
+console.log(
+  `devices alarming:  ${relative(summary.devices_alarming, exactAlarming)}`
+);
+console.log(
+  `top 10 alarming: ${found.length}/10 found, ` +
+    `largest overcount ${overcount} of ${tenth}+ alarms`
+);
+console.log(
+  `memory: summary ${(fleet.memoryBytes() / 1024).toFixed(0)} KiB, ` +
+    `exact map ${exact.size} entries`
+);
+console.log(
+  `query: summary ${summaryMs.toFixed(2)} ms, ` +
+    `exact scan and sort ${exactMs.toFixed(0)} ms`
+);
@@ -0,0 +1,336 @@
+// Simulates a fleet uploading through an ingest overload, comparing the
+// firmware's old behaviour (fixed cadence, a full buffer re-sent on every
+// sample while uploads fail) with devices that follow the backend's rate
+// hints and retry-after (backpressure.js).
+//
+// Usage: node tools/overload_sim.js [--devices <n>] [--minutes <n>]
+//        [--degrade-at <minute>] [--degrade-minutes <n>]
+//        [--capacity <share during the overload>] [--max-pending <n>]
+//        [--transport http|coap]
+//
+// The backend is one FIFO writer costing WRITE_MS per request plus
+// ROW_MS per row at full capacity; for --degrade-minutes it runs at
+// --capacity of that (e.g. a database failover). Requests still queued
+// after HTTP_TIMEOUT fail on the device but are written anyway, so their
+// rows are written twice once the device re-sends them. Devices sample
+// every DATA_SEND_INTERVAL and keep SAMPLE_BUFFER_SIZE samples, dropping
+// the oldest, as the sketch does. The old firmware only uploads on its
+// sample ticks; the new one uploads at its deadline to the step, a full
+// batch goes out in the device's slot after the sample, and an upload
+// that got no answer backs off locally (UPLOAD_BACKOFF_BASE, doubling).
+//
+// With --transport coap a batch goes out non-confirmable and the device
+// waits up to COAP_RESPONSE_TIMEOUT for its response. The fixed-cadence
+// run is then replaced by the earlier CoAP firmware, which forgot a batch
+// as soon as it was sent, so every batch turned away with a 5.03 was lost.
+//
+// Reported: a timeline of offered uploads, queue delay, failed uploads
+// (timed out, or turned away with a retry-after) and the hint factor, and
+// the recovery time: how long after the capacity comes back uploads keep
+// failing.
+
+import { createBackpressure } from "../backpressure.js";
+
+const DATA_SEND_INTERVAL = 10000;
+const UPLOAD_BATCH_SIZE = 6;
+const UPLOAD_INTERVAL = DATA_SEND_INTERVAL * UPLOAD_BATCH_SIZE;
+const UPLOAD_JITTER = UPLOAD_INTERVAL / 10;
+const UPLOAD_FLUSH_SIZE = UPLOAD_BATCH_SIZE * 2;
+const MAX_UPLOAD_INTERVAL = UPLOAD_INTERVAL * 4;
+const UPLOAD_BACKOFF_BASE = UPLOAD_INTERVAL / 4;
+const HTTP_TIMEOUT = 5000;
+const COAP_RESPONSE_TIMEOUT = HTTP_TIMEOUT;
+const WRITE_MS = 2.4;
+const ROW_MS = 0.1;
+const TARGET_MS = 500;
+const STEP_MS = 100;
+const REPORT_MINUTES = 2;
+
+const options = {
+  devices: 10000,
+  minutes: 60,
+  degradeAt: 10,
+  degradeMinutes: 10,
+  capacity: 0.25,
+  maxPending: 200,
+  transport: "http",
+};
+
+for (let i = 2; i < process.argv.length; i += 2) {
+  const name = process.argv[i].replace(/^--/, "");
+  const key = name.replace(/-(\w)/g, (_, c) => c.toUpperCase());
+  const value = process.argv[i + 1];
+  if (
+    !(key in options) ||
+    i + 1 >= process.argv.length ||
+    (key === "transport" && value !== "http" && value !== "coap")
+  ) {
+    console.error(
+      "usage: overload_sim.js [--devices <n>] [--minutes <n>] " +
+        "[--degrade-at <minute>] [--degrade-minutes <n>] " +
+        "[--capacity <share>] [--max-pending <n>] [--transport http|coap]"
+    );
+    process.exit(2);
+  }
+  options[key] = key === "transport" ? value : Number(value);
+}
+
+const coap = options.transport === "coap";
+const responseTimeout = coap ? COAP_RESPONSE_TIMEOUT : HTTP_TIMEOUT;
+
+// Repeatable device phases and jitter (mulberry32); the backend's
+// retry-after spread still uses Math.random
+let seed = 1;
+function random() {
+  seed = (seed + 0x6d2b79f5) | 0;
+  let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+  t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+  return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+}
+
+const degradeStart = options.degradeAt * 60 * 1000;
+const degradeEnd = degradeStart + options.degradeMinutes * 60 * 1000;
+const capacityAt = (t) =>
+  t >= degradeStart && t < degradeEnd ? options.capacity : 1;
+
+// One run; hinted selects the new firmware and backend, forget the CoAP
+// firmware that dropped a batch once it was sent
+function simulate(hinted, forget = false) {
+  seed = 1;
+  // SAMPLE_BUFFER_SIZE before and after the sketch took hints
+  const bufferSize = hinted ? UPLOAD_BATCH_SIZE * 5 : UPLOAD_BATCH_SIZE * 2;
+  const backpressure = createBackpressure({
+    intervalMs: UPLOAD_INTERVAL,
+    batch: UPLOAD_BATCH_SIZE,
+    targetMs: TARGET_MS,
+    maxPending: options.maxPending,
+  });
+
+  // Devices by the step within DATA_SEND_INTERVAL they sample on
+  const buckets = Array.from(
+    { length: DATA_SEND_INTERVAL / STEP_MS },
+    () => []
+  );
+  for (let i = 0; i < options.devices; i++) {
+    const device = {
+      samples: 0,
+      lastUpload: 0,
+      // The new firmware draws its first upload from after a sample
+      nextDelay: (hinted ? DATA_SEND_INTERVAL : 0) + random() * UPLOAD_INTERVAL,
+      flushSize: UPLOAD_FLUSH_SIZE,
+      retryAfter: 0,
+      busyUntil: 0,
+      failures: 0,
+      slot: random() * DATA_SEND_INTERVAL, // uploadSlotOffset
+      dueStep: -1,
+    };
+    buckets[Math.floor(random() * buckets.length)].push(device);
+  }
+
+  const completions = []; // [time, started, rows], in time order (FIFO)
+  let head = 0;
+  let writerFree = 0;
+  let lastBad = 0;
+  let liftedAt = null;
+  const totals = {
+    uploads: 0,
+    failed: 0,
+    lost: 0,
+    rejected: 0,
+    written: 0,
+    twice: 0,
+  };
+  const timeline = [];
+  let period = { uploads: 0, failed: 0, delay: 0, factor: 1 };
+  // New firmware: devices by the step their upload deadline falls in; a
+  // device moved since it was filed has another dueStep and is skipped
+  const due = new Map();
+
+  function arm(device, at, step) {
+    device.dueStep = Math.max(step + 1, Math.ceil(at / STEP_MS));
+    if (!due.has(device.dueStep)) {
+      due.set(device.dueStep, []);
+    }
+    due.get(device.dueStep).push(device);
+  }
+
+  function upload(device, t) {
+    // scheduleNextUpload(): defaults until the response says otherwise
+    const jitter = (random() * 2 - 1) * UPLOAD_JITTER;
+    device.lastUpload = t;
+    device.nextDelay = UPLOAD_INTERVAL + jitter;
+    device.flushSize = UPLOAD_FLUSH_SIZE;
+    device.retryAfter = 0;
+    const rows = device.samples;
+    totals.uploads++;
+    period.uploads++;
+
+    const hints = hinted ? backpressure.hints(t) : {};
+    let ok = false;
+    if (hinted && backpressure.saturated()) {
+      // 503 right away, with a retry-after
+      device.retryAfter = Math.min(
+        backpressure.retryAfter(t),
+        MAX_UPLOAD_INTERVAL
+      );
+      if (forget) {
+        totals.rejected += rows;
+      }
+    } else {
+      const start = Math.max(t, writerFree);
+      writerFree = start + (WRITE_MS + ROW_MS * rows) / capacityAt(start);
+      completions.push([writerFree, backpressure.begin(t), rows]);
+      ok = writerFree - t <= responseTimeout;
+      device.busyUntil = forget
+        ? t
+        : Math.min(writerFree, t + responseTimeout);
+      totals.written += rows;
+      if (!ok && !forget) {
+        totals.twice += rows; // The device will send them again
+      }
+    }
+    if (ok || forget) {
+      device.samples = 0;
+      device.failures = 0;
+    }
+    if (!ok) {
+      totals.failed++;
+      period.failed++;
+    }
+    // setUploadRateHints(); a timed-out response carries nothing
+    if (hints.upload_interval && (ok || device.retryAfter)) {
+      device.nextDelay += hints.upload_interval - UPLOAD_INTERVAL;
+      device.flushSize = hints.upload_batch;
+    }
+    if (hinted && !ok && !device.retryAfter && !forget) {
+      // backOffUpload()
+      device.failures = Math.min(device.failures + 1, 8);
+      const backoff = Math.min(
+        UPLOAD_BACKOFF_BASE * 2 ** (device.failures - 1),
+        MAX_UPLOAD_INTERVAL
+      );
+      device.retryAfter = backoff / 2 + random() * (backoff / 2);
+    }
+    device.nextDelay = Math.max(device.nextDelay, device.retryAfter);
+    return ok;
+  }
+
+  const end = options.minutes * 60 * 1000;
+  for (let t = 0, step = 0; t < end; t += STEP_MS, step++) {
+    while (head < completions.length && completions[head][0] <= t) {
+      const [time, started] = completions[head++];
+      backpressure.end(started, true, time);
+    }
+
+    const send = (device) => {
+      if (!upload(device, t) && t >= degradeStart) {
+        lastBad = t;
+      }
+    };
+    for (const device of buckets[step % buckets.length]) {
+      device.samples++;
+      if (device.samples > bufferSize) {
+        device.samples = bufferSize;
+        totals.lost++;
+      }
+      const since = t - device.lastUpload;
+      if (hinted) {
+        // requestUpload(); a deadline that passed with nothing to send
+        // is served right after this sample
+        const nextDelay =
+          device.samples >= device.flushSize && since >= device.retryAfter
+            ? Math.min(device.nextDelay, since + device.slot)
+            : device.nextDelay;
+        if (nextDelay !== device.nextDelay || device.dueStep < step) {
+          device.nextDelay = nextDelay;
+          arm(device, device.lastUpload + nextDelay, step - 1);
+        }
+        continue;
+      }
+      if (t < device.busyUntil) {
+        continue;
+      }
+      const uploadDue = since >= device.nextDelay;
+      if (uploadDue || device.samples >= device.flushSize) {
+        send(device);
+      }
+    }
+
+    // serviceUpload() of the new firmware, at each device's deadline
+    for (const device of due.get(step) ?? []) {
+      if (device.dueStep !== step) {
+        continue;
+      }
+      if (t < device.busyUntil) {
+        arm(device, device.busyUntil, step);
+        continue;
+      }
+      if (device.samples === 0) {
+        continue;
+      }
+      send(device);
+      arm(device, device.lastUpload + device.nextDelay, step);
+    }
+    due.delete(step);
+
+    const delay = Math.max(0, writerFree - t);
+    const { factor } = backpressure.stats(t);
+    const lifted = !backpressure.hints(t).upload_interval;
+    if (hinted && t >= degradeEnd && liftedAt === null && lifted) {
+      liftedAt = t;
+    }
+    period.delay = Math.max(period.delay, delay);
+    period.factor = Math.max(period.factor, factor);
+    if ((t + STEP_MS) % (REPORT_MINUTES * 60 * 1000) === 0) {
+      timeline.push({ minute: (t + STEP_MS) / 60000, ...period });
+      period = { uploads: 0, failed: 0, delay: 0, factor: 1 };
+    }
+  }
+  return { hinted, forget, timeline, totals, lastBad, liftedAt, end };
+}
+
+function report(name, result) {
+  const { hinted, forget, timeline, totals, lastBad, liftedAt, end } = result;
+  console.log(`${name}\n  min  uploads/s  max delay  failed  factor`);
+  for (const row of timeline) {
+    const seconds = REPORT_MINUTES * 60;
+    console.log(
+      `  ${String(row.minute).padStart(3)}` +
+        `${(row.uploads / seconds).toFixed(0).padStart(11)}` +
+        `${(row.delay / 1000).toFixed(1).padStart(10)} s` +
+        `${((100 * row.failed) / Math.max(1, row.uploads))
+          .toFixed(0)
+          .padStart(7)}%` +
+        `${(hinted ? row.factor.toFixed(2) : "-").padStart(8)}`
+    );
+  }
+  const recovery =
+    lastBad >= end - REPORT_MINUTES * 60 * 1000
+      ? "not recovered by the end of the run"
+      : `${(Math.max(0, lastBad - degradeEnd) / 1000).toFixed(0)} s`;
+  const lifted =
+    liftedAt === null
+      ? ""
+      : `; hints lifted after ${((liftedAt - degradeEnd) / 1000).toFixed(0)} s`;
+  console.log(`  recovery after capacity returns: ${recovery}${lifted}`);
+  console.log(
+    `  ${totals.uploads} uploads, ${totals.failed} failed, ` +
+      `${totals.lost} samples dropped from full buffers, ` +
+      (forget ? `${totals.rejected} rows lost to 5.03s, ` : "") +
+      `${totals.twice} of ${totals.written} rows written twice\n`
+  );
+}
+
+console.log(
+  `${options.devices} devices over ${options.transport}, ` +
+    `${options.minutes} min; writer at ` +
+    `${options.capacity * 100}% capacity from minute ${options.degradeAt} ` +
+    `for ${options.degradeMinutes} min\n`
+);
+if (coap) {
+  report("rate hints, batches forgotten once sent", simulate(true, true));
+  report("rate hints, batches kept until a 2.xx", simulate(true));
+} else {
+  report("fixed cadence (no hints)", simulate(false));
+  report("rate hints and retry-after", simulate(true));
+}
@@ -0,0 +1,186 @@
+// Compares the hot-path queries through the Supabase REST client with the
+// pooled named statements of db.js, and with the same SQL sent unprepared,
+// against a local database (e.g. `supabase start`, which serves both).
+//
+// Usage: node tools/pg_bench.js [--iterations <n>] [--concurrency <n>]
+//                               [--batch <rows>]
+//
+// Needs POSTGRES_URL, plus SUPABASE_URL and SUPABASE_KEY for the REST
+// path. Inserted rows are tagged with a far-future created_at and deleted
+// afterwards.
+
+import { v4 } from "uuid";
+import { supabase } from "../supabase.js";
+import {
+  DATA_COLUMNS,
+  insertReadings,
+  pool,
+  readingBuckets,
+  recentReadings,
+} from "../db.js";
+
+const options = {
+  iterations: 500,
+  concurrency: 8,
+  batch: 6,
+};
+
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: pg_bench.js [--iterations <n>] [--concurrency <n>] " +
+        "[--batch <rows>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+
+function benchRows() {
+  return Array.from({ length: options.batch }, (_, i) => ({
+    id: v4(),
+    created_at: new Date(BENCH_EPOCH + i * 10000).toISOString(),
+    temperature: 20 + Math.random() * 10,
+    humidity: 40 + Math.random() * 30,
+    light_intensity: Math.round(Math.random() * 4095),
+    fan: false,
+    fan_led: false,
+    light: true,
+    light_led: true,
+    alram_led: false,
+    buzzer: false,
+  }));
+}
+
+async function rest(query) {
+  const { data, error } = await query;
+  if (error) {
+    throw new Error(error.message);
+  }
+  return data;
+}
+
+// Same SQL as db.js without a statement name, parsed and planned each time
+async function unprepared(statement, values) {
+  const { rows } = await pool.query(statement, values);
+  return rows;
+}
+
+const insertSql = `INSERT INTO data (${DATA_COLUMNS.join(", ")})
+  SELECT * FROM unnest($1::uuid[], $2::timestamptz[], $3::numeric[],
+    $4::numeric[], $5::numeric[], $6::boolean[], $7::boolean[],
+    $8::boolean[], $9::boolean[], $10::boolean[], $11::boolean[])
+  RETURNING *`;
+const recentSql = `SELECT * FROM data
+  WHERE created_at >= now() - make_interval(mins => $1)
+  ORDER BY created_at DESC LIMIT $2`;
+const bucketsSql = `SELECT to_timestamp(floor(extract(epoch FROM created_at)
+    / $1) * $1) AS bucket, count(*)::int AS readings,
+    avg(temperature) AS temperature, max(temperature) AS max_temperature,
+    avg(humidity) AS humidity, avg(light_intensity) AS light_intensity
+  FROM data WHERE created_at >= now() - make_interval(mins => $2)
+  GROUP BY bucket ORDER BY bucket`;
+
+const paths = {
+  rest: {
+    insert: () => rest(supabase.from("data").insert(benchRows()).select()),
+    recent: () =>
+      rest(
+        supabase
+          .from("data")
+          .select("*")
+          .gte("created_at", new Date(Date.now() - 10 * 60000).toISOString())
+          .order("created_at", { ascending: false })
+          .limit(1000)
+      ),
+    // PostgREST has no GROUP BY; dashboards fetched the rows and bucketed
+    // them client side
+    buckets: () =>
+      rest(
+        supabase
+          .from("data")
+          .select("created_at, temperature, humidity, light_intensity")
+          .gte("created_at", new Date(Date.now() - 60 * 60000).toISOString())
+      ),
+  },
+  unprepared: {
+    insert: () => {
+      const rows = benchRows();
+      return unprepared(
+        insertSql,
+        DATA_COLUMNS.map((column) => rows.map((row) => row[column]))
+      );
+    },
+    recent: () => unprepared(recentSql, [10, 1000]),
+    buckets: () => unprepared(bucketsSql, [10, 60]),
+  },
+  prepared: {
+    insert: () => insertReadings(benchRows()),
+    recent: () => recentReadings(10, 1000),
+    buckets: () => readingBuckets(10, 60),
+  },
+};
+
+function percentile(sorted, p) {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+async function run(operation) {
+  const latencies = [];
+  let next = 0;
+  const start = performance.now();
+  await Promise.all(
+    Array.from({ length: options.concurrency }, async () => {
+      while (next++ < options.iterations) {
+        const t0 = performance.now();
+        await operation();
+        latencies.push(performance.now() - t0);
+      }
+    })
+  );
+  const elapsed = (performance.now() - start) / 1000;
+  latencies.sort((a, b) => a - b);
+  return {
+    p50: percentile(latencies, 0.5),
+    p95: percentile(latencies, 0.95),
+    perSecond: options.iterations / elapsed,
+  };
+}
+
+if (!process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set");
+  process.exit(2);
+}
+if (!process.env.SUPABASE_URL) {
+  console.log("SUPABASE_URL is not set, skipping the REST path\n");
+  delete paths.rest;
+}
+
+console.log(
+  `${options.iterations} iterations, concurrency ${options.concurrency}, ` +
+    `${options.batch} rows per insert, pool of ${pool.options.max}\n`
+);
+console.log("path        query      p50 ms    p95 ms     ops/s");
+try {
+  for (const [name, operations] of Object.entries(paths)) {
+    for (const [query, operation] of Object.entries(operations)) {
+      await operation(); // Warm up connections and statement caches
+      const result = await run(operation);
+      console.log(
+        `${name.padEnd(11)} ${query.padEnd(8)} ${result.p50
+          .toFixed(2)
+          .padStart(8)} ${result.p95.toFixed(2).padStart(9)} ${result.perSecond
+          .toFixed(0)
+          .padStart(9)}`
+      );
+    }
+  }
+} finally {
+  await pool.query("DELETE FROM data WHERE created_at >= $1", [
+    new Date(BENCH_EPOCH).toISOString(),
+  ]);
+  await pool.end();
+}
@@ -0,0 +1,135 @@
+// Cost and detection delay of device presence tracking (presence.js) in
+// simulated time.
+//
+// Usage: node tools/presence_bench.js [--devices <n>]
+//        [--minutes <simulated>] [--silent <share>]
+//
+// Simulates --devices boards uploading once a minute with a few seconds
+// of jitter. Halfway through, --silent of them stop; every one should be
+// reported offline once three of its learned intervals have passed, and
+// no other. The wheel is advanced every simulated second, as the server's
+// timer does.
+
+import { createPresenceTracker } from "../presence.js";
+
+const INTERVAL_MS = 60 * 1000;
+const MISS_FACTOR = 3;
+const JITTER_MS = 5000;
+
+const options = { devices: 100000, minutes: 20, silent: 0.1 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: presence_bench.js [--devices <n>] [--minutes <n>] " +
+        "[--silent <share>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+const names = Array.from({ length: options.devices }, (_, i) => `dev-${i}`);
+const silentCount = Math.floor(options.devices * options.silent);
+const silentAt = Math.floor(options.minutes / 2) * INTERVAL_MS;
+const lastUpload = new Map(); // Device -> time of its last upload
+const wentOffline = new Map(); // Device -> time reported offline
+
+const presence = createPresenceTracker({
+  intervalMs: INTERVAL_MS,
+  missFactor: MISS_FACTOR,
+  onTransition: ({ device, state, at }) => {
+    if (state === "offline") {
+      wentOffline.set(device, Date.parse(at));
+    }
+  },
+});
+
+// Upload times: each device keeps a phase within the minute and jitters
+// around it, so uploads spread over the interval as a real fleet's do
+const start = Date.UTC(2026, 0, 1);
+const phases = names.map(() => Math.random() * INTERVAL_MS);
+const uploads = []; // [time, device], in time order per second
+for (let minute = 0; minute < options.minutes; minute++) {
+  for (let device = 0; device < options.devices; device++) {
+    const at =
+      minute * INTERVAL_MS + phases[device] + Math.random() * JITTER_MS;
+    if (device < silentCount && at >= silentAt) {
+      continue;
+    }
+    uploads.push([start + Math.floor(at), device]);
+  }
+}
+uploads.sort((a, b) => a[0] - b[0]);
+
+const heapBefore = process.memoryUsage().heapUsed;
+let seenMs = 0;
+let advanceMs = 0;
+let worstTickMs = 0;
+let next = 0;
+const end = start + options.minutes * INTERVAL_MS;
+for (let now = start; now < end; now += 1000) {
+  let begin = performance.now();
+  for (; next < uploads.length && uploads[next][0] < now + 1000; next++) {
+    const [at, device] = uploads[next];
+    presence.seen(names[device], at);
+    lastUpload.set(device, at);
+  }
+  seenMs += performance.now() - begin;
+  begin = performance.now();
+  presence.advance(now + 1000);
+  const tickMs = performance.now() - begin;
+  advanceMs += tickMs;
+  worstTickMs = Math.max(worstTickMs, tickMs);
+}
+const heapBytes = process.memoryUsage().heapUsed - heapBefore;
+
+// Delay between a silent device's deadline and its offline report
+const delays = [];
+let wrong = 0;
+for (let device = 0; device < options.devices; device++) {
+  const reported = wentOffline.get(names[device]);
+  if (device >= silentCount) {
+    wrong += reported !== undefined;
+    continue;
+  }
+  if (reported === undefined) {
+    wrong++;
+    continue;
+  }
+  const expected = presence.device(names[device], end).expected_interval_ms;
+  delays.push(reported - lastUpload.get(device) - MISS_FACTOR * expected);
+}
+delays.sort((a, b) => a - b);
+
+let statusMs = performance.now();
+const status = presence.status({ state: "offline", limit: 100 }, end);
+statusMs = performance.now() - statusMs;
+let allMs = performance.now();
+presence.status({ limit: 100 }, end);
+allMs = performance.now() - allMs;
+
+const ticks = (end - start) / 1000;
+console.log(
+  `${options.devices} devices, ${options.minutes} min simulated, ` +
+    `${silentCount} go silent, ${uploads.length} uploads\n`
+);
+console.log(
+  `seen: ${(uploads.length / seenMs / 1000).toFixed(2)}M uploads/s`
+);
+console.log(
+  `advance: ${((advanceMs / ticks) * 1000).toFixed(1)} us/tick average, ` +
+    `${worstTickMs.toFixed(2)} ms worst tick`
+);
+console.log(
+  `offline: ${status.offline} reported, ${wrong} wrong or missed; ` +
+    `delay after deadline ${delays[0] ?? "-"}..${delays.at(-1) ?? "-"} ms`
+);
+console.log(
+  `memory: ~${Math.round(heapBytes / options.devices)} B/device ` +
+    `(heap growth, includes the bench's own map)`
+);
+console.log(
+  `status: offline list ${statusMs.toFixed(2)} ms, ` +
+    `full list ${allMs.toFixed(2)} ms`
+);
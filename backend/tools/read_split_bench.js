@@ -0,0 +1,123 @@
+// Ingest latency while dashboards poll, with their reads on the primary,
+// on a replica and on the in-memory read model (see reads.js).
+//
+// Usage: node tools/read_split_bench.js [--seconds <per phase>]
+//        [--dashboards <concurrent readers>] [--batch <rows per write>]
+//
+// Needs POSTGRES_URL; the replica phase also needs POSTGRES_READ_URL and
+// is skipped without it. Each phase writes --batch rows back to back for
+// --seconds while --dashboards loops run the recent-readings and bucket
+// queries. Rows use a far-future created_at and are deleted after.
+
+import { v4 } from "uuid";
+import { pool, readPool, writeRows } from "../db.js";
+import { createReadModel } from "../readmodel.js";
+import { createReadPath } from "../reads.js";
+
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+
+const options = { seconds: 20, dashboards: 8, batch: 50 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: read_split_bench.js [--seconds <n>] [--dashboards <n>]" +
+        " [--batch <rows>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+if (!process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set");
+  process.exit(2);
+}
+
+let rowIndex = 0;
+function benchRows(count) {
+  return Array.from({ length: count }, () => ({
+    id: v4(),
+    created_at: new Date(BENCH_EPOCH + rowIndex++ * 10000).toISOString(),
+    temperature: 20 + Math.random() * 10,
+    humidity: 40 + Math.random() * 30,
+    light_intensity: Math.round(Math.random() * 999),
+    fan: false,
+    fan_led: false,
+    light: true,
+    light_led: true,
+    alram_led: false,
+    buzzer: false,
+  }));
+}
+
+function percentile(sorted, p) {
+  return sorted.length
+    ? sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+    : 0;
+}
+
+async function phase(mode) {
+  const readModel = mode === "memory" ? createReadModel() : null;
+  const reads = createReadPath({ mode, readModel });
+  await reads.ready;
+  if (mode === "replica") {
+    // Let the first lag sample land before reads are routed
+    await new Promise((resolve) => setTimeout(resolve, 2500));
+  }
+
+  const deadline = performance.now() + options.seconds * 1000;
+  const sources = {};
+  let queries = 0;
+  const dashboards = Array.from({ length: options.dashboards }, async () => {
+    while (performance.now() < deadline) {
+      for (const result of [
+        await reads.recent(10, 1000),
+        await reads.buckets(10, 60),
+      ]) {
+        sources[result.source] = (sources[result.source] ?? 0) + 1;
+        queries++;
+      }
+    }
+  });
+
+  const latencies = [];
+  while (performance.now() < deadline) {
+    const start = performance.now();
+    const written = await writeRows(benchRows(options.batch));
+    latencies.push(performance.now() - start);
+    readModel?.apply(written, BENCH_EPOCH + rowIndex * 10000);
+  }
+  await Promise.all(dashboards);
+
+  latencies.sort((a, b) => a - b);
+  console.log(
+    `${mode.padEnd(8)} ${String(latencies.length).padStart(7)} ` +
+      `${percentile(latencies, 0.5).toFixed(1).padStart(9)} ` +
+      `${percentile(latencies, 0.99).toFixed(1).padStart(9)} ` +
+      `${(queries / options.seconds).toFixed(0).padStart(9)}  ` +
+      Object.entries(sources)
+        .map(([source, count]) => `${source}=${count}`)
+        .join(" ")
+  );
+}
+
+console.log(
+  `${options.dashboards} dashboards, ${options.batch}-row writes, ` +
+    `${options.seconds} s per phase\n`
+);
+console.log("reads     writes  write p50  write p99  queries/s  answered by");
+try {
+  await phase("primary");
+  if (readPool !== pool) {
+    await phase("replica");
+  }
+  await phase("memory");
+} finally {
+  await pool.query("DELETE FROM data WHERE created_at >= $1", [
+    new Date(BENCH_EPOCH).toISOString(),
+  ]);
+  await pool.end();
+  if (readPool !== pool) {
+    await readPool.end();
+  }
+}
@@ -0,0 +1,236 @@
+// Accuracy, size and speed of the per-device quantile sketches against
+// exact percentiles.
+//
+// Usage: node tools/sketch_bench.js [--devices <n>] [--zones <n>]
+//        [--hours <n>] [--alpha <relative error>] [--load]
+//
+// Simulates --devices boards in --zones zones reporting every 10 s for
+// --hours hours, builds one sketch per device, hour and metric as ingest
+// does, then answers p50/p95/p99 temperature per zone per hour by merging
+// sketches and, exactly, by sorting the raw readings. With --load and
+// POSTGRES_URL the readings and sketches are also written to Postgres
+// (far-future timestamps, deleted afterwards) and the fleet-wide hourly
+// query is timed against percentile_disc over `data`.
+
+import { v4 } from "uuid";
+import { copyRows } from "../copy.js";
+import { COLUMN_TYPES, DATA_COLUMNS, pool } from "../db.js";
+import { createQuantileStore, SKETCH_TABLE } from "../quantiles.js";
+import {
+  createSketch,
+  encodeSketch,
+  sketchAdd,
+  sketchMerge,
+  sketchQuantile,
+} from "../sketch.js";
+
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+const HOUR_MS = 60 * 60 * 1000;
+const SAMPLE_MS = 10000;
+const QUANTILES = [50, 95, 99];
+
+const options = { devices: 1000, zones: 10, hours: 24, alpha: 0.01 };
+let load = false;
+for (let i = 2; i < process.argv.length; i++) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (key === "load") {
+    load = true;
+  } else if (key in options && i + 1 < process.argv.length) {
+    options[key] = Number(process.argv[++i]);
+  } else {
+    console.error(
+      "usage: sketch_bench.js [--devices <n>] [--zones <n>] [--hours <n>]" +
+        " [--alpha <a>] [--load]"
+    );
+    process.exit(2);
+  }
+}
+if (load && !process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set");
+  process.exit(2);
+}
+
+const perHour = HOUR_MS / SAMPLE_MS;
+const zoneOf = (device) => device % options.zones;
+
+// Readings in hundredths like numeric(5,2): a per-device baseline, a
+// diurnal swing, noise and a rare spike so the tails are not trivial
+function temperatureAt(device, hour) {
+  const base = 18 + (device % 17) * 0.6;
+  const swing = 5 * Math.sin((hour / 24) * 2 * Math.PI);
+  const spike = Math.random() < 0.002 ? 15 * Math.random() : 0;
+  return (
+    Math.round((base + swing + (Math.random() - 0.5) * 3 + spike) * 100) / 100
+  );
+}
+
+// Sketches per device and hour, and the raw values per zone and hour
+const sketches = []; // [hour][device]
+const exact = []; // [hour][zone] -> Float64Array
+let sketchBytes = 0;
+let readings = 0;
+const buildStart = performance.now();
+for (let hour = 0; hour < options.hours; hour++) {
+  const byDevice = [];
+  const byZone = Array.from(
+    { length: options.zones },
+    (_, zone) =>
+      new Float64Array(
+        perHour * Math.ceil((options.devices - zone) / options.zones)
+      )
+  );
+  const filled = new Array(options.zones).fill(0);
+  for (let device = 0; device < options.devices; device++) {
+    const sketch = createSketch(options.alpha);
+    const zone = zoneOf(device);
+    for (let sample = 0; sample < perHour; sample++) {
+      const value = temperatureAt(device, hour);
+      sketchAdd(sketch, value);
+      byZone[zone][filled[zone]++] = value;
+    }
+    sketchBytes += encodeSketch(sketch).length;
+    byDevice.push(sketch);
+  }
+  readings += options.devices * perHour;
+  sketches.push(byDevice);
+  exact.push(byZone);
+}
+const buildSeconds = (performance.now() - buildStart) / 1000;
+
+// Per zone and hour: merge the zone's device sketches
+let start = performance.now();
+const approximate = [];
+for (let hour = 0; hour < options.hours; hour++) {
+  const merged = Array.from({ length: options.zones }, () =>
+    createSketch(options.alpha)
+  );
+  sketches[hour].forEach((sketch, device) =>
+    sketchMerge(merged[zoneOf(device)], sketch)
+  );
+  approximate.push(
+    merged.map((sketch) =>
+      QUANTILES.map((q) => sketchQuantile(sketch, q / 100))
+    )
+  );
+}
+const sketchMs = performance.now() - start;
+
+// Same answers exactly: sort each zone-hour, take rank floor(q * (n - 1))
+start = performance.now();
+const truth = exact.map((byZone) =>
+  byZone.map((values) => {
+    const sorted = values.slice().sort();
+    return QUANTILES.map(
+      (q) => sorted[Math.floor((q / 100) * (sorted.length - 1))]
+    );
+  })
+);
+const exactMs = performance.now() - start;
+
+const errors = QUANTILES.map(() => ({ max: 0, sum: 0, count: 0 }));
+for (let hour = 0; hour < options.hours; hour++) {
+  for (let zone = 0; zone < options.zones; zone++) {
+    QUANTILES.forEach((q, k) => {
+      const want = truth[hour][zone][k];
+      const got = approximate[hour][zone][k];
+      const error = Math.abs(got - want) / Math.abs(want);
+      errors[k].max = Math.max(errors[k].max, error);
+      errors[k].sum += error;
+      errors[k].count++;
+    });
+  }
+}
+
+console.log(
+  `${options.devices} devices, ${options.zones} zones, ${options.hours} h, ` +
+    `${readings} readings, alpha ${options.alpha}\n`
+);
+console.log(
+  `sketches built in ${buildSeconds.toFixed(1)} s ` +
+    `(${(readings / buildSeconds / 1e6).toFixed(1)}M readings/s), ` +
+    `${(sketchBytes / (options.devices * options.hours)).toFixed(1)} bytes ` +
+    `per device-hour vs ${perHour * 8} raw`
+);
+console.log(
+  `zone x hour p50/p95/p99: sketch merge ${sketchMs.toFixed(0)} ms, ` +
+    `exact sort ${exactMs.toFixed(0)} ms\n`
+);
+console.log("quantile  mean rel. error  max rel. error  bound");
+QUANTILES.forEach((q, k) => {
+  console.log(
+    `p${String(q).padEnd(8)} ${(errors[k].sum / errors[k].count)
+      .toExponential(2)
+      .padStart(15)} ${errors[k].max.toExponential(2).padStart(15)} ` +
+      `${options.alpha.toExponential(2).padStart(6)}`
+  );
+});
+
+if (load) {
+  const store = createQuantileStore({ pool, alpha: options.alpha });
+  const from = new Date(BENCH_EPOCH);
+  const to = new Date(BENCH_EPOCH + options.hours * HOUR_MS);
+  try {
+    await store.start();
+    store.stop();
+    for (let hour = 0; hour < options.hours; hour++) {
+      for (let device = 0; device < options.devices; device++) {
+        const rows = [];
+        for (let sample = 0; sample < perHour; sample++) {
+          rows.push({
+            id: v4(),
+            created_at: new Date(
+              BENCH_EPOCH + hour * HOUR_MS + sample * SAMPLE_MS
+            ).toISOString(),
+            temperature: temperatureAt(device, hour),
+            humidity: 50,
+            light_intensity: 100,
+            fan: false,
+            fan_led: false,
+            light: false,
+            light_led: false,
+            alram_led: false,
+            buzzer: false,
+          });
+        }
+        store.record(`bench-${device}`, rows);
+        await copyRows(pool, "data", rows, DATA_COLUMNS, COLUMN_TYPES);
+      }
+    }
+    await store.flush(Infinity);
+    await pool.query("ANALYZE data");
+
+    const timeQuery = async (run) => {
+      const begin = performance.now();
+      await run();
+      return performance.now() - begin;
+    };
+    const sqlMs = await timeQuery(() =>
+      pool.query(
+        `SELECT date_trunc('hour', created_at) AS hour,
+                percentile_disc(ARRAY[0.5, 0.95, 0.99])
+                  WITHIN GROUP (ORDER BY temperature)
+           FROM data WHERE created_at >= $1 AND created_at < $2
+          GROUP BY hour`,
+        [from, to]
+      )
+    );
+    const storeMs = await timeQuery(() =>
+      store.query({
+        metric: "temperature",
+        quantiles: QUANTILES,
+        group: "fleet",
+        intervalSeconds: 3600,
+        from: from.getTime(),
+        to: to.getTime(),
+      })
+    );
+    console.log(
+      `\nfleet x hour from Postgres: percentile_disc ${sqlMs.toFixed(0)} ms,` +
+        ` stored sketches ${storeMs.toFixed(0)} ms`
+    );
+  } finally {
+    await pool.query("DELETE FROM data WHERE created_at >= $1", [from]);
+    await pool.query(`DELETE FROM ${SKETCH_TABLE} WHERE bucket >= $1`, [from]);
+  }
+}
+await pool.end();
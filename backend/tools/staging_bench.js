@@ -0,0 +1,137 @@
+// Burst ingest straight into `data` vs through the unlogged staging table,
+// and what each does to dashboard query latency meanwhile.
+//
+// Usage: node tools/staging_bench.js [--rows <n>] [--batch <rows>]
+//
+// Needs POSTGRES_URL. Each phase writes --rows rows in COPY batches while
+// a dashboard loop runs the recent-readings and bucket queries; the
+// staging phase then measures the merger draining the table with the same
+// loop running. Rows use a far-future created_at and are deleted after.
+
+import { v4 } from "uuid";
+import { copyRows } from "../copy.js";
+import {
+  COLUMN_TYPES,
+  DATA_COLUMNS,
+  pool,
+  readingBuckets,
+  recentReadings,
+} from "../db.js";
+import { createStagingMerger, STAGING_TABLE } from "../staging.js";
+
+const BENCH_EPOCH = Date.parse("2100-01-01T00:00:00Z");
+
+const options = { rows: 500000, batch: 10000 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error("usage: staging_bench.js [--rows <n>] [--batch <rows>]");
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+if (!process.env.POSTGRES_URL) {
+  console.error("POSTGRES_URL is not set");
+  process.exit(2);
+}
+
+let rowIndex = 0;
+function benchRows(count) {
+  return Array.from({ length: count }, () => ({
+    id: v4(),
+    // Devices drain out of order; created_at is shuffled within an hour
+    created_at: new Date(
+      BENCH_EPOCH + (rowIndex++ % 360) * 10000 + Math.random() * 3600000
+    ).toISOString(),
+    temperature: 20 + Math.random() * 10,
+    humidity: 40 + Math.random() * 30,
+    light_intensity: Math.round(Math.random() * 999),
+    fan: false,
+    fan_led: false,
+    light: true,
+    light_led: true,
+    alram_led: false,
+    buzzer: false,
+  }));
+}
+
+function percentile(sorted, p) {
+  return sorted.length
+    ? sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))]
+    : 0;
+}
+
+// Runs dashboard queries back to back until stop() and reports latencies
+function dashboardLoop() {
+  const latencies = [];
+  let running = true;
+  const done = (async () => {
+    while (running) {
+      const start = performance.now();
+      await recentReadings(10, 1000);
+      await readingBuckets(10, 60);
+      latencies.push(performance.now() - start);
+    }
+  })();
+  return async () => {
+    running = false;
+    await done;
+    latencies.sort((a, b) => a - b);
+    return {
+      p50: percentile(latencies, 0.5),
+      p95: percentile(latencies, 0.95),
+    };
+  };
+}
+
+async function burst(table) {
+  const stop = dashboardLoop();
+  const start = performance.now();
+  for (let written = 0; written < options.rows; written += options.batch) {
+    const rows = benchRows(options.batch);
+    await copyRows(pool, table, rows, DATA_COLUMNS, COLUMN_TYPES);
+  }
+  const seconds = (performance.now() - start) / 1000;
+  return { rate: options.rows / seconds, seconds, queries: await stop() };
+}
+
+function report(name, result) {
+  console.log(
+    `${name.padEnd(16)} ${result.rate.toFixed(0).padStart(10)} ` +
+      `${result.seconds.toFixed(1).padStart(8)} ` +
+      `${result.queries.p50.toFixed(1).padStart(9)} ` +
+      `${result.queries.p95.toFixed(1).padStart(9)}`
+  );
+}
+
+const merger = createStagingMerger({ pool });
+try {
+  await merger.start();
+  merger.stop(); // Merged explicitly below
+
+  const idle = dashboardLoop();
+  await new Promise((resolve) => setTimeout(resolve, 5000));
+  const idleQueries = await idle();
+
+  console.log(`${options.rows} rows in COPY batches of ${options.batch}\n`);
+  console.log("phase              rows/s  seconds  query p50  query p95");
+  report("idle", { rate: 0, seconds: 5, queries: idleQueries });
+  report("direct burst", await burst("data"));
+  report("staged burst", await burst(STAGING_TABLE));
+
+  const stop = dashboardLoop();
+  const start = performance.now();
+  await merger.merge();
+  const seconds = (performance.now() - start) / 1000;
+  report("merge", {
+    rate: merger.stats().merged_rows / seconds,
+    seconds,
+    queries: await stop(),
+  });
+} finally {
+  await pool.query("DELETE FROM data WHERE created_at >= $1", [
+    new Date(BENCH_EPOCH).toISOString(),
+  ]);
+  await pool.query(`TRUNCATE ${STAGING_TABLE}`);
+  await pool.end();
+}
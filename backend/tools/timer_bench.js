@@ -0,0 +1,175 @@
+// Cost of the shared timer wheel (timerwheel.js) against one native
+// setTimeout per timer, at --timers pending timers.
+//
+// Usage: node --expose-gc tools/timer_bench.js [--timers <n>]
+//        [--tick <ms>]
+//
+// Measures, for each side: arming the timers with deadlines spread over
+// an hour, moving every one of them (what an upload does to a device's
+// heartbeat deadline), cancelling them all, the heap each pending timer
+// holds, and firing the timers when they all come due within two
+// seconds: the time from arming the first to running the last, and the
+// largest lateness (arming a million timers takes long enough that the
+// earliest are already due). Without --expose-gc the heap figures are
+// skipped.
+
+import { createTimerWheel } from "../timerwheel.js";
+
+const HOUR_MS = 60 * 60 * 1000;
+const FIRE_WINDOW_MS = 2000;
+
+const options = { timers: 1000000, tick: 10 };
+for (let i = 2; i < process.argv.length; i += 2) {
+  const key = process.argv[i].replace(/^--/, "");
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error("usage: timer_bench.js [--timers <n>] [--tick <ms>]");
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+const n = options.timers;
+const delays = Array.from({ length: n }, () =>
+  Math.floor(1000 + Math.random() * HOUR_MS)
+);
+const moved = delays.map((delay) => delay + Math.floor(Math.random() * 60000));
+const noop = () => {};
+
+function heapUsed() {
+  global.gc();
+  return process.memoryUsage().heapUsed;
+}
+
+function timed(fn) {
+  const begin = performance.now();
+  fn();
+  return performance.now() - begin;
+}
+
+// Per-operation rate in millions per second
+const rate = (ms) => `${(n / ms / 1000).toFixed(2)}M/s`;
+
+function nativeCosts() {
+  const handles = new Array(n);
+  const before = global.gc ? heapUsed() : 0;
+  const schedule = timed(() => {
+    for (let i = 0; i < n; i++) {
+      handles[i] = setTimeout(noop, delays[i]);
+    }
+  });
+  const bytes = global.gc ? (heapUsed() - before) / n : null;
+  const move = timed(() => {
+    for (let i = 0; i < n; i++) {
+      clearTimeout(handles[i]);
+      handles[i] = setTimeout(noop, moved[i]);
+    }
+  });
+  const cancel = timed(() => {
+    for (let i = 0; i < n; i++) {
+      clearTimeout(handles[i]);
+    }
+  });
+  return { schedule, move, cancel, bytes };
+}
+
+function wheelCosts() {
+  const wheel = createTimerWheel({ tickMs: options.tick });
+  const now = Date.now();
+  wheel.advance(now);
+  const handles = new Array(n);
+  const before = global.gc ? heapUsed() : 0;
+  const schedule = timed(() => {
+    for (let i = 0; i < n; i++) {
+      handles[i] = wheel.schedule(now + delays[i], noop, i);
+    }
+  });
+  const bytes = global.gc ? (heapUsed() - before) / n : null;
+  const move = timed(() => {
+    for (let i = 0; i < n; i++) {
+      wheel.reschedule(handles[i], now + moved[i]);
+    }
+  });
+  const cancel = timed(() => {
+    for (let i = 0; i < n; i++) {
+      wheel.cancel(handles[i]);
+    }
+  });
+  return { schedule, move, cancel, bytes };
+}
+
+// Arms n timers due within FIRE_WINDOW_MS and waits for all of them;
+// returns the wall time and the largest lateness
+function fire(arm) {
+  return new Promise((resolve) => {
+    const start = performance.now();
+    let left = n;
+    let late = 0;
+    const done = (due) => {
+      late = Math.max(late, performance.now() - due);
+      if (--left === 0) {
+        resolve({ total: performance.now() - start, late });
+      }
+    };
+    arm(start, done);
+  });
+}
+
+function fireNative() {
+  return fire((start, done) => {
+    for (let i = 0; i < n; i++) {
+      const delay = Math.random() * FIRE_WINDOW_MS;
+      setTimeout(() => done(start + delay), delay);
+    }
+  });
+}
+
+async function fireWheel() {
+  const wheel = createTimerWheel({ tickMs: options.tick });
+  wheel.advance(Date.now());
+  // The wheel's own timer is unref'd, so the bench keeps a ref'd one
+  const driver = setInterval(() => wheel.advance(), options.tick);
+  const result = await fire((start, done) => {
+    const offset = Date.now() - start;
+    for (let i = 0; i < n; i++) {
+      const due = start + Math.random() * FIRE_WINDOW_MS;
+      wheel.schedule(due + offset, done, due);
+    }
+  });
+  clearInterval(driver);
+  return result;
+}
+
+const native = nativeCosts();
+const wheel = wheelCosts();
+const nativeFire = await fireNative();
+const wheelFire = await fireWheel();
+
+console.log(
+  `${n} timers, wheel tick ${options.tick} ms` +
+    (global.gc ? "" : " (run with --expose-gc for heap figures)") +
+    "\n"
+);
+const rows = [
+  ["", "setTimeout", "wheel"],
+  ["schedule", rate(native.schedule), rate(wheel.schedule)],
+  ["move", rate(native.move), rate(wheel.move)],
+  ["cancel", rate(native.cancel), rate(wheel.cancel)],
+  [
+    "heap/timer",
+    native.bytes === null ? "-" : `${native.bytes.toFixed(0)} B`,
+    wheel.bytes === null ? "-" : `${wheel.bytes.toFixed(0)} B`,
+  ],
+  [
+    "fire all",
+    `${nativeFire.total.toFixed(0)} ms`,
+    `${wheelFire.total.toFixed(0)} ms`,
+  ],
+  [
+    "latest",
+    `${nativeFire.late.toFixed(0)} ms`,
+    `${wheelFire.late.toFixed(0)} ms`,
+  ],
+];
+for (const row of rows) {
+  console.log(row[0].padEnd(12) + row[1].padStart(12) + row[2].padStart(12));
+}
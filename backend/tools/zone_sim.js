@@ -0,0 +1,185 @@
+// Simulates one zone of boards reading the same space, comparing each board
+// switching its fan on its own reading (controlFan on local thresholds)
+// with the zone decision of zones.js delivered in upload responses.
+//
+// Usage: node tools/zone_sim.js [--devices <n>] [--hours <n>]
+//                               [--upload-seconds <n>] [--spread <degC>]
+//
+// The zone temperature swings slowly around the fan threshold; every board
+// sees it with a fixed placement offset (+/- spread) plus sensor noise and
+// reads every SENSOR_READ_INTERVAL. In zone mode a board applies the zone
+// decision on the first control tick after its upload response arrives.
+//
+// Reported: ticks on which the boards' fans disagree, fan toggles per
+// board-hour, and command latency from a zone decision change to each
+// board applying it (and to the whole zone agreeing).
+
+import { createZoneRegistry } from "../zones.js";
+
+const SENSOR_READ_INTERVAL = 2000;
+const TEMP_HIGH = 30;
+const RESPONSE_LATENCY_MS = [20, 150];
+
+const options = {
+  devices: 6,
+  hours: 24,
+  uploadSeconds: 60,
+  spread: 0.8,
+};
+
+for (let i = 2; i < process.argv.length; i += 2) {
+  const name = process.argv[i].replace(/^--/, "");
+  const key = name.replace(/-(\w)/g, (_, c) => c.toUpperCase());
+  if (!(key in options) || i + 1 >= process.argv.length) {
+    console.error(
+      "usage: zone_sim.js [--devices <n>] [--hours <n>] " +
+        "[--upload-seconds <n>] [--spread <degC>]"
+    );
+    process.exit(2);
+  }
+  options[key] = Number(process.argv[i + 1]);
+}
+
+// Deterministic runs (mulberry32)
+let seed = 1;
+function random() {
+  seed = (seed + 0x6d2b79f5) | 0;
+  let t = Math.imul(seed ^ (seed >>> 15), 1 | seed);
+  t = (t + Math.imul(t ^ (t >>> 7), 61 | t)) ^ t;
+  return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+}
+
+function uniform(low, high) {
+  return low + (high - low) * random();
+}
+
+function zoneTemperature(t) {
+  return (
+    TEMP_HIGH +
+    1.5 * Math.sin((2 * Math.PI * t) / (2 * 3600 * 1000)) +
+    0.3 * Math.sin((2 * Math.PI * t) / (7 * 60 * 1000))
+  );
+}
+
+function percentile(values, p) {
+  if (values.length === 0) {
+    return 0;
+  }
+  const sorted = [...values].sort((a, b) => a - b);
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+const uploadMs = options.uploadSeconds * 1000;
+const ids = Array.from({ length: options.devices }, (_, i) => `board-${i}`);
+const zones = createZoneRegistry({ zones: { zone: { devices: ids } } });
+const boards = ids.map((id) => ({
+  id,
+  offset: uniform(-options.spread, options.spread),
+  nextUpload: uniform(0, uploadMs),
+  pending: [],
+  zoneFan: null,
+  local: { fan: false, toggles: 0 },
+  zoned: { fan: false, toggles: 0 },
+  appliedDecision: 0,
+}));
+
+let decision = null;
+let decisionCount = 0;
+let decisionTime = 0;
+const applyLatencies = [];
+const agreeLatencies = [];
+let waitingForAgreement = false;
+let localDisagree = 0;
+let zonedDisagree = 0;
+let ticks = 0;
+
+function setFan(state, fan) {
+  if (state.fan !== fan) {
+    state.toggles += 1;
+    state.fan = fan;
+  }
+}
+
+const endMs = options.hours * 3600 * 1000;
+for (let t = 0; t < endMs; t += SENSOR_READ_INTERVAL) {
+  for (const board of boards) {
+    // Responses that arrived since the last tick are applied first
+    while (board.pending.length && board.pending[0].at <= t) {
+      const response = board.pending.shift();
+      board.zoneFan = response.fan;
+      if (response.decision > board.appliedDecision) {
+        board.appliedDecision = response.decision;
+        applyLatencies.push(t - decisionTime);
+      }
+    }
+
+    const reading =
+      zoneTemperature(t) + board.offset + (random() - 0.5) * 0.2;
+    const localFan = reading >= TEMP_HIGH;
+    setFan(board.local, localFan);
+    setFan(board.zoned, board.zoneFan ?? localFan);
+
+    if (t >= board.nextUpload) {
+      const control = zones.record(
+        board.id,
+        { temperature: reading, humidity: 50 },
+        t
+      );
+      if (control.zone_fan !== decision) {
+        decision = control.zone_fan;
+        decisionCount += 1;
+        decisionTime = t;
+        waitingForAgreement = true;
+      }
+      board.pending.push({
+        at: t + uniform(...RESPONSE_LATENCY_MS),
+        fan: control.zone_fan,
+        decision: decisionCount,
+      });
+      board.nextUpload = t + uploadMs * uniform(0.9, 1.1);
+    }
+  }
+
+  ticks += 1;
+  const localFans = new Set(boards.map((board) => board.local.fan));
+  const zonedFans = new Set(boards.map((board) => board.zoned.fan));
+  localDisagree += localFans.size > 1 ? 1 : 0;
+  zonedDisagree += zonedFans.size > 1 ? 1 : 0;
+  if (
+    waitingForAgreement &&
+    boards.every((board) => board.appliedDecision === decisionCount)
+  ) {
+    agreeLatencies.push(t - decisionTime);
+    waitingForAgreement = false;
+  }
+}
+
+const boardHours = options.devices * options.hours;
+const toggles = (mode) =>
+  boards.reduce((sum, board) => sum + board[mode].toggles, 0) / boardHours;
+
+console.log(
+  `${options.devices} boards, ${options.hours} h, upload every ` +
+    `${options.uploadSeconds} s, placement +/-${options.spread} C\n`
+);
+console.log("mode    disagree  toggles/board-h");
+console.log(
+  `local   ${((100 * localDisagree) / ticks).toFixed(1).padStart(7)}%` +
+    `  ${toggles("local").toFixed(1).padStart(15)}`
+);
+console.log(
+  `zone    ${((100 * zonedDisagree) / ticks).toFixed(1).padStart(7)}%` +
+    `  ${toggles("zoned").toFixed(1).padStart(15)}`
+);
+console.log(
+  `\n${decisionCount} zone decisions; apply latency mean ` +
+    `${(
+      applyLatencies.reduce((a, b) => a + b, 0) /
+      Math.max(1, applyLatencies.length) /
+      1000
+    ).toFixed(1)} s, p95 ${(percentile(applyLatencies, 0.95) / 1000).toFixed(
+      1
+    )} s; whole zone agrees after p95 ` +
+    `${(percentile(agreeLatencies, 0.95) / 1000).toFixed(1)} s, max ` +
+    `${(Math.max(0, ...agreeLatencies) / 1000).toFixed(1)} s`
+);
@@ -0,0 +1,87 @@
+// Coalesces concurrent ingest calls into one database write. Rows wait at
+// most maxDelayMs, or until maxRows are queued; while a write is running
+// new rows keep queuing, so batches grow with load (a reconnect storm
+// becomes a few large COPYs instead of thousands of small INSERTs).
+// Each caller's promise settles with its own rows once their batch is
+// written. A write rejected for its data (SQLSTATE class 22 or 23, e.g.
+// a value outside numeric(5,2)) is one statement, so nothing of it was
+// stored: the batch is split in halves and retried until the failing
+// callers are isolated, and only they are rejected (one device's bad
+// reading does not fail everyone else's upload in the same window). Any
+// other failure (connection lost, pool timeout) rejects the whole batch
+// at once rather than retrying into an outage. Returns { add, drain };
+// drain() writes whatever is queued, e.g. before the process exits.
+
+const isDataError = (err) => /^2[23]/.test(err?.code ?? "");
+export function createBatchWriter({ write, maxRows = 5000, maxDelayMs = 20 }) {
+  let waiting = [];
+  let waitingRows = 0;
+  let timer = null;
+  let writing = null; // The batch being written
+
+  function schedule() {
+    if (waitingRows >= maxRows) {
+      flush();
+    } else if (!timer && !writing) {
+      timer = setTimeout(flush, maxDelayMs);
+    }
+  }
+
+  async function writeEntries(entries) {
+    try {
+      const written = await write(entries.flatMap((entry) => entry.rows));
+      let offset = 0;
+      for (const entry of entries) {
+        entry.resolve(written.slice(offset, offset + entry.rows.length));
+        offset += entry.rows.length;
+      }
+    } catch (err) {
+      if (entries.length === 1 || !isDataError(err)) {
+        for (const entry of entries) {
+          entry.reject(err);
+        }
+        return;
+      }
+      const half = entries.length >> 1;
+      await writeEntries(entries.slice(0, half));
+      await writeEntries(entries.slice(half));
+    }
+  }
+
+  async function flush() {
+    clearTimeout(timer);
+    timer = null;
+    if (writing || waiting.length === 0) {
+      return;
+    }
+    const batch = waiting;
+    waiting = [];
+    waitingRows = 0;
+    writing = writeEntries(batch);
+    try {
+      await writing;
+    } finally {
+      writing = null;
+      if (waiting.length) {
+        schedule();
+      }
+    }
+  }
+
+  function add(rows) {
+    return new Promise((resolve, reject) => {
+      waiting.push({ rows, resolve, reject });
+      waitingRows += rows.length;
+      schedule();
+    });
+  }
+
+  // Resolves once nothing is queued or being written
+  async function drain() {
+    while (writing || waiting.length) {
+      await (writing ?? flush());
+    }
+  }
+
+  return { add, drain };
+}
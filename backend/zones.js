@@ -0,0 +1,161 @@
+// Zone grouping of devices that share one space (e.g. a greenhouse).
+// Every ingested batch updates the zone's live aggregates incrementally:
+// running sums for the means, and the maximum, which is rescanned only when
+// the device holding it reports a lower value or goes stale. A zone's
+// latest readings are also linked in the order they arrived (a device that
+// reports again moves to the newest end), so expiry only looks at the
+// stale entries at the oldest end. Readings without a finite temperature and
+// humidity are left out, since one would poison the sums. Fans are then
+// switched per zone, with hysteresis on the zone mean, so the boards of one
+// zone no longer fight each other on their own local readings.
+
+export function createZoneRegistry({
+  zones = {},
+  staleMs = 5 * 60 * 1000,
+  tempHigh = 30,
+  hysteresis = 0.5,
+} = {}) {
+  const zoneOfDevice = new Map();
+  const states = [];
+  for (const [name, zone] of Object.entries(zones)) {
+    const state = {
+      name,
+      tempHigh: zone.temp_high ?? tempHigh,
+      latest: new Map(),
+      oldest: null, // Arrival order of the latest entries
+      newest: null,
+      temperatureSum: 0,
+      humiditySum: 0,
+      maxTemperature: -Infinity,
+      maxDevice: null,
+      fan: false,
+    };
+    states.push(state);
+    for (const deviceId of zone.devices ?? []) {
+      zoneOfDevice.set(deviceId, state);
+    }
+  }
+
+  function rescanMax(state) {
+    state.maxTemperature = -Infinity;
+    state.maxDevice = null;
+    for (const [deviceId, entry] of state.latest) {
+      if (entry.temperature > state.maxTemperature) {
+        state.maxTemperature = entry.temperature;
+        state.maxDevice = deviceId;
+      }
+    }
+  }
+
+  function unlink(state, deviceId) {
+    const entry = state.latest.get(deviceId);
+    if (!entry) {
+      return;
+    }
+    state.latest.delete(deviceId);
+    state.temperatureSum -= entry.temperature;
+    state.humiditySum -= entry.humidity;
+    if (entry.prev) {
+      entry.prev.next = entry.next;
+    } else {
+      state.oldest = entry.next;
+    }
+    if (entry.next) {
+      entry.next.prev = entry.prev;
+    } else {
+      state.newest = entry.prev;
+    }
+  }
+
+  function append(state, deviceId, entry) {
+    state.latest.set(deviceId, entry);
+    state.temperatureSum += entry.temperature;
+    state.humiditySum += entry.humidity;
+    entry.prev = state.newest;
+    if (state.newest) {
+      state.newest.next = entry;
+    } else {
+      state.oldest = entry;
+    }
+    state.newest = entry;
+  }
+
+  function remove(state, deviceId) {
+    unlink(state, deviceId);
+    if (state.maxDevice === deviceId) {
+      rescanMax(state);
+    }
+  }
+
+  function expire(state, now) {
+    while (state.oldest && now - state.oldest.at > staleMs) {
+      remove(state, state.oldest.deviceId);
+    }
+  }
+
+  function decide(state) {
+    if (state.latest.size === 0) {
+      return;
+    }
+    const mean = state.temperatureSum / state.latest.size;
+    if (mean >= state.tempHigh) {
+      state.fan = true;
+    } else if (mean < state.tempHigh - hysteresis) {
+      state.fan = false;
+    }
+  }
+
+  // Zone-level control for a device, or null when it belongs to no zone
+  function control(deviceId) {
+    const state = zoneOfDevice.get(deviceId);
+    return state ? { zone_fan: state.fan } : null;
+  }
+
+  // Records the newest reading of a device and returns its zone control
+  function record(deviceId, reading, now = Date.now()) {
+    const state = zoneOfDevice.get(deviceId);
+    const { temperature, humidity } = reading ?? {};
+    if (!state || !Number.isFinite(temperature) || !Number.isFinite(humidity)) {
+      return control(deviceId);
+    }
+    unlink(state, deviceId);
+    append(state, deviceId, {
+      deviceId,
+      temperature,
+      humidity,
+      at: now,
+      prev: null,
+      next: null,
+    });
+    if (temperature >= state.maxTemperature) {
+      state.maxTemperature = temperature;
+      state.maxDevice = deviceId;
+    } else if (state.maxDevice === deviceId) {
+      rescanMax(state);
+    }
+    expire(state, now);
+    decide(state);
+    return control(deviceId);
+  }
+
+  function summary(now = Date.now()) {
+    return states.map((state) => {
+      expire(state, now);
+      const devices = state.latest.size;
+      return {
+        zone: state.name,
+        devices,
+        temperature: devices ? state.temperatureSum / devices : null,
+        max_temperature: devices ? state.maxTemperature : null,
+        humidity: devices ? state.humiditySum / devices : null,
+        fan: state.fan,
+      };
+    });
+  }
+
+  function zoneOf(deviceId) {
+    return zoneOfDevice.get(deviceId)?.name ?? null;
+  }
+
+  return { record, control, summary, zoneOf };
+}